@@ -8,9 +8,6 @@
 
 namespace storage_engine {
 
-LockManager::LockManager() = default;
-LockManager::~LockManager() = default;
-
 std::unique_lock<std::shared_mutex> LockManager::acquireLock(const std::string& node_id) {
     auto& mutex = locks_[node_id];
     return std::unique_lock<std::shared_mutex>(mutex); // Acquire exclusive lock
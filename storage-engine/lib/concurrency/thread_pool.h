@@ -3,6 +3,7 @@
 #ifndef CORE_THREAD_POOL_H
 #define CORE_THREAD_POOL_H
 
+#include <condition_variable>
 #include <functional>
 #include <vector>
 #include <thread>
@@ -14,73 +15,17 @@ namespace storage_engine {
 
 class ThreadPool {
 public:
-    ThreadPool(size_t numThreads = std::thread::hardware_concurrency()) {
-        // Create the specified number of threads
-        for (size_t i = 0; i < numThreads; ++i) {
-            workers_.emplace_back([this]() {
-                while (true) {
-                    std::function<void()> task;
-
-                    {
-                        std::unique_lock<std::mutex> lock(queueMutex_);
-
-                        // Wait for a task or shutdown signal
-                        condition_.wait(lock, [this]() { return stop_ || !taskQueue_.empty(); });
-
-                        if (stop_ && taskQueue_.empty()) {
-                            return;
-                        }
-
-                        // Get the next task
-                        task = std::move(taskQueue_.front());
-                        taskQueue_.pop();
-                    }
-
-                    // Execute the task
-                    task();
-                }
-            });
-        }
-    }
-
-    ~ThreadPool() {
-        {
-            std::unique_lock<std::mutex> lock(queueMutex_);
-            stop_ = true;
-        }
-
-        condition_.notify_all(); // Notify all threads to stop
-        for (std::thread &worker : workers_) {
-            if (worker.joinable()) {
-                worker.join();
-            }
-        }
-    }
+    // Create the specified number of worker threads
+    explicit ThreadPool(size_t numThreads = std::thread::hardware_concurrency());
+    // Stop taking tasks, run the ones queued and join the workers
+    ~ThreadPool();
 
     // Submit a task to the thread pool
-    std::future<void> submitTask(std::function<void()> task) {
-        auto packaged_task = std::make_shared<std::packaged_task<void()>>(std::move(task));
-        std::future<void> future = packaged_task->get_future();
-
-        {
-            std::unique_lock<std::mutex> lock(queueMutex_);
-            if (stop_) {
-                throw std::runtime_error("Cannot submit tasks to a stopped thread pool");
-            }
-            taskQueue_.emplace([packaged_task]() { (*packaged_task)(); });
-        }
-
-        condition_.notify_one(); // Notify one thread to pick up the task
-        return future;
-    }
+    // throws std::runtime_error once the pool is stopped
+    std::future<void> submitTask(std::function<void()> task);
 
     // Cancel all tasks (mark the pool as stopped)
-    void cancelAllTasks() {
-        std::unique_lock<std::mutex> lock(queueMutex_);
-        stop_ = true;
-        taskQueue_ = {}; // Clear the queue
-        condition_.notify_all(); // Notify all threads to stop
-    }
+    void cancelAllTasks();
 
 private:
     std::vector<std::thread> workers_; // Vector of worker threads
@@ -0,0 +1,110 @@
+// arena.cpp
+//
+// Implementation of Arena (bump allocator for memtable entries) for the storage engine.
+
+#include "core/arena.h"
+#include <cstring>
+
+namespace storage_engine {
+
+Arena::Arena(MemoryTracker* tracker) : tracker_(tracker) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    current_.store(newBlock(kBlockSize), std::memory_order_release);
+}
+
+Arena::~Arena() {
+    if (tracker_ != nullptr) {
+        tracker_->release(MemoryTracker::Component::kMemtables, memory_usage_.load());
+    }
+}
+
+char* Arena::allocate(size_t bytes) {
+    return allocate(bytes, 1);
+}
+
+char* Arena::allocateAligned(size_t bytes) {
+    return allocate(bytes, alignof(std::max_align_t));
+}
+
+const char* Arena::copy(const char* data, size_t len) {
+    char* mem = allocate(len);
+    if (len > 0) {
+        std::memcpy(mem, data, len);
+    }
+    return mem;
+}
+
+size_t Arena::memoryUsage() const noexcept {
+    return memory_usage_.load(std::memory_order_relaxed);
+}
+
+void Arena::reset() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    blocks_.clear();
+    if (tracker_ != nullptr) {
+        tracker_->release(MemoryTracker::Component::kMemtables, memory_usage_.load());
+    }
+    memory_usage_ = 0;
+    current_.store(newBlock(kBlockSize), std::memory_order_release);
+}
+
+char* Arena::allocate(size_t bytes, size_t alignment) {
+    if (bytes == 0) {
+        bytes = 1;
+    }
+
+    Block* block = current_.load(std::memory_order_acquire);
+    size_t used = block->used.load(std::memory_order_relaxed);
+    while (true) {
+        size_t start = (used + alignment - 1) & ~(alignment - 1);
+        if (start + bytes > block->size) {
+            return allocateFallback(block, bytes, alignment);
+        }
+        if (block->used.compare_exchange_weak(used, start + bytes, std::memory_order_relaxed)) {
+            return block->data.get() + start;
+        }
+    }
+}
+
+char* Arena::allocateFallback(Block* full, size_t bytes, size_t alignment) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // big requests get a block of their own so the current block isn't wasted
+    if (bytes > kBlockSize / 4) {
+        return newBlock(bytes)->data.get();
+    }
+
+    // another writer may already have switched blocks while we waited
+    Block* block = current_.load(std::memory_order_acquire);
+    if (block == full) {
+        block = newBlock(kBlockSize);
+        current_.store(block, std::memory_order_release);
+    }
+
+    size_t used = block->used.load(std::memory_order_relaxed);
+    while (true) {
+        size_t start = (used + alignment - 1) & ~(alignment - 1);
+        if (start + bytes > block->size) {
+            // the fresh block filled up under us, start over on a new one
+            block = newBlock(kBlockSize);
+            current_.store(block, std::memory_order_release);
+            used = 0;
+            continue;
+        }
+        if (block->used.compare_exchange_weak(used, start + bytes, std::memory_order_relaxed)) {
+            return block->data.get() + start;
+        }
+    }
+}
+
+Arena::Block* Arena::newBlock(size_t size) {
+    // new[] returns memory aligned for any fundamental type
+    blocks_.push_back(std::make_unique<Block>(size));
+    memory_usage_.fetch_add(size + sizeof(Block), std::memory_order_relaxed);
+    if (tracker_ != nullptr) {
+        tracker_->consume(MemoryTracker::Component::kMemtables, size + sizeof(Block));
+    }
+    return blocks_.back().get();
+}
+
+} // namespace storage_engine
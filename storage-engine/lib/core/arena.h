@@ -0,0 +1,70 @@
+#pragma once
+
+#ifndef CORE_ARENA_H
+#define CORE_ARENA_H
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "core/memory_tracker.h"
+
+namespace storage_engine {
+
+// Bump allocator owned by a memtable.
+//
+// Keys, node metadata and adjacency entries are carved out of large blocks
+// and never freed individually; everything is released in one shot by
+// reset() (or the destructor) once the memtable has been flushed.
+// allocate() is safe to call from concurrent writers: the fast path is a
+// CAS on the current block, only switching blocks takes the mutex.
+// Blocks are charged to the memtable component of `tracker` (if given) as
+// they are reserved and released with them.
+class Arena {
+public:
+    explicit Arena(MemoryTracker* tracker = nullptr);
+    ~Arena();
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    // Unaligned bytes, for string payloads
+    char* allocate(size_t bytes);
+
+    // Bytes aligned for any object type
+    char* allocateAligned(size_t bytes);
+
+    // Copy `len` bytes into the arena and return the copy
+    const char* copy(const char* data, size_t len);
+
+    // Total bytes reserved from the system (blocks, not just bytes handed out)
+    size_t memoryUsage() const noexcept;
+
+    // Release every block at once. Not safe against concurrent allocate().
+    void reset();
+
+private:
+    static constexpr size_t kBlockSize = 64 * 1024;
+
+    struct Block {
+        explicit Block(size_t size) : data(new char[size]), size(size) {}
+        std::unique_ptr<char[]> data;
+        const size_t size;
+        std::atomic<size_t> used{0};
+    };
+
+    std::atomic<Block*> current_{nullptr};
+    std::vector<std::unique_ptr<Block>> blocks_;  // guarded by mutex_
+    std::mutex mutex_;
+    std::atomic<size_t> memory_usage_{0};
+    MemoryTracker* tracker_ = nullptr;
+
+    char* allocate(size_t bytes, size_t alignment);
+    char* allocateFallback(Block* full, size_t bytes, size_t alignment);
+    Block* newBlock(size_t size);
+};
+
+} // namespace storage_engine
+
+#endif // CORE_ARENA_H
@@ -0,0 +1,214 @@
+// block.cpp
+//
+// Implementation of SSTable blocks (BlockBuilder, BlockReader) for the storage engine.
+
+#include "core/block.h"
+#include "core/utils.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace storage_engine {
+
+void BlockHandle::encodeTo(std::string& dst) const {
+    Util::putVarint64(dst, offset);
+    Util::putVarint64(dst, size);
+}
+
+bool BlockHandle::decodeFrom(std::string_view& input) {
+    return Util::getVarint64(input, offset) && Util::getVarint64(input, size);
+}
+
+bool BlockHandle::fitsWithin(uint64_t limit) const noexcept {
+    return offset <= limit && size <= limit - offset;
+}
+
+BlockBuilder::BlockBuilder(int restart_interval)
+    : restart_interval_(restart_interval < 1 ? 1 : restart_interval), restarts_{0} {}
+
+void BlockBuilder::add(std::string_view key, std::string_view value) {
+    if (num_entries_ > 0 && key <= std::string_view(last_key_)) {
+        throw std::invalid_argument("Block keys must be added in increasing order");
+    }
+
+    size_t shared = 0;
+    if (counter_ < restart_interval_) {
+        size_t max_shared = std::min(last_key_.size(), key.size());
+        while (shared < max_shared && last_key_[shared] == key[shared]) {
+            ++shared;
+        }
+    } else {
+        // restart point: the full key, so a search can start decoding here
+        restarts_.push_back(static_cast<uint32_t>(buffer_.size()));
+        counter_ = 0;
+    }
+
+    Util::putVarint32(buffer_, static_cast<uint32_t>(shared));
+    Util::putVarint32(buffer_, static_cast<uint32_t>(key.size() - shared));
+    Util::putVarint32(buffer_, static_cast<uint32_t>(value.size()));
+    buffer_.append(key.data() + shared, key.size() - shared);
+    buffer_.append(value.data(), value.size());
+
+    last_key_.assign(key.data(), key.size());
+    ++counter_;
+    ++num_entries_;
+}
+
+std::string BlockBuilder::finish() {
+    for (uint32_t restart : restarts_) {
+        Util::putFixed32(buffer_, restart);
+    }
+    Util::putFixed32(buffer_, static_cast<uint32_t>(restarts_.size()));
+
+    std::string block;
+    block.swap(buffer_);
+    restarts_.assign(1, 0);
+    counter_ = 0;
+    num_entries_ = 0;
+    last_key_.clear();
+    return block;
+}
+
+size_t BlockBuilder::sizeEstimate() const {
+    return buffer_.size() + (restarts_.size() + 1) * sizeof(uint32_t);
+}
+
+bool BlockBuilder::empty() const {
+    return num_entries_ == 0;
+}
+
+const std::string& BlockBuilder::lastKey() const {
+    return last_key_;
+}
+
+BlockReader::BlockReader(std::string contents) : owned_(std::move(contents)) {
+    parseTrailer(owned_);
+}
+
+BlockReader::BlockReader(std::string_view contents) {
+    parseTrailer(contents);
+}
+
+void BlockReader::parseTrailer(std::string_view contents) {
+    if (contents.size() < sizeof(uint32_t)) {
+        throw std::runtime_error("Corrupted block: too short");
+    }
+    num_restarts_ = Util::decodeFixed32(contents.data() + contents.size() - sizeof(uint32_t));
+
+    size_t trailer = (static_cast<size_t>(num_restarts_) + 1) * sizeof(uint32_t);
+    if (num_restarts_ == 0 || trailer > contents.size()) {
+        throw std::runtime_error("Corrupted block: bad restart array");
+    }
+    data_ = contents.substr(0, contents.size() - trailer);
+    restarts_ = contents.substr(data_.size(), num_restarts_ * sizeof(uint32_t));
+    size_ = contents.size();
+}
+
+uint32_t BlockReader::restartOffset(uint32_t index) const {
+    return Util::decodeFixed32(restarts_.data() + index * sizeof(uint32_t));
+}
+
+std::string_view BlockReader::restartKey(uint32_t index) const {
+    uint32_t offset = restartOffset(index);
+    if (offset > data_.size()) {
+        throw std::runtime_error("Corrupted block: bad restart point");
+    }
+
+    std::string_view entry = data_.substr(offset);
+    uint32_t shared = 0;
+    uint32_t non_shared = 0;
+    uint32_t value_len = 0;
+    if (!Util::getVarint32(entry, shared) || !Util::getVarint32(entry, non_shared) ||
+        !Util::getVarint32(entry, value_len) || shared != 0 || entry.size() < non_shared) {
+        throw std::runtime_error("Corrupted block: bad restart entry");
+    }
+    return entry.substr(0, non_shared);
+}
+
+bool BlockReader::get(std::string_view key, std::string_view& value) const {
+    Iterator it(this);
+    it.Seek(key);
+    if (it.Valid() && it.key() == key) {
+        value = it.value();
+        return true;
+    }
+    return false;
+}
+
+size_t BlockReader::size() const noexcept {
+    return size_;
+}
+
+BlockReader::Iterator::Iterator(const BlockReader* block) : block_(block) {
+    SeekToFirst();
+}
+
+bool BlockReader::Iterator::Valid() const {
+    return valid_;
+}
+
+std::string_view BlockReader::Iterator::key() const {
+    return key_;
+}
+
+std::string_view BlockReader::Iterator::value() const {
+    return value_;
+}
+
+void BlockReader::Iterator::Next() {
+    parseNext();
+}
+
+void BlockReader::Iterator::Seek(std::string_view target) {
+    // last restart point whose key is < target, the answer is at or after it
+    uint32_t left = 0;
+    uint32_t right = block_->num_restarts_ - 1;
+    while (left < right) {
+        uint32_t mid = left + (right - left + 1) / 2;
+        if (block_->restartKey(mid) < target) {
+            left = mid;
+        } else {
+            right = mid - 1;
+        }
+    }
+
+    seekToRestart(left);
+    do {
+        parseNext();
+    } while (valid_ && std::string_view(key_) < target);
+}
+
+void BlockReader::Iterator::SeekToFirst() {
+    seekToRestart(0);
+    parseNext();
+}
+
+void BlockReader::Iterator::seekToRestart(uint32_t index) {
+    key_.clear();
+    next_ = block_->restartOffset(index);
+}
+
+void BlockReader::Iterator::parseNext() {
+    if (next_ >= block_->data_.size()) {
+        valid_ = false;
+        return;
+    }
+
+    std::string_view rest = block_->data_.substr(next_);
+    const size_t before = rest.size();
+    uint32_t shared = 0;
+    uint32_t non_shared = 0;
+    uint32_t value_len = 0;
+    if (!Util::getVarint32(rest, shared) || !Util::getVarint32(rest, non_shared) ||
+        !Util::getVarint32(rest, value_len) || shared > key_.size() ||
+        rest.size() < static_cast<size_t>(non_shared) + value_len) {
+        throw std::runtime_error("Corrupted block: bad entry");
+    }
+
+    key_.resize(shared);
+    key_.append(rest.data(), non_shared);
+    value_ = rest.substr(non_shared, value_len);
+    next_ += (before - rest.size()) + non_shared + value_len;
+    valid_ = true;
+}
+
+} // namespace storage_engine
@@ -0,0 +1,119 @@
+#pragma once
+
+#ifndef CORE_BLOCK_H
+#define CORE_BLOCK_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace storage_engine {
+
+// Location of a block inside an SSTable file
+struct BlockHandle {
+    uint64_t offset = 0;
+    uint64_t size = 0;
+
+    void encodeTo(std::string& dst) const;
+    // false if `input` doesn't start with a valid handle
+    bool decodeFrom(std::string_view& input);
+    // whether the block lies within the first `limit` bytes. a decoded
+    // handle is untrusted, offset + size may wrap around
+    bool fitsWithin(uint64_t limit) const noexcept;
+};
+
+// Builds a block of sorted key/value entries, the unit SSTables are read in.
+// Keys are prefix compressed: each entry only stores the bytes that differ
+// from the previous key. Every restart_interval entries a full key is
+// written (a restart point) so lookups can binary search the restarts and
+// then decode at most restart_interval entries.
+//
+//   entry:   [varint shared][varint non_shared][varint value_len]
+//            [key bytes after the shared prefix][value]
+//   trailer: [fixed32 restart offset] x num_restarts [fixed32 num_restarts]
+class BlockBuilder {
+public:
+    explicit BlockBuilder(int restart_interval = 16);
+
+    // keys must be added in strictly increasing order
+    void add(std::string_view key, std::string_view value);
+
+    // Append the trailer and return the block, the builder starts over
+    std::string finish();
+
+    // Bytes the block would take if finished now
+    size_t sizeEstimate() const;
+    bool empty() const;
+    const std::string& lastKey() const;
+
+private:
+    const int restart_interval_;
+    std::string buffer_;
+    std::vector<uint32_t> restarts_;
+    int counter_ = 0;           // entries since the last restart
+    uint32_t num_entries_ = 0;
+    std::string last_key_;
+};
+
+// Read-only view of a finished block. It owns the bytes it was built from
+// unless given a view, in which case the caller keeps them alive.
+class BlockReader {
+public:
+    // throws std::runtime_error if the block is malformed
+    explicit BlockReader(std::string contents);
+    explicit BlockReader(std::string_view contents);
+
+    // data_ may point into owned_, so the reader stays where it was built
+    BlockReader(const BlockReader&) = delete;
+    BlockReader& operator=(const BlockReader&) = delete;
+
+    // Value stored under key, false if the block doesn't have it
+    bool get(std::string_view key, std::string_view& value) const;
+
+    // bytes of the block itself
+    size_t size() const noexcept;
+
+    class Iterator {
+    public:
+        explicit Iterator(const BlockReader* block);
+
+        bool Valid() const;
+        // valid until the iterator moves
+        std::string_view key() const;
+        std::string_view value() const;
+
+        void Next();
+        // first entry with key >= target: binary search over the restart
+        // points, then a linear scan inside one restart interval
+        void Seek(std::string_view target);
+        void SeekToFirst();
+
+    private:
+        const BlockReader* block_;
+        size_t next_ = 0;         // offset of the entry after the current one
+        std::string key_;         // current key, rebuilt from the shared prefix
+        std::string_view value_;
+        bool valid_ = false;
+
+        void seekToRestart(uint32_t index);
+        // decode the entry at next_
+        void parseNext();
+    };
+
+private:
+    std::string owned_;
+    std::string_view data_;       // entries, trailer excluded
+    std::string_view restarts_;   // fixed32 offsets of the restart points
+    uint32_t num_restarts_ = 0;
+    size_t size_ = 0;
+
+    void parseTrailer(std::string_view contents);
+    uint32_t restartOffset(uint32_t index) const;
+    // full key stored at a restart point
+    std::string_view restartKey(uint32_t index) const;
+};
+
+} // namespace storage_engine
+
+#endif // CORE_BLOCK_H
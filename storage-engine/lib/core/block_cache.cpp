@@ -0,0 +1,227 @@
+// block_cache.cpp
+//
+// Implementation of BlockCache (sharded cache of SSTable blocks) for the storage engine.
+
+#include "core/block_cache.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace storage_engine {
+
+namespace {
+
+// passes of the CLOCK hand an entry survives after it was last used
+constexpr uint8_t kClockLow = 1;
+constexpr uint8_t kClockHigh = 3;
+
+} // namespace
+
+size_t BlockCache::KeyHash::operator()(const Key& key) const noexcept {
+    uint64_t h = key.file_id * 0x9e3779b97f4a7c15ull ^ key.offset * 0xc2b2ae3d27d4eb4full;
+    return static_cast<size_t>(h ^ (h >> 29));
+}
+
+BlockCache::BlockCache(size_t capacity, Policy policy, size_t num_shards, double high_priority_ratio,
+                       MemoryTracker* tracker)
+    : policy_(policy), capacity_(capacity), tracker_(tracker) {
+    num_shards = std::max<size_t>(1, num_shards);
+    shard_capacity_ = capacity / num_shards;
+    high_pool_capacity_ = static_cast<size_t>(shard_capacity_ * std::clamp(high_priority_ratio, 0.0, 1.0));
+    for (size_t i = 0; i < num_shards; ++i) {
+        auto shard = std::make_unique<Shard>();
+        shard->hand = shard->low.end();
+        shards_.push_back(std::move(shard));
+    }
+}
+
+BlockCache::~BlockCache() {
+    if (tracker_ != nullptr) {
+        tracker_->release(MemoryTracker::Component::kBlockCache, memoryUsage());
+    }
+}
+
+uint64_t BlockCache::newFileId() noexcept {
+    return next_file_id_.fetch_add(1, std::memory_order_relaxed);
+}
+
+BlockCache::Handle BlockCache::lookup(uint64_t file_id, uint64_t offset) {
+    Key key{file_id, offset};
+    Shard& shard = shardFor(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    auto it = shard.map.find(key);
+    if (it == shard.map.end()) {
+        stats_.misses.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+    }
+    touch(shard, it->second);
+    stats_.hits.fetch_add(1, std::memory_order_relaxed);
+    return it->second->value;
+}
+
+BlockCache::Handle BlockCache::insert(uint64_t file_id, uint64_t offset, std::string contents, Priority priority) {
+    size_t charge = contents.size() + kEntryOverhead;
+    Handle value = std::make_shared<const std::string>(std::move(contents));
+    if (charge > shard_capacity_) {
+        return value;
+    }
+
+    Key key{file_id, offset};
+    Shard& shard = shardFor(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    // two readers missed on the same block, the later copy replaces the first
+    auto existing = shard.map.find(key);
+    if (existing != shard.map.end()) {
+        unlink(shard, existing->second);
+    }
+    while (shard.usage + charge > shard_capacity_ && evictOne(shard) != 0) {
+    }
+
+    link(shard, Entry{key, value, charge, priority});
+    stats_.inserts.fetch_add(1, std::memory_order_relaxed);
+    return value;
+}
+
+size_t BlockCache::evict(size_t bytes) {
+    size_t freed = 0;
+    for (auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        while (freed < bytes) {
+            size_t evicted = evictOne(*shard);
+            if (evicted == 0) {
+                break;
+            }
+            freed += evicted;
+        }
+        if (freed >= bytes) {
+            break;
+        }
+    }
+    return freed;
+}
+
+size_t BlockCache::memoryUsage() const {
+    size_t usage = 0;
+    for (const auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        usage += shard->usage;
+    }
+    return usage;
+}
+
+size_t BlockCache::capacity() const noexcept {
+    return capacity_;
+}
+
+const BlockCacheStats& BlockCache::stats() const noexcept {
+    return stats_;
+}
+
+BlockCache::Policy BlockCache::policyFromString(const std::string& name) {
+    if (name == "lru") {
+        return Policy::kLRU;
+    }
+    if (name == "clock") {
+        return Policy::kClock;
+    }
+    throw std::invalid_argument("Unknown block cache policy: " + name);
+}
+
+BlockCache::Shard& BlockCache::shardFor(const Key& key) {
+    // the low bits pick the hash bucket inside the shard, use the high ones
+    return *shards_[(KeyHash{}(key) >> 32) % shards_.size()];
+}
+
+void BlockCache::touch(Shard& shard, EntryList::iterator it) {
+    if (policy_ == Policy::kClock) {
+        it->clock = it->priority == Priority::kHigh ? kClockHigh : kClockLow;
+        return;
+    }
+    EntryList& list = it->in_high_pool ? shard.high : shard.low;
+    list.splice(list.begin(), list, it);
+}
+
+void BlockCache::link(Shard& shard, Entry entry) {
+    shard.usage += entry.charge;
+    if (tracker_ != nullptr) {
+        tracker_->consume(MemoryTracker::Component::kBlockCache, entry.charge);
+    }
+
+    Key key = entry.key;
+    EntryList::iterator it;
+    if (policy_ == Policy::kClock) {
+        // right behind the hand, the last entry it reaches. a data block
+        // only earns a pass once it is read again, so one-off scans go first
+        entry.clock = entry.priority == Priority::kHigh ? kClockHigh : 0;
+        it = shard.low.insert(shard.hand, std::move(entry));
+    } else if (entry.priority == Priority::kHigh && high_pool_capacity_ > 0) {
+        entry.in_high_pool = true;
+        shard.high_usage += entry.charge;
+        shard.high.push_front(std::move(entry));
+        it = shard.high.begin();
+
+        // the high pool overflows into the low one, oldest first
+        while (shard.high_usage > high_pool_capacity_) {
+            auto oldest = std::prev(shard.high.end());
+            oldest->in_high_pool = false;
+            shard.high_usage -= oldest->charge;
+            shard.low.splice(shard.low.begin(), shard.high, oldest);
+        }
+    } else {
+        shard.low.push_front(std::move(entry));
+        it = shard.low.begin();
+    }
+    shard.map[key] = it;
+}
+
+void BlockCache::unlink(Shard& shard, EntryList::iterator it) {
+    shard.usage -= it->charge;
+    if (tracker_ != nullptr) {
+        tracker_->release(MemoryTracker::Component::kBlockCache, it->charge);
+    }
+    shard.map.erase(it->key);
+
+    if (it->in_high_pool) {
+        shard.high_usage -= it->charge;
+        shard.high.erase(it);
+        return;
+    }
+    if (it == shard.hand) {
+        ++shard.hand;
+    }
+    shard.low.erase(it);
+}
+
+size_t BlockCache::evictOne(Shard& shard) {
+    EntryList::iterator victim;
+    if (policy_ == Policy::kClock) {
+        if (shard.low.empty()) {
+            return 0;
+        }
+        while (true) {
+            if (shard.hand == shard.low.end()) {
+                shard.hand = shard.low.begin();
+            }
+            if (shard.hand->clock == 0) {
+                break;
+            }
+            --shard.hand->clock;
+            ++shard.hand;
+        }
+        victim = shard.hand;
+    } else if (!shard.low.empty()) {
+        victim = std::prev(shard.low.end());
+    } else if (!shard.high.empty()) {
+        victim = std::prev(shard.high.end());
+    } else {
+        return 0;
+    }
+
+    size_t charge = victim->charge;
+    unlink(shard, victim);
+    stats_.evictions.fetch_add(1, std::memory_order_relaxed);
+    return charge;
+}
+
+} // namespace storage_engine
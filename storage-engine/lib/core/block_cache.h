@@ -0,0 +1,133 @@
+#pragma once
+
+#ifndef CORE_BLOCK_CACHE_H
+#define CORE_BLOCK_CACHE_H
+
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "core/memory_tracker.h"
+
+namespace storage_engine {
+
+// Counters of a BlockCache
+struct BlockCacheStats {
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> misses{0};
+    std::atomic<uint64_t> inserts{0};
+    std::atomic<uint64_t> evictions{0};
+};
+
+// Uncompressed SSTable blocks kept in memory, keyed by (file id, block
+// offset) and bounded in bytes. The key space is split over shards with
+// a mutex each, so concurrent readers rarely contend.
+//
+// Index and filter blocks are inserted with high priority: every lookup
+// in their file goes through them, so they outlive data blocks.
+//  - LRU keeps them in a pool of at most high_priority_ratio of each
+//    shard, overflowing into the low pool; the low pool is evicted first.
+//  - CLOCK gives them more passes of the hand before they go.
+//
+// Lookups return shared handles, a block evicted while a reader holds it
+// is freed when the reader lets go.
+class BlockCache {
+public:
+    enum class Policy { kLRU, kClock };
+    enum class Priority { kLow, kHigh };
+
+    using Handle = std::shared_ptr<const std::string>;
+
+    // capacity in bytes, 0 caches nothing. blocks are charged to the block
+    // cache component of `tracker` when one is given
+    explicit BlockCache(size_t capacity, Policy policy = Policy::kLRU, size_t num_shards = 16,
+                        double high_priority_ratio = 0.5, MemoryTracker* tracker = nullptr);
+    ~BlockCache();
+
+    BlockCache(const BlockCache&) = delete;
+    BlockCache& operator=(const BlockCache&) = delete;
+
+    // Unique id for a file to key its blocks by, file names and numbers
+    // may be reused once a table is deleted
+    uint64_t newFileId() noexcept;
+
+    // nullptr on a miss
+    Handle lookup(uint64_t file_id, uint64_t offset);
+
+    // Cache a block and return a handle to it. A block bigger than a
+    // shard is handed back without being cached
+    Handle insert(uint64_t file_id, uint64_t offset, std::string contents, Priority priority);
+
+    // Drop blocks until at least `bytes` are freed, returns the bytes freed
+    size_t evict(size_t bytes);
+
+    size_t memoryUsage() const;
+    size_t capacity() const noexcept;
+    const BlockCacheStats& stats() const noexcept;
+
+    // "lru" or "clock", throws std::invalid_argument otherwise
+    static Policy policyFromString(const std::string& name);
+
+private:
+    struct Key {
+        uint64_t file_id;
+        uint64_t offset;
+        bool operator==(const Key& other) const noexcept {
+            return file_id == other.file_id && offset == other.offset;
+        }
+    };
+
+    struct KeyHash {
+        size_t operator()(const Key& key) const noexcept;
+    };
+
+    struct Entry {
+        Key key;
+        Handle value;
+        size_t charge;
+        Priority priority;
+        bool in_high_pool = false;  // LRU: which list holds it
+        uint8_t clock = 0;          // CLOCK: passes left before eviction
+    };
+
+    using EntryList = std::list<Entry>;
+
+    struct Shard {
+        std::mutex mutex;
+        std::unordered_map<Key, EntryList::iterator, KeyHash> map;
+        // LRU: most recently used first. CLOCK only uses `low` as its ring
+        EntryList high;
+        EntryList low;
+        EntryList::iterator hand;
+        size_t usage = 0;
+        size_t high_usage = 0;
+    };
+
+    const Policy policy_;
+    const size_t capacity_;
+    size_t shard_capacity_;
+    size_t high_pool_capacity_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+    std::atomic<uint64_t> next_file_id_{1};
+    MemoryTracker* tracker_ = nullptr;
+    BlockCacheStats stats_;
+
+    // bookkeeping of a cached block besides its bytes
+    static constexpr size_t kEntryOverhead = sizeof(Entry) + 2 * sizeof(void*) + MemoryTracker::kHashNodeOverhead;
+
+    Shard& shardFor(const Key& key);
+
+    // callers hold the shard mutex
+    void touch(Shard& shard, EntryList::iterator it);
+    void link(Shard& shard, Entry entry);
+    void unlink(Shard& shard, EntryList::iterator it);
+    size_t evictOne(Shard& shard);
+};
+
+} // namespace storage_engine
+
+#endif // CORE_BLOCK_CACHE_H
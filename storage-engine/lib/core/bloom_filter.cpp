@@ -0,0 +1,99 @@
+// bloom_filter.cpp
+//
+// Implementation of BloomFilter (per-SSTable key filter) for the storage engine.
+
+#include "core/bloom_filter.h"
+#include "core/utils.h"
+#include <algorithm>
+
+namespace storage_engine {
+
+BloomFilter::BloomFilter(int bits_per_key) : bits_per_key_(std::max(1, bits_per_key)) {
+    // k = bits_per_key * ln(2) minimizes the false positive rate
+    num_probes_ = std::clamp(static_cast<int>(bits_per_key_ * 0.69), 1, 30);
+}
+
+std::string BloomFilter::build(const std::vector<std::string_view>& keys) const {
+    std::vector<uint32_t> hashes;
+    hashes.reserve(keys.size());
+    for (const auto& key : keys) {
+        hashes.push_back(hash(key));
+    }
+    return buildFromHashes(hashes);
+}
+
+std::string BloomFilter::buildFromHashes(const std::vector<uint32_t>& hashes) const {
+    // tiny filters have a high false positive rate, keep a floor
+    size_t bits = std::max<size_t>(64, hashes.size() * bits_per_key_);
+    size_t bytes = (bits + 7) / 8;
+    bits = bytes * 8;
+
+    std::string filter(bytes, '\0');
+    filter.push_back(static_cast<char>(num_probes_));
+
+    // double hashing: probe i is h + i * delta
+    for (uint32_t h : hashes) {
+        const uint32_t delta = (h >> 17) | (h << 15);
+        for (int i = 0; i < num_probes_; ++i) {
+            uint32_t bit = h % bits;
+            filter[bit / 8] |= static_cast<char>(1 << (bit % 8));
+            h += delta;
+        }
+    }
+    return filter;
+}
+
+bool BloomFilter::mayContain(std::string_view filter, std::string_view key) {
+    if (filter.size() < 2) {
+        return true;
+    }
+
+    const size_t bits = (filter.size() - 1) * 8;
+    const int num_probes = static_cast<unsigned char>(filter.back());
+    if (num_probes < 1 || num_probes > 30) {
+        // written by a newer encoding, don't guess
+        return true;
+    }
+
+    uint32_t h = hash(key);
+    const uint32_t delta = (h >> 17) | (h << 15);
+    for (int i = 0; i < num_probes; ++i) {
+        uint32_t bit = h % bits;
+        if ((filter[bit / 8] & (1 << (bit % 8))) == 0) {
+            return false;
+        }
+        h += delta;
+    }
+    return true;
+}
+
+uint32_t BloomFilter::hash(std::string_view key) {
+    // murmur-like, 4 bytes at a time
+    const uint32_t seed = 0xbc9f1d34;
+    const uint32_t m = 0xc6a4a793;
+    uint32_t h = seed ^ static_cast<uint32_t>(key.size() * m);
+
+    size_t i = 0;
+    for (; i + 4 <= key.size(); i += 4) {
+        h += Util::decodeFixed32(key.data() + i);
+        h *= m;
+        h ^= (h >> 16);
+    }
+
+    switch (key.size() - i) {
+        case 3:
+            h += static_cast<uint32_t>(static_cast<unsigned char>(key[i + 2])) << 16;
+            [[fallthrough]];
+        case 2:
+            h += static_cast<uint32_t>(static_cast<unsigned char>(key[i + 1])) << 8;
+            [[fallthrough]];
+        case 1:
+            h += static_cast<unsigned char>(key[i]);
+            h *= m;
+            h ^= (h >> 24);
+            break;
+    }
+    return h;
+}
+
+} // namespace storage_engine
@@ -0,0 +1,44 @@
+#pragma once
+
+#ifndef CORE_BLOOM_FILTER_H
+#define CORE_BLOOM_FILTER_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace storage_engine {
+
+// Bloom filter over the keys of one SSTable, stored in the file next to the
+// index. A negative answer is definite, so a lookup for a key the table
+// doesn't hold costs no data block read.
+//
+//   filter: [bit array][1 byte: number of probes]
+class BloomFilter {
+public:
+    // ~1% false positives at 10 bits per key
+    explicit BloomFilter(int bits_per_key = 10);
+
+    // Build the filter for `keys`
+    std::string build(const std::vector<std::string_view>& keys) const;
+
+    // Same, from the hash() of each key. lets a writer drop the keys
+    // themselves as soon as they are written
+    std::string buildFromHashes(const std::vector<uint32_t>& hashes) const;
+
+    // false only if key was definitely not among the keys the filter was
+    // built from. an empty or unknown filter says yes to everything
+    static bool mayContain(std::string_view filter, std::string_view key);
+
+    // hash stored on disk, so it must not change between builds
+    static uint32_t hash(std::string_view key);
+
+private:
+    int bits_per_key_;
+    int num_probes_;
+};
+
+} // namespace storage_engine
+
+#endif // CORE_BLOOM_FILTER_H
@@ -3,28 +3,210 @@
 // Implementation of CompactionManager for the storage engine.
 
 #include "core/compaction_manager.h"
+#include "concurrency/thread_pool.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iterator>
 #include <stdexcept>
 
 namespace storage_engine {
 
-CompactionManager::CompactionManager() = default;
+namespace {
 
-CompactionManager::CompactionManager(const std::string& sstable_filename) 
-    : sstable_filename_(sstable_filename) {}
+// number of a table file, named "<number>.sst"
+std::optional<uint64_t> tableNumber(const std::filesystem::path& path) {
+    if (path.extension() != ".sst") {
+        return std::nullopt;
+    }
+    try {
+        return std::stoull(path.stem().string());
+    } catch (const std::exception&) {
+        return std::nullopt; // not one of ours
+    }
+}
 
-void CompactionManager::run() {
-    if (old_memtables_.empty()) {
-        return; // Nothing to compact
+// key range and entry count of a table nobody described to us
+void describeTable(const SSTableReader& reader, FileMetaData& file) {
+    file.path = reader.filename();
+    file.file_size = reader.fileSize();
+    file.num_entries = 0;
+    SSTableReader::Iterator it(&reader);
+    for (it.SeekToFirst(); it.Valid(); it.Next()) {
+        if (file.num_entries++ == 0) {
+            file.smallest = std::string(it.key());
+        }
+        file.largest = std::string(it.key());
+    }
+}
+
+// Run every task on the pool and the calling thread, returning once all
+// are done. the caller takes whatever the pool hasn't started yet, so it
+// never waits on a pool whose threads are all blocked on it
+void runTasks(ThreadPool* pool, const std::vector<std::function<void()>>& tasks) {
+    struct Shared {
+        const std::vector<std::function<void()>>* tasks;
+        std::atomic<size_t> next{0};
+        std::mutex mutex;
+        std::condition_variable finished;
+        size_t done = 0;
+    };
+    auto shared = std::make_shared<Shared>();
+    shared->tasks = &tasks;
+    size_t count = tasks.size();
+
+    // tasks must not throw. a helper that starts late finds nothing left
+    // and never touches tasks, which may be gone by then
+    auto work = [shared, count]() {
+        for (size_t i = shared->next++; i < count; i = shared->next++) {
+            (*shared->tasks)[i]();
+            std::lock_guard<std::mutex> lock(shared->mutex);
+            if (++shared->done == count) {
+                shared->finished.notify_all();
+            }
+        }
+    };
+
+    for (size_t i = 1; i < count && pool != nullptr; ++i) {
+        try {
+            pool->submitTask(work);
+        } catch (const std::exception&) {
+            break; // the pool is shutting down, we do the rest
+        }
     }
+    work();
 
-    // Merge old memtables into a new SSTable
-    SSTable new_table = mergeOldMemtables();
+    std::unique_lock<std::mutex> lock(shared->mutex);
+    shared->finished.wait(lock, [&]() { return shared->done == count; });
+}
+
+// records of a key newest first, folded oldest first
+std::optional<GraphNodeMeta> foldRecords(std::vector<GraphNodeMeta>& records) {
+    if (records.empty()) {
+        return std::nullopt;
+    }
+    GraphNodeMeta folded = std::move(records.back());
+    for (auto it = std::next(records.rbegin()); it != records.rend(); ++it) {
+        folded.merge(*it);
+    }
+    return folded;
+}
+
+bool hasDeletedConnection(const GraphNodeMeta& meta) {
+    const auto& connections = meta.get_connections();
+    return std::any_of(connections.begin(), connections.end(), [](const auto& conn) { return conn.second == '0'; });
+}
+
+} // namespace
+
+CompactionManager::CompactionManager()
+    : live_(std::make_shared<LiveTables>()), policy_(CompactionPolicy::create(compaction_options_)) {
+    options_.compression_stats = &compression_stats_;
+    openLiveTables();
+}
+
+CompactionManager::CompactionManager(const SSTableOptions& options)
+    : options_(options), live_(std::make_shared<LiveTables>()),
+      policy_(CompactionPolicy::create(compaction_options_)) {
+    options_.compression_stats = &compression_stats_;
+    openLiveTables();
+}
 
+CompactionManager::CompactionManager(const std::string& data_directory, const SSTableOptions& options,
+                                     const CompactionOptions& compaction_options)
+    : options_(options), compaction_options_(compaction_options), versions_(data_directory),
+      live_(std::make_shared<LiveTables>()), policy_(CompactionPolicy::create(compaction_options_)) {
+    options_.compression_stats = &compression_stats_;
+    bool had_manifest = versions_.recover();
+
+    // tables the manifest doesn't name are outputs of a flush or compaction
+    // that never committed. without any manifest they are the flushes of
+    // a version that didn't keep one, those are adopted at level 0
+    std::vector<std::pair<uint64_t, std::filesystem::path>> unlisted;
+    for (const auto& entry : std::filesystem::directory_iterator(data_directory)) {
+        auto number = tableNumber(entry.path());
+        if (number) {
+            unlisted.emplace_back(*number, entry.path());
+        }
+    }
+    auto version = versions_.current();
+    for (int level = 0; level < version->numLevels(); ++level) {
+        for (const auto& file : version->files(level)) {
+            unlisted.erase(std::remove_if(unlisted.begin(), unlisted.end(),
+                                          [&](const auto& table) { return table.first == file->number; }),
+                           unlisted.end());
+        }
+    }
+
+    if (had_manifest) {
+        for (const auto& table : unlisted) {
+            std::filesystem::remove(table.second);
+        }
+        openLiveTables();
+        return;
+    }
+
+    openLiveTables();
+    std::sort(unlisted.begin(), unlisted.end());
+    for (const auto& table : unlisted) {
+        syncTable(table.second.string());
+    }
+    if (!unlisted.empty()) {
+        syncDirectory();
+    }
+    for (const auto& table : unlisted) {
+        versions_.markFileNumberUsed(table.first);
+        auto reader = std::make_shared<SSTableReader>(table.second.string(), options_, &read_stats_);
+        FileMetaData file;
+        file.number = table.first;
+        describeTable(*reader, file);
+        file.smallest_sequence = versions_.allocateSequences(std::max<uint64_t>(1, file.num_entries));
+        file.largest_sequence = file.smallest_sequence + std::max<uint64_t>(1, file.num_entries) - 1;
+        VersionEdit edit;
+        edit.addFile(0, file);
+        install(edit, {{file.number, reader}});
+    }
+}
+
+void CompactionManager::run() {
+    std::lock_guard<std::mutex> lock(compaction_mutex_);
+
+    if (!old_memtables_.empty() && !versions_.directory().empty()) {
+        // k-way merge of the memtables into a new level 0 SSTable, written
+        // as it is merged. a node's records are folded oldest memtable
+        // first, so later edge deltas land on top of earlier ones
+        std::vector<std::unique_ptr<MergeSource>> sources;
+        for (auto* memtable : old_memtables_) {
+            sources.push_back(std::make_unique<MemtableSource>(memtable->newIterator()));
+        }
+        MergingIterator input(std::move(sources));
+        input.SeekToFirst();
+
+        Subcompaction output;
+        writeTables(input, nullptr, options_, 0, false, output);
+        if (!output.outputs.empty()) {
+            FileMetaData& file = output.outputs.front();
+            file.smallest_sequence = versions_.allocateSequences(file.num_entries);
+            file.largest_sequence = file.smallest_sequence + file.num_entries - 1;
+            syncDirectory();
+            VersionEdit edit;
+            edit.addFile(0, file);
+            install(edit, output.readers);
+        }
+        releaseData(output.released_data_ids);
+    }
     // Clear old memtables after merging
     clearOldMemtables();
 
-    // Write new_table to disk
-    writeSSTableToDisk(new_table);
+    while (compactOnce()) {
+    }
 }
 
 void CompactionManager::triggerCompaction() {
@@ -36,22 +218,546 @@ CompactionManager* CompactionManager::get() {
 }
 
 std::vector<unsigned char> CompactionManager::getNodeData(const std::string& key) {
-    SSTable sstable;
-    return sstable.readFromDisk(sstable_filename_, key); // Read from disk using SSTable's method
+    auto live = liveTables();
+    for (const auto& file : live->version->filesForKey(key)) {
+        if (auto value = live->readers.at(file->number)->get(key)) {
+            return std::move(*value);
+        }
+    }
+    throw std::runtime_error("Key not found in SSTables: " + key);
 }
 
-SSTable CompactionManager::mergeOldMemtables() {
-    SSTable merged_table;
+std::optional<GraphNodeMeta> CompactionManager::getNodeMeta(const std::string& key, std::string_view neighbor_prefix) {
+    auto live = liveTables();
 
-    for (auto* memtable : old_memtables_) {
-        auto entries = memtable->getEntries(); // Assuming getEntries returns a vector of entries
+    // collect newest first until a record hides everything older. files
+    // whose key range excludes the key are never touched
+    std::vector<GraphNodeMeta> records;
+    std::string scratch;
+    for (const auto& file : live->version->filesForKey(key)) {
+        const auto& reader = live->readers.at(file->number);
+        auto value = reader->getView(key, scratch);
+        if (!value) {
+            continue;
+        }
+        GraphNodeMeta meta;
+        if (!meta.decodeFrom(*value, neighbor_prefix)) {
+            throw std::runtime_error("Corrupted record of " + key + " in " + reader->filename());
+        }
+        records.push_back(std::move(meta));
+        if (!records.back().is_delta()) {
+            break;
+        }
+    }
+    return foldRecords(records);
+}
+
+std::vector<std::optional<GraphNodeMeta>> CompactionManager::multiGetNodeMeta(const std::vector<std::string>& keys,
+                                                                              std::string_view neighbor_prefix) {
+    auto live = liveTables();
+
+    // per key the files that may hold it, newest first, and the records
+    // found in them so far
+    struct KeyState {
+        Version::FileList files;
+        size_t next = 0;
+        std::vector<GraphNodeMeta> records;
+    };
+    std::vector<KeyState> states(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+        states[i].files = live->version->filesForKey(keys[i]);
+    }
+
+    std::vector<TableLookup> lookups;
+    std::vector<size_t> owners;
+    while (true) {
+        lookups.clear();
+        owners.clear();
+        for (size_t i = 0; i < keys.size(); ++i) {
+            auto& state = states[i];
+            if (state.next < state.files.size() && (state.records.empty() || state.records.back().is_delta())) {
+                lookups.push_back({live->readers.at(state.files[state.next++]->number).get(), keys[i], std::nullopt});
+                owners.push_back(i);
+            }
+        }
+        if (lookups.empty()) {
+            break;
+        }
 
-        for (const auto& entry : entries) {
-            merged_table.insert(entry); // Insert each entry into the merged table
+        SSTableReader::multiGet(lookups, options_.io_backend);
+        for (size_t j = 0; j < lookups.size(); ++j) {
+            if (!lookups[j].value) {
+                continue;
+            }
+            GraphNodeMeta meta;
+            if (!meta.decodeFrom(*lookups[j].value, neighbor_prefix)) {
+                throw std::runtime_error("Corrupted record of " + lookups[j].key + " in " +
+                                         lookups[j].reader->filename());
+            }
+            states[owners[j]].records.push_back(std::move(meta));
         }
     }
 
-    return merged_table;
+    std::vector<std::optional<GraphNodeMeta>> results;
+    results.reserve(keys.size());
+    for (auto& state : states) {
+        results.push_back(foldRecords(state.records));
+    }
+    return results;
+}
+
+void CompactionManager::forEachLiveNode(const std::function<void(std::string_view key)>& fn) const {
+    auto live = liveTables();
+
+    // fold oldest first: the deepest level up, level 0 lists newest first
+    std::vector<std::unique_ptr<MergeSource>> sources;
+    for (int level = live->version->numLevels() - 1; level >= 0; --level) {
+        const auto& files = live->version->files(level);
+        for (auto file = files.rbegin(); file != files.rend(); ++file) {
+            sources.push_back(std::make_unique<SSTableSource>(live->readers.at((*file)->number).get()));
+        }
+    }
+    MergingIterator input(std::move(sources));
+    for (input.SeekToFirst(); input.Valid(); input.Next()) {
+        if (!input.value().is_tombstone()) {
+            fn(input.key());
+        }
+    }
+}
+
+void CompactionManager::addSSTable(const std::string& filename) {
+    // open outside the lock, it reads the footer and index from disk
+    auto reader = std::make_shared<SSTableReader>(filename, options_, &read_stats_);
+    FileMetaData file;
+    file.number = versions_.newFileNumber();
+    describeTable(*reader, file);
+    file.smallest_sequence = versions_.allocateSequences(std::max<uint64_t>(1, file.num_entries));
+    file.largest_sequence = file.smallest_sequence + std::max<uint64_t>(1, file.num_entries) - 1;
+
+    VersionEdit edit;
+    edit.addFile(0, file);
+    install(edit, {{file.number, reader}});
+}
+
+void CompactionManager::addFlushedFile(FileMetaData file) {
+    syncTable(file.path);
+    syncDirectory();
+    auto reader = std::make_shared<SSTableReader>(file.path, options_, &read_stats_);
+    file.smallest_sequence = versions_.allocateSequences(std::max<uint64_t>(1, file.num_entries));
+    file.largest_sequence = file.smallest_sequence + std::max<uint64_t>(1, file.num_entries) - 1;
+
+    VersionEdit edit;
+    edit.addFile(0, file);
+    install(edit, {{file.number, reader}});
+}
+
+void CompactionManager::setLogCheckpoint(uint64_t position) {
+    if (position <= versions_.logCheckpoint()) {
+        return;
+    }
+    VersionEdit edit;
+    edit.setLogCheckpoint(position);
+    install(edit, {});
+}
+
+uint64_t CompactionManager::logCheckpoint() const noexcept {
+    return versions_.logCheckpoint();
+}
+
+uint64_t CompactionManager::newFileNumber() {
+    return versions_.newFileNumber();
+}
+
+void CompactionManager::setDataReleaseCallback(DataReleaseCallback callback) {
+    std::lock_guard<std::mutex> lock(compaction_mutex_);
+    on_data_released_ = std::move(callback);
+}
+
+void CompactionManager::setThreadPool(ThreadPool* pool) {
+    std::lock_guard<std::mutex> lock(compaction_mutex_);
+    thread_pool_ = pool;
+}
+
+std::shared_ptr<const Version> CompactionManager::currentVersion() const {
+    return liveTables()->version;
+}
+
+std::vector<double> CompactionManager::levelScores() const {
+    return policy_->scores(*currentVersion());
+}
+
+const SSTableReadStats& CompactionManager::readStats() const noexcept {
+    return read_stats_;
+}
+
+const CompactionStats& CompactionManager::compactionStats() const noexcept {
+    return stats_;
+}
+
+const CompressionStats& CompactionManager::compressionStats() const noexcept {
+    return compression_stats_;
+}
+
+const SSTableOptions& CompactionManager::sstableOptions() const noexcept {
+    return options_;
+}
+
+std::shared_ptr<const CompactionManager::LiveTables> CompactionManager::liveTables() const {
+    std::lock_guard<std::mutex> lock(sstables_mutex_);
+    return live_;
+}
+
+void CompactionManager::openLiveTables() {
+    auto live = std::make_shared<LiveTables>();
+    live->version = versions_.current();
+    for (int level = 0; level < live->version->numLevels(); ++level) {
+        for (const auto& file : live->version->files(level)) {
+            live->readers[file->number] = std::make_shared<SSTableReader>(file->path, options_, &read_stats_);
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(sstables_mutex_);
+    live_ = std::move(live);
+}
+
+void CompactionManager::install(VersionEdit& edit, const ReaderMap& new_readers) {
+    // the manifest and live_ must change in the same order, installs are
+    // serialized without blocking lookups on the manifest sync
+    std::lock_guard<std::mutex> install_lock(install_mutex_);
+    versions_.logAndApply(edit);
+
+    auto live = std::make_shared<LiveTables>();
+    live->version = versions_.current();
+    auto previous = liveTables();
+    for (int level = 0; level < live->version->numLevels(); ++level) {
+        for (const auto& file : live->version->files(level)) {
+            auto it = previous->readers.find(file->number);
+            if (it != previous->readers.end()) {
+                live->readers.emplace(file->number, it->second);
+            }
+        }
+    }
+    for (const auto& [number, reader] : new_readers) {
+        live->readers[number] = reader;
+    }
+
+    std::lock_guard<std::mutex> lock(sstables_mutex_);
+    live_ = std::move(live);
+}
+
+bool CompactionManager::compactOnce() {
+    if (versions_.directory().empty()) {
+        return false;
+    }
+
+    auto version = versions_.current();
+    std::optional<CompactionJob> job = policy_->pick(*version);
+    if (!job) {
+        return false;
+    }
+
+    // nothing to merge the file with, it only changes level
+    if (job->isTrivialMove()) {
+        const auto& input = job->inputs.front();
+        VersionEdit edit;
+        edit.deleteFile(input.level, input.files.front()->number);
+        edit.addFile(job->output_level, *input.files.front());
+        install(edit, {});
+        stats_.trivial_moves.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // fold oldest first, the job lists its inputs newest first
+    Version::FileList ordered;
+    for (auto input = job->inputs.rbegin(); input != job->inputs.rend(); ++input) {
+        ordered.insert(ordered.end(), input->files.rbegin(), input->files.rend());
+    }
+
+    auto live = liveTables();
+    uint64_t smallest_sequence = UINT64_MAX;
+    uint64_t largest_sequence = 0;
+    for (const auto& file : ordered) {
+        smallest_sequence = std::min(smallest_sequence, file->smallest_sequence);
+        largest_sequence = std::max(largest_sequence, file->largest_sequence);
+        live->readers.at(file->number)->adviseAccessPattern(SSTableReader::AccessPattern::kSequential);
+    }
+
+    // the bottom of the tree holds most of the data and is rewritten least,
+    // trade write time for size
+    SSTableOptions output_options = options_;
+    if (job->bottommost) {
+        output_options.compression = options_.bottommost_compression;
+    }
+
+    // disjoint key ranges merged side by side, their outputs are disjoint
+    // too and are installed together
+    std::vector<std::string> boundaries = subcompactionBoundaries(*live, *job);
+    std::vector<Subcompaction> subcompactions(boundaries.size() + 1);
+    std::vector<std::function<void()>> tasks;
+    for (size_t i = 0; i < subcompactions.size(); ++i) {
+        subcompactions[i].lower = i > 0 ? &boundaries[i - 1] : nullptr;
+        subcompactions[i].upper = i < boundaries.size() ? &boundaries[i] : nullptr;
+        tasks.push_back([&, i]() {
+            try {
+                runSubcompaction(*live, ordered, output_options, job->bottommost, subcompactions[i]);
+            } catch (...) {
+                subcompactions[i].error = std::current_exception();
+            }
+        });
+    }
+    runTasks(thread_pool_, tasks);
+
+    for (const auto& file : ordered) {
+        live->readers.at(file->number)->adviseAccessPattern(SSTableReader::AccessPattern::kRandom);
+    }
+
+    VersionEdit edit;
+    ReaderMap new_readers;
+    std::exception_ptr error;
+    for (auto& sub : subcompactions) {
+        error = error ? error : sub.error;
+        new_readers.insert(sub.readers.begin(), sub.readers.end());
+        for (auto& file : sub.outputs) {
+            file.smallest_sequence = smallest_sequence;
+            file.largest_sequence = largest_sequence;
+            edit.addFile(job->output_level, file);
+        }
+    }
+    if (error) {
+        for (const auto& [number, reader] : new_readers) {
+            std::filesystem::remove(reader->filename());
+        }
+        std::rethrow_exception(error);
+    }
+    for (const auto& input : job->inputs) {
+        for (const auto& file : input.files) {
+            edit.deleteFile(input.level, file->number);
+        }
+    }
+
+    try {
+        if (!new_readers.empty()) {
+            syncDirectory();
+        }
+        install(edit, new_readers);
+    } catch (...) {
+        for (const auto& [number, reader] : new_readers) {
+            std::filesystem::remove(reader->filename());
+        }
+        throw;
+    }
+
+    // lookups that still hold the old tables keep reading through their
+    // open descriptors
+    uint64_t bytes_read = 0;
+    for (const auto& file : ordered) {
+        bytes_read += file->file_size;
+        std::filesystem::remove(file->path);
+    }
+    uint64_t bytes_written = 0;
+    for (const auto& sub : subcompactions) {
+        for (const auto& file : sub.outputs) {
+            bytes_written += file.file_size;
+        }
+        releaseData(sub.released_data_ids);
+    }
+    stats_.compactions.fetch_add(1, std::memory_order_relaxed);
+    stats_.bytes_read.fetch_add(bytes_read, std::memory_order_relaxed);
+    stats_.bytes_written.fetch_add(bytes_written, std::memory_order_relaxed);
+    if (bytes_read > bytes_written) {
+        stats_.bytes_reclaimed.fetch_add(bytes_read - bytes_written, std::memory_order_relaxed);
+    }
+    return true;
+}
+
+std::vector<std::string> CompactionManager::subcompactionBoundaries(const LiveTables& live,
+                                                                  const CompactionJob& job) const {
+    // level 0 outputs stay one file, under size-tiered each level 0 file
+    // is a run of its own
+    size_t max_ranges = compaction_options_.max_subcompactions;
+    if (max_ranges <= 1 || thread_pool_ == nullptr || job.output_level == 0) {
+        return {};
+    }
+
+    // the data blocks of all inputs, cut where each range holds its share
+    std::vector<std::pair<std::string, uint64_t>> anchors;
+    uint64_t total = 0;
+    for (const auto& input : job.inputs) {
+        for (const auto& file : input.files) {
+            for (auto& anchor : live.readers.at(file->number)->blockAnchors()) {
+                total += anchor.second;
+                anchors.push_back(std::move(anchor));
+            }
+        }
+    }
+    if (anchors.size() < 2) {
+        return {};
+    }
+    std::sort(anchors.begin(), anchors.end());
+
+    std::vector<std::string> boundaries;
+    uint64_t bytes = 0;
+    for (const auto& [key, size] : anchors) {
+        bytes += size;
+        if (boundaries.size() + 1 < max_ranges && bytes >= total * (boundaries.size() + 1) / max_ranges &&
+            (boundaries.empty() || key > boundaries.back())) {
+            boundaries.push_back(key);
+        }
+    }
+    // nothing sorts after the largest key, a range above it would be empty
+    while (!boundaries.empty() && boundaries.back() >= anchors.back().first) {
+        boundaries.pop_back();
+    }
+    return boundaries;
+}
+
+void CompactionManager::runSubcompaction(const LiveTables& live, const Version::FileList& files,
+                                         const SSTableOptions& options, bool bottommost, Subcompaction& sub) {
+    std::vector<std::unique_ptr<MergeSource>> sources;
+    for (const auto& file : files) {
+        sources.push_back(std::make_unique<SSTableSource>(live.readers.at(file->number).get()));
+    }
+    MergingIterator input(std::move(sources));
+    if (sub.lower != nullptr) {
+        input.Seek(*sub.lower);
+        if (input.Valid() && input.key() == *sub.lower) {
+            input.Next();
+        }
+    } else {
+        input.SeekToFirst();
+    }
+    writeTables(input, sub.upper, options, compaction_options_.target_file_size, bottommost, sub);
+}
+
+void CompactionManager::writeTables(MergingIterator& input, const std::string* upper, const SSTableOptions& options,
+                                   uint64_t target_file_size, bool bottommost, Subcompaction& output) {
+    auto& outputs = output.outputs;
+    auto& readers = output.readers;
+    size_t first_output = outputs.size();
+    size_t first_release = output.released_data_ids.size();
+    std::ofstream out;
+    std::unique_ptr<SSTableBuilder> builder;
+    FileMetaData file;
+
+    auto finishTable = [&]() {
+        builder->finish();
+        out.close();
+        if (!out) {
+            throw std::runtime_error("Failed to write SSTable: " + file.path);
+        }
+        syncTable(file.path);
+        file.file_size = builder->fileSize();
+        file.num_entries = builder->numEntries();
+        file.smallest = builder->firstKey();
+        file.largest = builder->lastKey();
+        builder.reset();
+        readers.emplace(file.number, std::make_shared<SSTableReader>(file.path, options_, &read_stats_));
+        outputs.push_back(std::move(file));
+        file = FileMetaData();
+    };
+
+    try {
+        std::string encoded;
+        GraphNodeMeta stripped;
+        for (; input.Valid() && (upper == nullptr || input.key() <= *upper); input.Next()) {
+            const auto& replaced = input.replacedDataIds();
+            output.released_data_ids.insert(output.released_data_ids.end(), replaced.begin(), replaced.end());
+
+            // a tombstone only has to shadow older records, at the bottom
+            // there are none. a full node lists every edge it has, so its
+            // deleted ones cancel nothing; a delta's do until the bottom
+            const GraphNodeMeta* record = &input.value();
+            if (bottommost && record->is_tombstone()) {
+                stats_.tombstones_dropped.fetch_add(1, std::memory_order_relaxed);
+                stats_.records_dropped.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+            if ((bottommost || !record->is_delta()) && hasDeletedConnection(*record)) {
+                stripped = *record;
+                stats_.edges_dropped.fetch_add(stripped.remove_deleted_connections(), std::memory_order_relaxed);
+                record = &stripped;
+                if (record->is_delta() && record->get_connections().empty()) {
+                    stats_.records_dropped.fetch_add(1, std::memory_order_relaxed);
+                    continue;
+                }
+            }
+
+            if (!builder) {
+                file.number = versions_.newFileNumber();
+                file.path =
+                    (std::filesystem::path(versions_.directory()) / (std::to_string(file.number) + ".sst")).string();
+                out.open(file.path, std::ios::binary | std::ios::trunc);
+                if (!out) {
+                    throw std::runtime_error("Failed to open file for writing: " + file.path);
+                }
+                builder = std::make_unique<SSTableBuilder>(out, options);
+            }
+
+            encoded.clear();
+            record->encodeTo(encoded);
+            builder->add(input.key(), encoded);
+            if (target_file_size > 0 && builder->fileSize() >= target_file_size) {
+                finishTable();
+            }
+        }
+        if (builder) {
+            finishTable();
+        }
+    } catch (...) {
+        if (builder) {
+            builder.reset();
+            out.close();
+            std::filesystem::remove(file.path);
+        }
+        for (size_t i = first_output; i < outputs.size(); ++i) {
+            readers.erase(outputs[i].number);
+            std::filesystem::remove(outputs[i].path);
+        }
+        outputs.resize(first_output);
+        output.released_data_ids.resize(first_release);
+        throw;
+    }
+}
+
+void CompactionManager::syncTable(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to open " + path + " for sync: " + std::strerror(errno));
+    }
+    int status = ::fdatasync(fd);
+    int error = errno;
+    ::close(fd);
+    if (status != 0) {
+        throw std::runtime_error("Failed to sync SSTable " + path + ": " + std::strerror(error));
+    }
+    stats_.tables_synced.fetch_add(1, std::memory_order_relaxed);
+}
+
+void CompactionManager::syncDirectory() {
+    if (versions_.directory().empty()) {
+        return;
+    }
+    int fd = ::open(versions_.directory().c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to open " + versions_.directory() + " for sync: " + std::strerror(errno));
+    }
+    int status = ::fsync(fd);
+    int error = errno;
+    ::close(fd);
+    if (status != 0) {
+        throw std::runtime_error("Failed to sync directory " + versions_.directory() + ": " + std::strerror(error));
+    }
+    stats_.directory_syncs.fetch_add(1, std::memory_order_relaxed);
+}
+
+void CompactionManager::releaseData(const std::vector<std::string>& data_ids) {
+    if (!on_data_released_) {
+        return;
+    }
+    for (const auto& data_id : data_ids) {
+        on_data_released_(data_id);
+        stats_.data_ids_released.fetch_add(1, std::memory_order_relaxed);
+    }
 }
 
 void CompactionManager::clearOldMemtables() {
@@ -61,8 +767,4 @@ void CompactionManager::clearOldMemtables() {
     old_memtables_.clear(); // Clear the list
 }
 
-void CompactionManager::writeSSTableToDisk(const SSTable& table) {
-    table.writeToDisk(sstable_filename_); // Use the writeToDisk method from SSTable class
-}
-
 } // namespace storage_engine
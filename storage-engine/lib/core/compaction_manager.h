@@ -3,20 +3,58 @@
 #ifndef CORE_COMPACTION_MANAGER_H
 #define CORE_COMPACTION_MANAGER_H
 
+#include "core/compaction_policy.h"
 #include "core/memtable.h"
+#include "core/merging_iterator.h"
 #include "core/sstable.h"
+#include "core/version_set.h"
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
 #include <vector>
 #include <string>
 
 namespace storage_engine {
 
+class ThreadPool;
+
+// What compactions did, and how much they gave back
+struct CompactionStats {
+    std::atomic<uint64_t> compactions{0};       // inputs merged into new tables
+    std::atomic<uint64_t> trivial_moves{0};     // tables that only changed level
+    std::atomic<uint64_t> bytes_read{0};        // table bytes of the inputs
+    std::atomic<uint64_t> bytes_written{0};     // table bytes of the outputs
+    std::atomic<uint64_t> bytes_reclaimed{0};   // inputs minus outputs, where they shrank
+    std::atomic<uint64_t> records_dropped{0};   // keys with no output record
+    std::atomic<uint64_t> tombstones_dropped{0};
+    std::atomic<uint64_t> edges_dropped{0};     // deleted connections written out
+    std::atomic<uint64_t> data_ids_released{0}; // node data nothing refers to anymore
+    std::atomic<uint64_t> tables_synced{0};     // fdatasync'd before the manifest listed them
+    std::atomic<uint64_t> directory_syncs{0};   // fsyncs of the data directory for new tables
+};
+
+// Owns the live SSTables: which files exist at which level (the VersionSet
+// and its manifest), an open reader for each, and the compactions that
+// move data down the levels.
 class CompactionManager {
 public:
-    // Constructors
+    // Constructors. without a data directory nothing is persisted and
+    // nothing is compacted, the manager only serves the tables added to it
     CompactionManager();
-    explicit CompactionManager(const std::string& sstable_filename);
+    explicit CompactionManager(const SSTableOptions& options);
+
+    // Tables and manifest live in data_directory, the live tables of an
+    // earlier run are reopened
+    // throws std::runtime_error if the manifest is corrupted or names a
+    // table that can't be opened
+    explicit CompactionManager(const std::string& data_directory, const SSTableOptions& options = SSTableOptions(),
+                               const CompactionOptions& compaction_options = CompactionOptions());
 
-    // Run the compaction process
+    // Run the compactions the policy picks until no level is over its limit
     void run();
 
     // Trigger a manual compaction
@@ -25,21 +63,150 @@ public:
     // Accessor to return the instance
     CompactionManager* get();
 
-    // Read node data from an SSTable given its key
+    // Read node data from an SSTable given its key, newest file first
+    // throws std::runtime_error if no SSTable holds the key
     std::vector<unsigned char> getNodeData(const std::string& key);
 
+    // Record of a node folded across every SSTable, newest first down to
+    // the first full node or tombstone. Only connections starting with
+    // neighbor_prefix are decoded. std::nullopt if no SSTable has the node
+    // throws std::runtime_error on a corrupted record
+    std::optional<GraphNodeMeta> getNodeMeta(const std::string& key, std::string_view neighbor_prefix = {});
+
+    // getNodeMeta() of many keys at once. the SSTables are probed in
+    // rounds, newest first: each round reads the next table of every key
+    // still missing a full record, with all its block reads in flight
+    // together on the io backend of the SSTable options
+    // throws std::runtime_error on a read error or a corrupted record
+    std::vector<std::optional<GraphNodeMeta>> multiGetNodeMeta(const std::vector<std::string>& keys,
+                                                               std::string_view neighbor_prefix = {});
+
+    // Call fn in key order with every key whose records across the SSTables
+    // fold to a node that exists, i.e. the newest full record isn't a
+    // tombstone. one merged pass over all the live tables
+    // throws std::runtime_error on a corrupted record
+    void forEachLiveNode(const std::function<void(std::string_view key)>& fn) const;
+
+    // Register an SSTable written elsewhere at level 0, it shadows every
+    // older one. the file is scanned for its key range
+    // throws std::runtime_error if the file is not a readable SSTable
+    void addSSTable(const std::string& filename);
+
+    // Register a table a flush just wrote at level 0. the writer fills in
+    // number, path, size, key range and entry count. the table and its
+    // directory entry are synced before the manifest lists it
+    // throws std::runtime_error if the table can't be synced, opened or logged
+    void addFlushedFile(FileMetaData file);
+
+    // Log to the manifest that every write-ahead log record ending at or
+    // before position is in a live table, so replay can skip them
+    // throws std::runtime_error if the manifest can't be written
+    void setLogCheckpoint(uint64_t position);
+
+    // the newest checkpoint logged, 0 if there is none
+    uint64_t logCheckpoint() const noexcept;
+
+    // Number for a new table file, never reused
+    uint64_t newFileNumber();
+
+    // Called with the data id of every node record a compaction replaced
+    // (by a newer record or a tombstone), once the compaction is live. the
+    // payload behind it can go
+    using DataReleaseCallback = std::function<void(const std::string& data_id)>;
+    void setDataReleaseCallback(DataReleaseCallback callback);
+
+    // Pool subcompactions run on, nullptr runs them all on the compacting
+    // thread. unset it before the pool goes away
+    void setThreadPool(ThreadPool* pool);
+
+    // live files by level
+    std::shared_ptr<const Version> currentVersion() const;
+
+    // how far each level is over its limit, see CompactionPolicy::scores()
+    std::vector<double> levelScores() const;
+
+    // filter and block read counters of every SSTable lookup
+    const SSTableReadStats& readStats() const noexcept;
+
+    const CompactionStats& compactionStats() const noexcept;
+
+    // codec counters of every SSTable written or read through these options
+    const CompressionStats& compressionStats() const noexcept;
+
+    // options flushes should write with, they share compressionStats()
+    const SSTableOptions& sstableOptions() const noexcept;
+
 private:
+    // a version and an open reader for each of its files, swapped as a
+    // whole so a lookup never sees one without the other
+    using ReaderMap = std::unordered_map<uint64_t, std::shared_ptr<SSTableReader>>;
+    struct LiveTables {
+        std::shared_ptr<const Version> version;
+        ReaderMap readers;  // by file number
+    };
+
+    // The keys in (lower, upper] of a compaction, a null bound is open.
+    // each one writes its own output files
+    struct Subcompaction {
+        const std::string* lower = nullptr;
+        const std::string* upper = nullptr;
+        std::vector<FileMetaData> outputs;
+        ReaderMap readers;
+        std::vector<std::string> released_data_ids;
+        std::exception_ptr error;
+    };
+
     std::vector<Memtable*> old_memtables_; // List of old memtables to be compacted
-    std::string sstable_filename_;        // Filename for the SSTable
+    SSTableOptions options_;               // How compaction writes SSTables
+    CompactionOptions compaction_options_;
+    SSTableReadStats read_stats_;
+    CompactionStats stats_;
+    CompressionStats compression_stats_;
+    VersionSet versions_;
+    std::shared_ptr<const LiveTables> live_;
+    mutable std::mutex sstables_mutex_;    // Guards live_
+    std::mutex install_mutex_;             // Serializes version changes
+    std::mutex compaction_mutex_;          // One compaction at a time
+    std::unique_ptr<CompactionPolicy> policy_;
+    ThreadPool* thread_pool_ = nullptr;
+    DataReleaseCallback on_data_released_;
+
+    std::shared_ptr<const LiveTables> liveTables() const;
+    void openLiveTables();
 
-    // Merge old memtables into a single SSTable
-    SSTable mergeOldMemtables();
+    // Log the edit and swap in the readers of the files it adds
+    void install(VersionEdit& edit, const ReaderMap& new_readers);
+
+    // A table the manifest is about to list has to be on disk first, and
+    // so does its name in the data directory. both count in stats_
+    // throws std::runtime_error if the sync fails
+    void syncTable(const std::string& path);
+    void syncDirectory();
+
+    // Stream input up to upper (inclusive, null for all of it) into new
+    // numbered tables, cut once they reach target_file_size (0 never cuts).
+    // deleted edges of full nodes are dropped, and at the bottom of the
+    // tree tombstones and deleted edges of deltas too
+    // on an error the tables written so far are removed again
+    void writeTables(MergingIterator& input, const std::string* upper, const SSTableOptions& options,
+                     uint64_t target_file_size, bool bottommost, Subcompaction& output);
+
+    // Hand the released data ids of a live compaction to the callback
+    void releaseData(const std::vector<std::string>& data_ids);
+
+    // Run one compaction picked by the policy, false if no level needs one
+    bool compactOnce();
+
+    // Keys splitting the job's inputs into ranges of about the same number
+    // of bytes, empty if it isn't worth splitting
+    std::vector<std::string> subcompactionBoundaries(const LiveTables& live, const CompactionJob& job) const;
+
+    // Merge files (oldest first) within the range of sub into new tables
+    void runSubcompaction(const LiveTables& live, const Version::FileList& files, const SSTableOptions& options,
+                          bool bottommost, Subcompaction& sub);
 
     // Clear old memtables after compaction
     void clearOldMemtables();
-
-    // Write the newly created SSTable to disk
-    void writeSSTableToDisk(const SSTable& table);
 };
 
 } // namespace storage_engine
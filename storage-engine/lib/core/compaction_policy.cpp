@@ -0,0 +1,254 @@
+// compaction_policy.cpp
+//
+// Implementation of the leveled and size-tiered CompactionPolicy for the storage engine.
+
+#include "core/compaction_policy.h"
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+namespace storage_engine {
+
+namespace {
+
+// key range covered by files
+void keyRange(const Version::FileList& files, std::string& smallest, std::string& largest) {
+    smallest = files.front()->smallest;
+    largest = files.front()->largest;
+    for (const auto& file : files) {
+        smallest = std::min(smallest, file->smallest);
+        largest = std::max(largest, file->largest);
+    }
+}
+
+uint64_t totalBytes(const Version::FileList& files) {
+    uint64_t bytes = 0;
+    for (const auto& file : files) {
+        bytes += file->file_size;
+    }
+    return bytes;
+}
+
+// nothing lives below level
+bool nothingBelow(const Version& version, int level) {
+    for (int l = level + 1; l < version.numLevels(); ++l) {
+        if (!version.files(l).empty()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// A sorted run of the size-tiered policy: one level 0 file or a whole level
+struct SortedRun {
+    int level;
+    Version::FileList files;
+    uint64_t bytes;
+};
+
+// newest first
+std::vector<SortedRun> sortedRuns(const Version& version) {
+    std::vector<SortedRun> runs;
+    for (const auto& file : version.files(0)) {
+        runs.push_back({0, {file}, file->file_size});
+    }
+    for (int level = 1; level < version.numLevels(); ++level) {
+        if (!version.files(level).empty()) {
+            runs.push_back({level, version.files(level), version.levelBytes(level)});
+        }
+    }
+    return runs;
+}
+
+} // namespace
+
+bool CompactionJob::isTrivialMove() const {
+    return inputs.size() == 1 && inputs.front().files.size() == 1 && inputs.front().level != output_level;
+}
+
+std::unique_ptr<CompactionPolicy> CompactionPolicy::create(const CompactionOptions& options) {
+    switch (options.style) {
+    case CompactionStyle::kSizeTiered:
+        return std::make_unique<SizeTieredCompactionPolicy>(options);
+    case CompactionStyle::kLeveled:
+    default:
+        return std::make_unique<LeveledCompactionPolicy>(options);
+    }
+}
+
+CompactionStyle CompactionPolicy::styleFromString(const std::string& name) {
+    if (name == "leveled") {
+        return CompactionStyle::kLeveled;
+    }
+    if (name == "size_tiered") {
+        return CompactionStyle::kSizeTiered;
+    }
+    throw std::invalid_argument("Unknown compaction style: " + name);
+}
+
+LeveledCompactionPolicy::LeveledCompactionPolicy(const CompactionOptions& options) : options_(options) {}
+
+std::vector<double> LeveledCompactionPolicy::scores(const Version& version) const {
+    std::vector<double> scores(version.numLevels(), 0);
+
+    // level 0 files overlap, each one costs every lookup a probe
+    scores[0] = static_cast<double>(version.files(0).size()) /
+                static_cast<double>(std::max<size_t>(1, options_.level0_file_trigger));
+
+    // the bottom level has nowhere to go
+    double max_files = static_cast<double>(options_.level1_max_files);
+    double max_bytes = static_cast<double>(options_.level1_max_bytes);
+    double multiplier = std::max(1.0, options_.level_size_multiplier);
+    for (int level = 1; level + 1 < version.numLevels(); ++level) {
+        if (max_files > 0) {
+            scores[level] = std::max(scores[level], static_cast<double>(version.files(level).size()) / max_files);
+        }
+        if (max_bytes > 0) {
+            scores[level] = std::max(scores[level], static_cast<double>(version.levelBytes(level)) / max_bytes);
+        }
+        max_files *= multiplier;
+        max_bytes *= multiplier;
+    }
+    return scores;
+}
+
+std::optional<CompactionJob> LeveledCompactionPolicy::pick(const Version& version) {
+    std::vector<double> level_scores = scores(version);
+    int level = -1;
+    for (int l = 0; l + 1 < version.numLevels(); ++l) {
+        if (level_scores[l] >= 1 && (level < 0 || level_scores[l] > level_scores[level])) {
+            level = l;
+        }
+    }
+    if (level < 0) {
+        return std::nullopt;
+    }
+    compact_pointers_.resize(version.numLevels());
+
+    // all of level 0 as its files overlap. deeper, the file that drags the
+    // fewest bytes of the next level along per byte it moves down
+    Version::FileList inputs;
+    if (level == 0) {
+        inputs = version.files(0);
+    } else {
+        const auto& files = version.files(level);
+        size_t start = std::find_if(files.begin(), files.end(),
+                                    [&](const auto& file) { return file->smallest > compact_pointers_[level]; }) -
+                       files.begin();
+        double best_ratio = std::numeric_limits<double>::infinity();
+        for (size_t i = 0; i < files.size(); ++i) {
+            const auto& file = files[(start + i) % files.size()];
+            uint64_t overlap = totalBytes(version.overlappingFiles(level + 1, file->smallest, file->largest));
+            double ratio = static_cast<double>(overlap) / static_cast<double>(std::max<uint64_t>(1, file->file_size));
+            if (ratio < best_ratio) {
+                best_ratio = ratio;
+                inputs = {file};
+            }
+        }
+    }
+
+    std::string smallest;
+    std::string largest;
+    keyRange(inputs, smallest, largest);
+    Version::FileList next = version.overlappingFiles(level + 1, smallest, largest);
+
+    // files of the level that fall inside the range of the next level's
+    // files come along for free, as long as they don't pull in more of it
+    if (level > 0 && !next.empty()) {
+        std::string next_smallest;
+        std::string next_largest;
+        keyRange(next, next_smallest, next_largest);
+        Version::FileList expanded =
+            version.overlappingFiles(level, std::min(smallest, next_smallest), std::max(largest, next_largest));
+        if (expanded.size() > inputs.size()) {
+            std::string expanded_smallest;
+            std::string expanded_largest;
+            keyRange(expanded, expanded_smallest, expanded_largest);
+            if (version.overlappingFiles(level + 1, expanded_smallest, expanded_largest).size() == next.size()) {
+                inputs = std::move(expanded);
+                largest = expanded_largest;
+            }
+        }
+    }
+    compact_pointers_[level] = largest;
+
+    CompactionJob job;
+    job.inputs.push_back({level, std::move(inputs)});
+    if (!next.empty()) {
+        job.inputs.push_back({level + 1, std::move(next)});
+    }
+    job.output_level = level + 1;
+    job.score = level_scores[level];
+    job.bottommost = nothingBelow(version, level + 1);
+    return job;
+}
+
+SizeTieredCompactionPolicy::SizeTieredCompactionPolicy(const CompactionOptions& options) : options_(options) {}
+
+std::vector<double> SizeTieredCompactionPolicy::scores(const Version& version) const {
+    // every run costs a lookup a probe, wherever it lives
+    std::vector<double> scores(version.numLevels(), 0);
+    scores[0] = static_cast<double>(sortedRuns(version).size()) /
+                static_cast<double>(std::max<size_t>(1, options_.level0_file_trigger));
+    return scores;
+}
+
+std::optional<CompactionJob> SizeTieredCompactionPolicy::pick(const Version& version) {
+    std::vector<SortedRun> runs = sortedRuns(version);
+    size_t trigger = std::max<size_t>(2, options_.level0_file_trigger);
+    if (runs.size() < trigger) {
+        return std::nullopt;
+    }
+
+    // the runs [first, last) are merged, they are adjacent in age so the
+    // output slots in between the runs left alone
+    size_t first = 0;
+    size_t last = 0;
+
+    // the newer runs hold so much that the oldest is mostly overwritten
+    // data, merge everything
+    uint64_t newer = 0;
+    for (size_t i = 0; i + 1 < runs.size(); ++i) {
+        newer += runs[i].bytes;
+    }
+    if (newer * 100 >= runs.back().bytes * options_.max_size_amplification_percent) {
+        last = runs.size();
+    }
+
+    // runs of about the same size, a run joins while it is at most
+    // size_ratio_percent bigger than the ones picked before it
+    for (size_t start = 0; last == 0 && start + 1 < runs.size(); ++start) {
+        uint64_t candidate = runs[start].bytes;
+        size_t end = start + 1;
+        while (end < runs.size() && runs[end].bytes * 100 <= candidate * (100 + options_.size_ratio_percent)) {
+            candidate += runs[end].bytes;
+            ++end;
+        }
+        if (end - start >= 2) {
+            first = start;
+            last = end;
+        }
+    }
+
+    // no similar runs, merge the newest ones to get back under the trigger
+    if (last == 0) {
+        last = std::min(runs.size(), runs.size() - trigger + 2);
+    }
+
+    CompactionJob job;
+    for (size_t i = first; i < last; ++i) {
+        if (job.inputs.empty() || job.inputs.back().level != runs[i].level) {
+            job.inputs.push_back({runs[i].level, {}});
+        }
+        auto& files = job.inputs.back().files;
+        files.insert(files.end(), runs[i].files.begin(), runs[i].files.end());
+    }
+    // a merge of everything settles at the bottom, any other one takes the
+    // place of its oldest run
+    job.bottommost = last == runs.size();
+    job.output_level = job.bottommost ? version.numLevels() - 1 : runs[last - 1].level;
+    job.score = scores(version)[0];
+    return job;
+}
+
+} // namespace storage_engine
@@ -0,0 +1,136 @@
+#pragma once
+
+#ifndef CORE_COMPACTION_POLICY_H
+#define CORE_COMPACTION_POLICY_H
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+#include "core/version_set.h"
+
+namespace storage_engine {
+
+// How the live SSTables are reshaped
+enum class CompactionStyle {
+    // one sorted run per level, each level multiplier times the one above.
+    // a key lives in at most one file per level: reads probe few files,
+    // every byte is rewritten about multiplier times per level
+    kLeveled,
+    // runs of similar size are merged into one bigger run. fewer rewrites
+    // of each byte, but more runs for a lookup to probe
+    kSizeTiered,
+};
+
+// When SSTables are compacted
+struct CompactionOptions {
+    CompactionStyle style = CompactionStyle::kLeveled;
+
+    // level 0 is merged into level 1 once it holds this many files
+    // (compaction_threshold in config.json). size-tiered: number of
+    // sorted runs that starts a compaction
+    size_t level0_file_trigger = 10;
+
+    // leveled: files and bytes at which level 1 pushes its overflow down
+    // a level (max_sstables in config.json), 0 for no limit. each deeper
+    // level may hold level_size_multiplier times more
+    size_t level1_max_files = 10;
+    uint64_t level1_max_bytes = 256ull << 20;
+    double level_size_multiplier = 10;
+
+    // size-tiered: the next older run joins a merge while it is at most
+    // this many percent bigger than the runs picked so far
+    unsigned size_ratio_percent = 1;
+
+    // size-tiered: once the newer runs add up to this many percent of the
+    // oldest (bottom) run, everything is merged into one run
+    unsigned max_size_amplification_percent = 200;
+
+    // compaction output into level 1 or deeper is cut into tables of
+    // about this many bytes, so a later compaction of a key range rewrites
+    // only the tables that hold it
+    uint64_t target_file_size = 64ull << 20;
+
+    // a compaction into level 1 or deeper is split into up to this many
+    // key ranges of similar size, merged in parallel into their own files
+    size_t max_subcompactions = 1;
+};
+
+// Files of one level read by a compaction
+struct CompactionInput {
+    int level = 0;
+    Version::FileList files;  // in the order of the level
+};
+
+// One compaction: its inputs are merged into files at output_level
+struct CompactionJob {
+    // newest data first, the order a lookup reads them
+    std::vector<CompactionInput> inputs;
+    int output_level = 0;
+    // score of the level that asked for the compaction
+    double score = 0;
+    // no file older than the inputs survives: the output is the bottom
+    // of the tree
+    bool bottommost = false;
+
+    // a single file with nothing to merge with, it can change level
+    // without being rewritten
+    bool isTrivialMove() const;
+};
+
+// Decides which files to compact next. Implementations may keep state
+// between picks; pick() is only called by one thread at a time.
+class CompactionPolicy {
+public:
+    virtual ~CompactionPolicy() = default;
+
+    // How far each level is over its limit, >= 1 means it needs a compaction
+    virtual std::vector<double> scores(const Version& version) const = 0;
+
+    // Compaction of the highest scoring level, std::nullopt if none scores 1
+    virtual std::optional<CompactionJob> pick(const Version& version) = 0;
+
+    static std::unique_ptr<CompactionPolicy> create(const CompactionOptions& options);
+
+    // "leveled" or "size_tiered"
+    // throws std::invalid_argument on any other name
+    static CompactionStyle styleFromString(const std::string& name);
+};
+
+// Level 0 is scored by its file count, deeper levels by the bytes and files
+// they hold against a target that grows level_size_multiplier times per
+// level. A level 1+ compaction takes the one file overlapping the fewest
+// bytes of the next level, relative to its own size.
+class LeveledCompactionPolicy : public CompactionPolicy {
+public:
+    explicit LeveledCompactionPolicy(const CompactionOptions& options);
+
+    std::vector<double> scores(const Version& version) const override;
+    std::optional<CompactionJob> pick(const Version& version) override;
+
+private:
+    CompactionOptions options_;
+    // per level, the largest key of its last compaction. equally good
+    // files are taken round robin from there
+    std::vector<std::string> compact_pointers_;
+};
+
+// Every level 0 file is a sorted run, and so is every deeper level that
+// holds files. Runs are merged newest first while the next one is of
+// similar size, and everything is merged once the newer runs hold too many
+// bytes compared to the oldest one.
+class SizeTieredCompactionPolicy : public CompactionPolicy {
+public:
+    explicit SizeTieredCompactionPolicy(const CompactionOptions& options);
+
+    std::vector<double> scores(const Version& version) const override;
+    std::optional<CompactionJob> pick(const Version& version) override;
+
+private:
+    CompactionOptions options_;
+};
+
+} // namespace storage_engine
+
+#endif // CORE_COMPACTION_POLICY_H
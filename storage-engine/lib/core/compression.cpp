@@ -0,0 +1,232 @@
+// compression.cpp
+//
+// Implementation of SSTable block compression for the storage engine.
+
+#include "core/compression.h"
+#include "core/utils.h"
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+#include <zlib.h>
+
+namespace storage_engine {
+
+namespace {
+
+constexpr size_t kMinMatch = 4;
+constexpr size_t kMaxOffset = 0xffff;
+constexpr size_t kMaxMatch = 1 << 16;
+// a match sequence costs at least a token and an offset
+constexpr uint64_t kMaxLZRatio = kMaxMatch / 3 + 1;
+// deflate can't expand a stream more than this
+constexpr uint64_t kMaxZlibRatio = 1032;
+constexpr int kHashBits = 13;
+
+uint32_t load32(const char* ptr) {
+    return Util::decodeFixed32(ptr);
+}
+
+uint32_t hashSequence(uint32_t sequence) {
+    return (sequence * 2654435761u) >> (32 - kHashBits);
+}
+
+void emitSequence(std::string& output, std::string_view literals, size_t offset, size_t match_length) {
+    size_t literal_nibble = std::min<size_t>(literals.size(), 15);
+    size_t match_nibble = match_length == 0 ? 0 : std::min<size_t>(match_length - kMinMatch, 15);
+    output.push_back(static_cast<char>((literal_nibble << 4) | match_nibble));
+
+    if (literal_nibble == 15) {
+        Util::putVarint64(output, literals.size() - 15);
+    }
+    output.append(literals.data(), literals.size());
+
+    if (match_length != 0) {
+        output.push_back(static_cast<char>(offset & 0xff));
+        output.push_back(static_cast<char>(offset >> 8));
+        if (match_nibble == 15) {
+            Util::putVarint64(output, match_length - kMinMatch - 15);
+        }
+    }
+}
+
+} // namespace
+
+bool Compression::compress(CompressionType type, std::string_view input, std::string& output) {
+    output.clear();
+    switch (type) {
+        case CompressionType::kLZ:
+            compressLZ(input, output);
+            return true;
+        case CompressionType::kZlib:
+            return compressZlib(input, output);
+        default:
+            return false;
+    }
+}
+
+std::string Compression::decompress(CompressionType type, std::string_view input) {
+    switch (type) {
+        case CompressionType::kNone:
+            return std::string(input);
+        case CompressionType::kLZ:
+            return decompressLZ(input);
+        case CompressionType::kZlib:
+            return decompressZlib(input);
+    }
+    throw std::runtime_error("Unknown compression type: " + std::to_string(static_cast<int>(type)));
+}
+
+CompressionType Compression::fromString(const std::string& name) {
+    if (name == "none") {
+        return CompressionType::kNone;
+    }
+    if (name == "lz") {
+        return CompressionType::kLZ;
+    }
+    if (name == "zlib") {
+        return CompressionType::kZlib;
+    }
+    throw std::invalid_argument("Unknown compression: " + name);
+}
+
+void Compression::compressLZ(std::string_view input, std::string& output) {
+    Util::putVarint64(output, input.size());
+
+    // last position each 4 byte sequence was seen at
+    std::vector<uint32_t> table(1u << kHashBits, UINT32_MAX);
+
+    const char* base = input.data();
+    size_t pos = 0;
+    size_t anchor = 0;
+    while (pos + kMinMatch <= input.size()) {
+        uint32_t sequence = load32(base + pos);
+        uint32_t& slot = table[hashSequence(sequence)];
+        size_t candidate = slot;
+        slot = static_cast<uint32_t>(pos);
+
+        if (candidate == UINT32_MAX || pos - candidate > kMaxOffset || load32(base + candidate) != sequence) {
+            ++pos;
+            continue;
+        }
+
+        size_t length = kMinMatch;
+        while (pos + length < input.size() && length < kMaxMatch && base[candidate + length] == base[pos + length]) {
+            ++length;
+        }
+
+        emitSequence(output, input.substr(anchor, pos - anchor), pos - candidate, length);
+        pos += length;
+        anchor = pos;
+    }
+
+    if (anchor < input.size()) {
+        emitSequence(output, input.substr(anchor), 0, 0);
+    }
+}
+
+std::string Compression::decompressLZ(std::string_view input) {
+    uint64_t raw_length = 0;
+    if (!Util::getVarint64(input, raw_length)) {
+        throw std::runtime_error("Corrupted LZ block: bad length");
+    }
+    // the length comes from disk, don't allocate more than the block can expand to
+    if (raw_length / kMaxLZRatio > input.size()) {
+        throw std::runtime_error("Corrupted LZ block: bad length");
+    }
+
+    std::string output;
+    output.reserve(raw_length);
+    while (output.size() < raw_length) {
+        if (input.empty()) {
+            throw std::runtime_error("Corrupted LZ block: truncated");
+        }
+        unsigned char token = static_cast<unsigned char>(input.front());
+        input.remove_prefix(1);
+
+        uint64_t literals = token >> 4;
+        uint64_t extra = 0;
+        if (literals == 15) {
+            if (!Util::getVarint64(input, extra)) {
+                throw std::runtime_error("Corrupted LZ block: bad literal length");
+            }
+            literals += extra;
+        }
+        if (input.size() < literals || raw_length - output.size() < literals) {
+            throw std::runtime_error("Corrupted LZ block: literals overrun");
+        }
+        output.append(input.data(), literals);
+        input.remove_prefix(literals);
+
+        if (output.size() == raw_length) {
+            break;
+        }
+
+        if (input.size() < 2) {
+            throw std::runtime_error("Corrupted LZ block: truncated match");
+        }
+        size_t offset = static_cast<unsigned char>(input[0]) | (static_cast<unsigned char>(input[1]) << 8);
+        input.remove_prefix(2);
+
+        uint64_t length = (token & 0x0f);
+        if (length == 15) {
+            if (!Util::getVarint64(input, extra)) {
+                throw std::runtime_error("Corrupted LZ block: bad match length");
+            }
+            length += extra;
+        }
+        length += kMinMatch;
+
+        if (length > kMaxMatch || offset == 0 || offset > output.size() || raw_length - output.size() < length) {
+            throw std::runtime_error("Corrupted LZ block: bad match");
+        }
+
+        // the match may overlap what it produces, copy byte by byte
+        size_t start = output.size() - offset;
+        for (size_t i = 0; i < length; ++i) {
+            output.push_back(output[start + i]);
+        }
+    }
+
+    if (!input.empty()) {
+        throw std::runtime_error("Corrupted LZ block: trailing bytes");
+    }
+    return output;
+}
+
+bool Compression::compressZlib(std::string_view input, std::string& output) {
+    Util::putVarint64(output, input.size());
+    size_t header = output.size();
+
+    uLongf bound = compressBound(static_cast<uLong>(input.size()));
+    output.resize(header + bound);
+    int status = compress2(reinterpret_cast<Bytef*>(&output[header]), &bound,
+                           reinterpret_cast<const Bytef*>(input.data()), static_cast<uLong>(input.size()),
+                           Z_BEST_COMPRESSION);
+    if (status != Z_OK) {
+        output.clear();
+        return false;
+    }
+    output.resize(header + bound);
+    return true;
+}
+
+std::string Compression::decompressZlib(std::string_view input) {
+    uint64_t raw_length = 0;
+    if (!Util::getVarint64(input, raw_length)) {
+        throw std::runtime_error("Corrupted zlib block: bad length");
+    }
+    if (raw_length / kMaxZlibRatio > input.size()) {
+        throw std::runtime_error("Corrupted zlib block: bad length");
+    }
+
+    std::string output(raw_length, '\0');
+    uLongf length = static_cast<uLongf>(raw_length);
+    int status = uncompress(reinterpret_cast<Bytef*>(&output[0]), &length,
+                            reinterpret_cast<const Bytef*>(input.data()), static_cast<uLong>(input.size()));
+    if (status != Z_OK || length != raw_length) {
+        throw std::runtime_error("Corrupted zlib block");
+    }
+    return output;
+}
+
+} // namespace storage_engine
@@ -0,0 +1,57 @@
+#pragma once
+
+#ifndef CORE_COMPRESSION_H
+#define CORE_COMPRESSION_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+namespace storage_engine {
+
+// Codec of an SSTable block, stored in the block's trailer byte
+enum class CompressionType : unsigned char {
+    kNone = 0,
+    kLZ = 1,    // built-in LZ77, fast enough for every flush
+    kZlib = 2,  // deflate, slower but smaller, meant for the bottom level
+};
+
+// Counters of the blocks written and read by SSTables
+struct CompressionStats {
+    std::atomic<uint64_t> bytes_in{0};            // block bytes before compression
+    std::atomic<uint64_t> bytes_out{0};           // block bytes as written
+    std::atomic<uint64_t> blocks_compressed{0};
+    std::atomic<uint64_t> blocks_stored_raw{0};   // didn't shrink enough, kept as is
+    std::atomic<uint64_t> bytes_decompressed{0};
+};
+
+class Compression {
+public:
+    // Compress input into output (replacing its contents). false if the
+    // codec is kNone or unknown
+    static bool compress(CompressionType type, std::string_view input, std::string& output);
+
+    // throws std::runtime_error on corrupted input or an unknown codec
+    static std::string decompress(CompressionType type, std::string_view input);
+
+    // "none", "lz" or "zlib", throws std::invalid_argument otherwise
+    static CompressionType fromString(const std::string& name);
+
+private:
+    // [varint raw length] then sequences of
+    //   [token: literal count << 4 | (match length - 4)]
+    //   [varint literal count - 15, if the nibble is 15][literals]
+    //   [fixed16 match offset][varint match length - 19, if the nibble is 15]
+    // the last sequence has literals only, matches are at most 64 KiB long
+    static void compressLZ(std::string_view input, std::string& output);
+    static std::string decompressLZ(std::string_view input);
+
+    // [varint raw length][zlib stream]
+    static bool compressZlib(std::string_view input, std::string& output);
+    static std::string decompressZlib(std::string_view input);
+};
+
+} // namespace storage_engine
+
+#endif // CORE_COMPRESSION_H
@@ -0,0 +1,60 @@
+// config.cpp
+//
+// Loading of EngineConfig from config.json for the storage engine.
+
+#include "core/config.h"
+#include <stdexcept>
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+namespace storage_engine {
+
+EngineConfig EngineConfig::fromFile(const std::string& path) {
+    boost::property_tree::ptree root;
+    try {
+        boost::property_tree::read_json(path, root);
+    } catch (const boost::property_tree::json_parser_error& e) {
+        throw std::runtime_error("Failed to parse config file: " + path + " (" + e.what() + ")");
+    }
+
+    EngineConfig config;
+    const auto& section = root.get_child("storage_engine", root);
+
+    config.data_directory = section.get("data_directory", config.data_directory);
+    config.index_directory = section.get("index_directory", config.index_directory);
+    config.metadata_directory = section.get("metadata_directory", config.metadata_directory);
+    config.memtable_size = section.get("memtable_size", config.memtable_size);
+    config.compaction_style = CompactionPolicy::styleFromString(section.get<std::string>("compaction_style", "leveled"));
+    config.max_sstables = section.get("max_sstables", config.max_sstables);
+    config.level1_max_bytes = section.get("level1_max_bytes", config.level1_max_bytes);
+    config.level_size_multiplier = section.get("level_size_multiplier", config.level_size_multiplier);
+    config.compaction_threshold = section.get("compaction_threshold", config.compaction_threshold);
+    config.compaction_size_ratio = section.get("compaction_size_ratio", config.compaction_size_ratio);
+    config.max_size_amplification_percent =
+        section.get("max_size_amplification_percent", config.max_size_amplification_percent);
+    config.target_file_size = section.get("target_file_size", config.target_file_size);
+    config.max_subcompactions = section.get("max_subcompactions", config.max_subcompactions);
+    config.cache_size = section.get("cache_size", config.cache_size);
+    config.flush_interval = section.get("flush_interval", config.flush_interval);
+    config.wal_sync_mode = MergeLog::syncModeFromString(section.get<std::string>("wal_sync_mode", "sync"));
+    config.wal_segment_size = section.get("wal_segment_size", config.wal_segment_size);
+    config.wal_recycle_segments = section.get("wal_recycle_segments", config.wal_recycle_segments);
+    config.max_wal_size = section.get("max_wal_size", config.max_wal_size);
+    config.max_immutable_memtables = section.get("max_immutable_memtables", config.max_immutable_memtables);
+    config.memtable_shards = section.get("memtable_shards", config.memtable_shards);
+    config.memory_budget = section.get("memory_budget", config.memory_budget);
+    config.bloom_bits_per_key = section.get("bloom_bits_per_key", config.bloom_bits_per_key);
+    config.sstable_use_mmap = section.get("sstable_use_mmap", config.sstable_use_mmap);
+    config.compression = Compression::fromString(section.get<std::string>("compression", "lz"));
+    config.bottommost_compression =
+        Compression::fromString(section.get<std::string>("bottommost_compression", "zlib"));
+    config.block_cache_size = section.get("block_cache_size", config.block_cache_size);
+    config.block_cache_policy = BlockCache::policyFromString(section.get<std::string>("block_cache_policy", "lru"));
+    config.block_cache_shards = section.get("block_cache_shards", config.block_cache_shards);
+    config.io_backend = IOBackend::typeFromString(section.get<std::string>("io_backend", "auto"));
+    config.io_queue_depth = section.get("io_queue_depth", config.io_queue_depth);
+
+    return config;
+}
+
+} // namespace storage_engine
@@ -0,0 +1,119 @@
+#pragma once
+
+#ifndef CORE_CONFIG_H
+#define CORE_CONFIG_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "core/block_cache.h"
+#include "core/compaction_policy.h"
+#include "core/compression.h"
+#include "core/io_backend.h"
+#include "core/merge_log.h"
+
+namespace storage_engine {
+
+// Tunables of the storage engine, mirrors the "storage_engine" section of
+// config.json. Defaults match the shipped config.json.
+struct EngineConfig {
+    std::string data_directory = "./data";
+    std::string index_directory = "./index";
+    std::string metadata_directory = "./metadata";
+
+    // bytes an active memtable may hold before it is rotated out
+    size_t memtable_size = 100000000;
+
+    // "leveled" keeps reads cheap, "size_tiered" keeps writes cheap
+    CompactionStyle compaction_style = CompactionStyle::kLeveled;
+
+    // SSTables and bytes at which leveled compaction pushes the overflow
+    // of level 1 down, each deeper level holds level_size_multiplier times
+    // more
+    size_t max_sstables = 10;
+    uint64_t level1_max_bytes = 268435456;
+    double level_size_multiplier = 10;
+    // level 0 (flushed, overlapping) SSTables that trigger a compaction
+    // into level 1, or sorted runs that trigger a size-tiered one
+    size_t compaction_threshold = 10;
+    // size-tiered: how much bigger than the runs before it a run may be to
+    // be merged with them, and the bytes of newer runs, relative to the
+    // oldest one, that merge everything (both in percent)
+    unsigned compaction_size_ratio = 1;
+    unsigned max_size_amplification_percent = 200;
+    // bytes at which compaction output below level 0 is cut into a new table
+    uint64_t target_file_size = 67108864;
+    // key ranges a compaction below level 0 is split into and merged in
+    // parallel on the engine's thread pool
+    size_t max_subcompactions = 4;
+
+    // bytes of the node object cache
+    size_t cache_size = 100000000;
+
+    // milliseconds between syncs of the write-ahead log by its own thread,
+    // what periodic and async writes may lose on a power failure
+    size_t flush_interval = 10000;
+
+    // how long writes wait on the write-ahead log by default: "sync"
+    // (fdatasync), "periodic" (written, synced every flush_interval) or
+    // "async" (buffered). each write may ask for another mode
+    SyncMode wal_sync_mode = SyncMode::kSync;
+
+    // bytes at which a write-ahead log segment is closed and the next one
+    // started, segments are preallocated to it. up to wal_recycle_segments
+    // segments a checkpoint freed are kept and written over
+    uint64_t wal_segment_size = 67108864;
+    size_t wal_recycle_segments = 4;
+
+    // bytes of write-ahead log past the last checkpoint before the memtables
+    // holding its oldest records are flushed early. bounds what a restart
+    // has to replay. 0 means no limit
+    uint64_t max_wal_size = 1073741824;
+
+    // writers stall once this many rotated memtables of one shard are
+    // waiting on a flush
+    size_t max_immutable_memtables = 4;
+
+    // number of write shards, each with its own memtables. 0 means one per
+    // hardware thread. memtable_size is split evenly between them
+    size_t memtable_shards = 0;
+
+    // bytes the engine may hold in memory across memtables, the object
+    // cache and the indexes. once crossed the cache is evicted and
+    // memtables are flushed early. 0 means no limit
+    size_t memory_budget = 1000000000;
+
+    // bloom filter bits per key in every SSTable, 0 disables the filters
+    int bloom_bits_per_key = 10;
+
+    // read SSTables through a read-only mmap instead of pread
+    bool sstable_use_mmap = false;
+
+    // block codec of flushed SSTables and of the bottom level written by
+    // compaction: "none", "lz" or "zlib"
+    CompressionType compression = CompressionType::kLZ;
+    CompressionType bottommost_compression = CompressionType::kZlib;
+
+    // bytes of uncompressed SSTable blocks kept in the block cache, its
+    // eviction policy, "lru" or "clock", and the number of independently
+    // locked shards it is split into
+    size_t block_cache_size = 100000000;
+    BlockCache::Policy block_cache_policy = BlockCache::Policy::kLRU;
+    size_t block_cache_shards = 16;
+
+    // how batched SSTable lookups read their blocks: "io_uring", "pread"
+    // (a thread pool) or "auto", io_uring where the kernel allows it. at
+    // most io_queue_depth reads of a batch are in flight
+    IOBackendType io_backend = IOBackendType::kAuto;
+    unsigned io_queue_depth = 64;
+
+    // Load config.json, keys that are missing keep their defaults
+    // throws std::runtime_error if the file can't be parsed
+    // throws std::invalid_argument on an unknown compression, cache policy,
+    // compaction style, io backend or sync mode
+    static EngineConfig fromFile(const std::string& path);
+};
+
+} // namespace storage_engine
+
+#endif // CORE_CONFIG_H
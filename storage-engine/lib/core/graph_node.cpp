@@ -3,12 +3,12 @@
 // Node Class Definitions for the storage engine.
 
 #include "core/graph_node.h"
+#include "core/memory_tracker.h"
+#include "core/utils.h"
+#include <algorithm>
 
 namespace storage_engine {
 
-GraphNodeMeta::GraphNodeMeta() = default;
-GraphNodeMeta::~GraphNodeMeta() = default;
-
 void GraphNodeMeta::set_data_id(const std::string& data_id) {
     this->data_pointer = data_id;
 }
@@ -25,6 +25,209 @@ std::string GraphNodeMeta::get_data_id() const {
     return data_pointer;
 }
 
+void GraphNodeMeta::set_payload(std::string_view bytes) {
+    this->payload = std::string(bytes);
+}
+
+const std::optional<std::string>& GraphNodeMeta::get_payload() const {
+    return payload;
+}
+
+void GraphNodeMeta::set_type(Type new_type) {
+    this->type = new_type;
+}
+
+GraphNodeMeta::Type GraphNodeMeta::get_type() const {
+    return type;
+}
+
+bool GraphNodeMeta::is_delta() const {
+    return type == Type::kDelta;
+}
+
+bool GraphNodeMeta::is_tombstone() const {
+    return type == Type::kTombstone;
+}
+
+void GraphNodeMeta::merge(const GraphNodeMeta& newer) {
+    if (!newer.is_delta()) {
+        *this = newer;
+        return;
+    }
+
+    // a deleted node takes no more edges
+    if (is_tombstone()) {
+        return;
+    }
+
+    for (const auto& conn : newer.get_connections()) {
+        // drop whatever flag the older record had for this neighbor
+        auto it = connection_list.lower_bound({conn.first, 0});
+        while (it != connection_list.end() && it->first == conn.first) {
+            it = connection_list.erase(it);
+        }
+        connection_list.insert(conn);
+    }
+}
+
+size_t GraphNodeMeta::remove_deleted_connections() {
+    size_t removed = 0;
+    for (auto it = connection_list.begin(); it != connection_list.end();) {
+        if (it->second == '0') {
+            it = connection_list.erase(it);
+            ++removed;
+        } else {
+            ++it;
+        }
+    }
+    return removed;
+}
+
+void GraphNodeMeta::encodeTo(std::string& dst) const {
+    dst.push_back(static_cast<char>(static_cast<unsigned char>(type) | (payload ? kPayloadFlag : 0)));
+    Util::putLengthPrefixed(dst, data_pointer);
+    if (payload) {
+        Util::putLengthPrefixed(dst, *payload);
+    }
+    Util::putVarint32(dst, static_cast<uint32_t>(connection_list.size()));
+
+    std::string flags((connection_list.size() + 7) / 8, '\0');
+    std::string restarts;
+    std::string ids;
+    std::string_view last;
+    uint32_t i = 0;
+    for (const auto& conn : connection_list) {
+        if (conn.second != '0') {
+            flags[i / 8] |= static_cast<char>(1 << (i % 8));
+        }
+
+        size_t shared = 0;
+        if (i % kConnectionRestartInterval == 0) {
+            Util::putFixed32(restarts, static_cast<uint32_t>(ids.size()));
+        } else {
+            size_t limit = std::min(last.size(), conn.first.size());
+            while (shared < limit && last[shared] == conn.first[shared]) {
+                ++shared;
+            }
+        }
+        Util::putVarint32(ids, static_cast<uint32_t>(shared));
+        Util::putVarint32(ids, static_cast<uint32_t>(conn.first.size() - shared));
+        ids.append(conn.first, shared, std::string::npos);
+
+        last = conn.first;
+        ++i;
+    }
+
+    dst += flags;
+    Util::putVarint32(dst, static_cast<uint32_t>(restarts.size() / sizeof(uint32_t)));
+    dst += restarts;
+    dst += ids;
+}
+
+bool GraphNodeMeta::decodeFrom(std::string_view input, std::string_view neighbor_prefix) {
+    if (input.empty()) {
+        return false;
+    }
+    unsigned char type_byte = static_cast<unsigned char>(input.front());
+    bool has_payload = (type_byte & kPayloadFlag) != 0;
+    type_byte &= ~kPayloadFlag;
+    if (type_byte > static_cast<unsigned char>(Type::kTombstone)) {
+        return false;
+    }
+    Type decoded_type = static_cast<Type>(type_byte);
+    input.remove_prefix(1);
+
+    std::string_view data_id;
+    std::string_view payload_bytes;
+    uint32_t count = 0;
+    if (!Util::getLengthPrefixed(input, data_id) || (has_payload && !Util::getLengthPrefixed(input, payload_bytes)) ||
+        !Util::getVarint32(input, count)) {
+        return false;
+    }
+
+    size_t flag_bytes = (static_cast<size_t>(count) + 7) / 8;
+    if (input.size() < flag_bytes) {
+        return false;
+    }
+    std::string_view flags = input.substr(0, flag_bytes);
+    input.remove_prefix(flag_bytes);
+
+    uint32_t num_restarts = 0;
+    if (!Util::getVarint32(input, num_restarts) ||
+        num_restarts != (static_cast<size_t>(count) + kConnectionRestartInterval - 1) / kConnectionRestartInterval ||
+        input.size() / sizeof(uint32_t) < num_restarts) {
+        return false;
+    }
+    const char* restarts = input.data();
+    std::string_view ids = input.substr(num_restarts * sizeof(uint32_t));
+
+    // first id of restart i, which is stored in full
+    auto restart_id = [&](uint32_t i, std::string_view& id) {
+        uint32_t offset = Util::decodeFixed32(restarts + i * sizeof(uint32_t));
+        if (offset > ids.size()) {
+            return false;
+        }
+        std::string_view entry = ids.substr(offset);
+        uint32_t shared = 0;
+        return Util::getVarint32(entry, shared) && shared == 0 && Util::getLengthPrefixed(entry, id);
+    };
+
+    // start at the last restart whose id sorts before the prefix, the ids
+    // ahead of it sort before the prefix too
+    uint32_t first = 0;
+    if (!neighbor_prefix.empty()) {
+        uint32_t lo = 0;
+        uint32_t hi = num_restarts;
+        while (lo < hi) {
+            uint32_t mid = lo + (hi - lo) / 2;
+            std::string_view id;
+            if (!restart_id(mid, id)) {
+                return false;
+            }
+            if (id < neighbor_prefix) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        first = lo == 0 ? 0 : lo - 1;
+    }
+
+    std::set<std::pair<std::string, unsigned char>> connections;
+    if (num_restarts > 0) {
+        uint32_t offset = Util::decodeFixed32(restarts + first * sizeof(uint32_t));
+        if (offset > ids.size()) {
+            return false;
+        }
+        std::string_view entries = ids.substr(offset);
+        std::string id;
+        for (uint32_t i = first * kConnectionRestartInterval; i < count; ++i) {
+            uint32_t shared = 0;
+            uint32_t unshared = 0;
+            if (!Util::getVarint32(entries, shared) || !Util::getVarint32(entries, unshared) ||
+                shared > id.size() || entries.size() < unshared) {
+                return false;
+            }
+            id.resize(shared);
+            id.append(entries.data(), unshared);
+            entries.remove_prefix(unshared);
+
+            if (id.compare(0, neighbor_prefix.size(), neighbor_prefix) == 0) {
+                bool added = (static_cast<unsigned char>(flags[i / 8]) >> (i % 8)) & 1;
+                connections.insert(connections.end(), {id, added ? '1' : '0'});
+            } else if (std::string_view(id) > neighbor_prefix) {
+                break; // sorted past every id with the prefix
+            }
+        }
+    }
+
+    type = decoded_type;
+    data_pointer = std::string(data_id);
+    payload = has_payload ? std::optional<std::string>(payload_bytes) : std::nullopt;
+    connection_list = std::move(connections);
+    return true;
+}
+
 template <typename T>
 GraphNodeData<T>::GraphNodeData() : node_id(UUIDGenerator::generateUUID()) {}
 
@@ -39,6 +242,10 @@ GraphNodeData<T>::GraphNodeData(const T& obj) : node_id(UUIDGenerator::generateU
     this->data_address_id = ""; // Placeholder for future use or implementation
 }
 
+template <typename T>
+GraphNodeData<T>::GraphNodeData(const std::string& data_id, std::string_view bytes)
+    : data(bytes.begin(), bytes.end()), node_id(data_id) {}
+
 template <typename T>
 void GraphNodeData<T>::set_data(const std::string& serialized_data_as_string) {
     this->data = std::vector<unsigned char>(serialized_data_as_string.begin(), serialized_data_as_string.end());
@@ -55,6 +262,18 @@ std::string GraphNodeData<T>::get_id() const noexcept {
     return node_id;
 }
 
+template <typename T>
+const std::vector<unsigned char>& GraphNodeData<T>::get_data() const noexcept {
+    return data;
+}
+
+template <typename T>
+size_t GraphNodeData<T>::get_memory_usage() const noexcept {
+    return sizeof(GraphNodeData<T>) + data.capacity() +
+           MemoryTracker::stringBytes(node_id) - sizeof(std::string) +
+           MemoryTracker::stringBytes(data_address_id) - sizeof(std::string);
+}
+
 template <typename T>
 std::vector<unsigned char> GraphNodeData<T>::serialize(const T& obj) {
     std::stringstream ss;
@@ -76,5 +295,6 @@ std::vector<unsigned char> GraphNodeData<T>::serialize(const T& obj) {
 template class GraphNodeData<int>;
 template class GraphNodeData<std::string>;
 template class GraphNodeData<double>;
+template class GraphNodeData<void*>;
 
 } // namespace storage_engine
@@ -3,21 +3,35 @@
 #ifndef CORE_GRAPH_NODE_H
 #define CORE_GRAPH_NODE_H
 
+#include <optional>
 #include <set>
 #include <utility>
 #include <vector>
 #include <string>
 #include <sstream>
 #include <stdexcept>
+#include <string_view>
 #include <type_traits>
 #include "core/uuid_generator.h"
 
 namespace storage_engine {
 
 class GraphNodeMeta {
+public:
+    // what a record means when it is folded with older records of the same node
+    enum class Type : unsigned char {
+        kNode,       // full node: data pointer and its complete connection list
+        kDelta,      // adjacency delta: connections added ('1') or deleted ('0')
+        kTombstone,  // node deleted, shadows everything older
+    };
+
 private:
     std::string data_pointer;
+    // bytes of the node data, kept with a full node so they reach the log
+    // and the SSTables with it
+    std::optional<std::string> payload;
     std::set<std::pair<std::string, unsigned char>> connection_list;
+    Type type = Type::kNode;
 
 public:
     GraphNodeMeta() = default;
@@ -27,6 +41,47 @@ public:
     void add_connection(const std::string& to_node_id, unsigned char flag_byte);
     const std::set<std::pair<std::string, unsigned char>>& get_connections() const;
     std::string get_data_id() const;
+    void set_payload(std::string_view bytes);
+    // std::nullopt if the record carries none
+    const std::optional<std::string>& get_payload() const;
+
+    void set_type(Type new_type);
+    Type get_type() const;
+    bool is_delta() const;
+    bool is_tombstone() const;
+
+    // Fold a newer record of the same node on top of this one. A newer node
+    // or tombstone replaces this record, a newer delta updates the flag of
+    // each connection it names (latest flag wins).
+    void merge(const GraphNodeMeta& newer);
+
+    // Drop the connections flagged deleted ('0'), returns how many. only
+    // safe once no older record is left for them to cancel
+    size_t remove_deleted_connections();
+
+    // Binary form of a record, as stored in SSTables and memtable dumps:
+    //
+    //   [type byte][varint data id length][data id]
+    //   [varint payload length][payload, if the type byte has kPayloadFlag]
+    //   [varint connection count n][(n + 7) / 8 flag bytes]
+    //   [varint restart count][fixed32 restart offset]...
+    //   [neighbor ids: varint shared, varint unshared, unshared bytes]...
+    //
+    // Flags are packed one bit per connection, set for an added edge ('1')
+    // and clear for a deleted one ('0'). Neighbor ids come sorted and share
+    // a prefix with the id before them, except every
+    // kConnectionRestartInterval-th id which is written in full; the
+    // restart table holds their offsets so a prefix lookup binary searches
+    // them and decodes only the ids that can match.
+    static constexpr uint32_t kConnectionRestartInterval = 16;
+    static constexpr unsigned char kPayloadFlag = 0x80;
+
+    void encodeTo(std::string& dst) const;
+
+    // Replace this record with one written by encodeTo(), keeping only the
+    // connections whose id starts with neighbor_prefix. false if the input
+    // is truncated or corrupted, the record is left untouched then
+    bool decodeFrom(std::string_view input, std::string_view neighbor_prefix = {});
 };
 
 template <typename T>
@@ -40,11 +95,17 @@ public:
     GraphNodeData();
     explicit GraphNodeData(const std::vector<unsigned char> data);
     explicit GraphNodeData(const T& obj);
+    // the payload of a stored node, under the data id it was created with
+    GraphNodeData(const std::string& data_id, std::string_view bytes);
     ~GraphNodeData() = default;
 
     void set_data(const std::string& serialized_data_as_string);
     void set_data(const std::vector<unsigned char>& serialized_data_as_bytes) noexcept;
     std::string get_id() const noexcept;
+    const std::vector<unsigned char>& get_data() const noexcept;
+
+    // heap bytes held by this object, payload and ids included
+    size_t get_memory_usage() const noexcept;
 
 private:
     static std::vector<unsigned char> serialize(const T& obj);
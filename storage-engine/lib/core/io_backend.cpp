@@ -0,0 +1,344 @@
+// io_backend.cpp
+//
+// Implementation of the io_uring and pread IOBackend for the storage engine.
+
+#include "core/io_backend.h"
+#include "concurrency/thread_pool.h"
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <future>
+#include <stdexcept>
+#include <thread>
+
+namespace storage_engine {
+
+namespace {
+
+// pread threads of a backend. each blocks on one read, beyond this many
+// they add little throughput and cost a stack each
+constexpr unsigned kMaxPreadThreads = 16;
+
+// the whole request, retrying interrupted and short reads
+void preadFully(ReadRequest& request) {
+    request.buffer->resize(request.size);
+    request.error = 0;
+    size_t done = 0;
+    while (done < request.size) {
+        ssize_t n = ::pread(request.fd, &(*request.buffer)[done], request.size - done, request.offset + done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            request.error = n < 0 ? errno : EIO;
+            return;
+        }
+        done += static_cast<size_t>(n);
+    }
+}
+
+} // namespace
+
+std::unique_ptr<IOBackend> IOBackend::create(IOBackendType type, unsigned queue_depth) {
+    queue_depth = std::max(1u, queue_depth);
+    if (type != IOBackendType::kPread) {
+        try {
+            return std::make_unique<IoUringBackend>(queue_depth);
+        } catch (const std::runtime_error&) {
+            // no io_uring here, pread gets the same reads done
+        }
+    }
+    return std::make_unique<PreadBackend>(queue_depth);
+}
+
+IOBackendType IOBackend::typeFromString(const std::string& name) {
+    if (name == "auto") {
+        return IOBackendType::kAuto;
+    }
+    if (name == "io_uring") {
+        return IOBackendType::kIoUring;
+    }
+    if (name == "pread") {
+        return IOBackendType::kPread;
+    }
+    throw std::invalid_argument("Unknown io backend: " + name);
+}
+
+PreadBackend::PreadBackend(unsigned threads)
+    : pool_(std::make_unique<ThreadPool>(std::clamp(threads, 1u, kMaxPreadThreads))) {}
+
+PreadBackend::~PreadBackend() = default;
+
+void PreadBackend::readBatch(std::vector<ReadRequest>& requests) {
+    // a single read isn't worth the hand-off
+    if (requests.size() == 1) {
+        preadFully(requests.front());
+        return;
+    }
+
+    std::vector<std::future<void>> pending;
+    pending.reserve(requests.size());
+    for (auto& request : requests) {
+        pending.push_back(pool_->submitTask([&request]() { preadFully(request); }));
+    }
+    for (auto& future : pending) {
+        future.get();
+    }
+}
+
+const char* PreadBackend::name() const noexcept {
+    return "pread";
+}
+
+// One io_uring instance: the submission and completion rings shared with
+// the kernel, and the submission entries. used by one batch at a time
+class IoUringBackend::Ring {
+public:
+    explicit Ring(unsigned entries) {
+        io_uring_params params;
+        std::memset(&params, 0, sizeof(params));
+        fd_ = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+        if (fd_ < 0) {
+            throw std::runtime_error(std::string("io_uring_setup failed: ") + std::strerror(errno));
+        }
+        entries_ = params.sq_entries;
+
+        // since 5.4 both rings live in one mapping
+        sq_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single_mmap) {
+            sq_size_ = cq_size_ = std::max(sq_size_, cq_size_);
+        }
+
+        sq_ = map(sq_size_, IORING_OFF_SQ_RING);
+        cq_ = single_mmap ? sq_ : map(cq_size_, IORING_OFF_CQ_RING);
+        sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+        sqes_ = static_cast<io_uring_sqe*>(static_cast<void*>(map(sqes_size_, IORING_OFF_SQES)));
+        if (sq_ == nullptr || cq_ == nullptr || sqes_ == nullptr) {
+            int error = errno;
+            unmap();
+            throw std::runtime_error(std::string("Failed to map io_uring: ") + std::strerror(error));
+        }
+
+        sq_tail_ = reinterpret_cast<unsigned*>(sq_ + params.sq_off.tail);
+        sq_mask_ = *reinterpret_cast<unsigned*>(sq_ + params.sq_off.ring_mask);
+        sq_array_ = reinterpret_cast<unsigned*>(sq_ + params.sq_off.array);
+        cq_head_ = reinterpret_cast<unsigned*>(cq_ + params.cq_off.head);
+        cq_tail_ = reinterpret_cast<unsigned*>(cq_ + params.cq_off.tail);
+        cq_mask_ = *reinterpret_cast<unsigned*>(cq_ + params.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<io_uring_cqe*>(cq_ + params.cq_off.cqes);
+    }
+
+    ~Ring() {
+        unmap();
+    }
+
+    Ring(const Ring&) = delete;
+    Ring& operator=(const Ring&) = delete;
+
+    unsigned entries() const noexcept {
+        return entries_;
+    }
+
+    // Queue a read of iov at offset, the kernel sees it on the next enter()
+    void pushRead(int fd, uint64_t offset, const iovec* iov, uint64_t user_data) {
+        // we are the only producer, the kernel only moves the head
+        unsigned tail = *sq_tail_;
+        unsigned index = tail & sq_mask_;
+        io_uring_sqe* sqe = &sqes_[index];
+        std::memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = IORING_OP_READV;
+        sqe->fd = fd;
+        sqe->off = offset;
+        sqe->addr = reinterpret_cast<uint64_t>(iov);
+        sqe->len = 1;
+        sqe->user_data = user_data;
+        sq_array_[index] = index;
+        __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+    }
+
+    // Submit to_submit queued reads and wait for at least one completion.
+    // the number the kernel took, or -errno
+    int enter(unsigned to_submit) {
+        long ret = ::syscall(__NR_io_uring_enter, fd_, to_submit, 1u, IORING_ENTER_GETEVENTS, nullptr, 0);
+        return ret < 0 ? -errno : static_cast<int>(ret);
+    }
+
+    // Hand every posted completion to f(user_data, res)
+    template <typename F>
+    void reap(F&& f) {
+        unsigned head = *cq_head_;
+        unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head) {
+            const io_uring_cqe& cqe = cqes_[head & cq_mask_];
+            f(cqe.user_data, cqe.res);
+        }
+        __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+    }
+
+private:
+    int fd_ = -1;
+    unsigned entries_ = 0;
+    size_t sq_size_ = 0;
+    size_t cq_size_ = 0;
+    size_t sqes_size_ = 0;
+    char* sq_ = nullptr;
+    char* cq_ = nullptr;
+    io_uring_sqe* sqes_ = nullptr;
+    unsigned* sq_tail_ = nullptr;
+    unsigned sq_mask_ = 0;
+    unsigned* sq_array_ = nullptr;
+    unsigned* cq_head_ = nullptr;
+    unsigned* cq_tail_ = nullptr;
+    unsigned cq_mask_ = 0;
+    io_uring_cqe* cqes_ = nullptr;
+
+    char* map(size_t size, uint64_t offset) {
+        void* mapping = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_,
+                               static_cast<off_t>(offset));
+        return mapping == MAP_FAILED ? nullptr : static_cast<char*>(mapping);
+    }
+
+    void unmap() noexcept {
+        if (sqes_ != nullptr) {
+            ::munmap(sqes_, sqes_size_);
+        }
+        if (cq_ != nullptr && cq_ != sq_) {
+            ::munmap(cq_, cq_size_);
+        }
+        if (sq_ != nullptr) {
+            ::munmap(sq_, sq_size_);
+        }
+        sq_ = cq_ = nullptr;
+        sqes_ = nullptr;
+        if (fd_ >= 0) {
+            ::close(fd_);
+            fd_ = -1;
+        }
+    }
+};
+
+IoUringBackend::IoUringBackend(unsigned queue_depth) : queue_depth_(std::max(1u, queue_depth)) {
+    // the first ring doubles as the check that io_uring is usable
+    idle_.push_back(std::make_unique<Ring>(queue_depth_));
+}
+
+IoUringBackend::~IoUringBackend() = default;
+
+void IoUringBackend::readBatch(std::vector<ReadRequest>& requests) {
+    std::unique_ptr<Ring> ring;
+    try {
+        ring = acquire();
+    } catch (const std::runtime_error&) {
+        // out of rings (memlock limit), this batch goes one read at a time
+        for (auto& request : requests) {
+            preadFully(request);
+        }
+        return;
+    }
+
+    // reads go out in request order, short and interrupted ones are sent
+    // again for what is left. at most entries() are queued or in flight
+    std::vector<iovec> iovecs(requests.size());
+    std::vector<size_t> done(requests.size(), 0);
+    std::vector<size_t> retry;
+    size_t next = 0;
+    unsigned queued = 0;
+    unsigned in_flight = 0;
+    for (auto& request : requests) {
+        request.buffer->resize(request.size);
+        request.error = 0;
+    }
+
+    while (true) {
+        while (queued + in_flight < ring->entries() && (!retry.empty() || next < requests.size())) {
+            size_t i;
+            if (!retry.empty()) {
+                i = retry.back();
+                retry.pop_back();
+            } else {
+                i = next++;
+            }
+            auto& request = requests[i];
+            if (request.size == 0) {
+                continue;
+            }
+            iovecs[i].iov_base = &(*request.buffer)[done[i]];
+            iovecs[i].iov_len = request.size - done[i];
+            ring->pushRead(request.fd, request.offset + done[i], &iovecs[i], i);
+            ++queued;
+        }
+        if (queued + in_flight == 0) {
+            break;
+        }
+
+        int submitted = ring->enter(queued);
+        if (submitted < 0 && submitted != -EINTR && submitted != -EAGAIN && submitted != -EBUSY) {
+            for (size_t i = 0; i < requests.size(); ++i) {
+                if (done[i] < requests[i].size && requests[i].error == 0) {
+                    requests[i].error = -submitted;
+                }
+            }
+            // the ring is unusable, but reads in flight keep writing into
+            // the buffers, closing the ring doesn't stop them. every one is
+            // reaped before the caller may free the buffers. if the kernel
+            // won't let us wait, its completions are polled for
+            while (in_flight > 0) {
+                ring->reap([&](uint64_t, int) { --in_flight; });
+                if (in_flight > 0 && ring->enter(0) < 0) {
+                    std::this_thread::yield();
+                }
+            }
+            return;  // not handed back
+        }
+        if (submitted > 0) {
+            queued -= static_cast<unsigned>(submitted);
+            in_flight += static_cast<unsigned>(submitted);
+        }
+
+        ring->reap([&](uint64_t user_data, int res) {
+            --in_flight;
+            size_t i = static_cast<size_t>(user_data);
+            if (res == -EINTR || res == -EAGAIN) {
+                retry.push_back(i);
+            } else if (res < 0) {
+                requests[i].error = -res;
+            } else if (res == 0) {
+                requests[i].error = EIO;  // the file ends before the block does
+            } else if ((done[i] += static_cast<size_t>(res)) < requests[i].size) {
+                retry.push_back(i);
+            }
+        });
+    }
+
+    release(std::move(ring));
+}
+
+const char* IoUringBackend::name() const noexcept {
+    return "io_uring";
+}
+
+std::unique_ptr<IoUringBackend::Ring> IoUringBackend::acquire() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!idle_.empty()) {
+            std::unique_ptr<Ring> ring = std::move(idle_.back());
+            idle_.pop_back();
+            return ring;
+        }
+    }
+    return std::make_unique<Ring>(queue_depth_);
+}
+
+void IoUringBackend::release(std::unique_ptr<Ring> ring) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    idle_.push_back(std::move(ring));
+}
+
+} // namespace storage_engine
@@ -0,0 +1,94 @@
+#pragma once
+
+#ifndef CORE_IO_BACKEND_H
+#define CORE_IO_BACKEND_H
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace storage_engine {
+
+class ThreadPool;
+
+// One positional read of a batch
+struct ReadRequest {
+    int fd = -1;
+    uint64_t offset = 0;
+    size_t size = 0;
+    std::string* buffer = nullptr;  // resized to size, filled on success
+    int error = 0;                  // errno of a failed read, EIO on a short file
+};
+
+enum class IOBackendType {
+    kAuto,     // io_uring when the kernel lets us have a ring, pread otherwise
+    kIoUring,
+    kPread,
+};
+
+// Reads a batch of blocks with all of them in flight at once, so a lookup
+// of many keys waits for the slowest read instead of the sum of them.
+// Safe to use from many threads.
+class IOBackend {
+public:
+    virtual ~IOBackend() = default;
+
+    // Read every request into its buffer and return once all completed.
+    // failures are reported per request, nothing throws
+    virtual void readBatch(std::vector<ReadRequest>& requests) = 0;
+
+    // "io_uring" or "pread"
+    virtual const char* name() const noexcept = 0;
+
+    // kAuto and kIoUring fall back to pread when io_uring_setup() fails
+    // (old kernel, seccomp). queue_depth caps the reads in flight per ring
+    // and the pread threads (at most 16 of those)
+    static std::unique_ptr<IOBackend> create(IOBackendType type = IOBackendType::kAuto, unsigned queue_depth = 64);
+
+    // "auto", "io_uring" or "pread"
+    // throws std::invalid_argument on any other name
+    static IOBackendType typeFromString(const std::string& name);
+};
+
+// pread from a pool of threads, one read per task
+class PreadBackend : public IOBackend {
+public:
+    // threads is capped at 16, reads beyond wait for a free thread
+    explicit PreadBackend(unsigned threads);
+    ~PreadBackend() override;
+
+    void readBatch(std::vector<ReadRequest>& requests) override;
+    const char* name() const noexcept override;
+
+private:
+    std::unique_ptr<ThreadPool> pool_;
+};
+
+// Reads submitted to io_uring rings through the raw syscalls, no liburing.
+// A batch takes a ring for itself, rings are created as concurrent batches
+// need them and kept for later ones.
+class IoUringBackend : public IOBackend {
+public:
+    // throws std::runtime_error if the kernel refuses to set up a ring
+    explicit IoUringBackend(unsigned queue_depth);
+    ~IoUringBackend() override;
+
+    void readBatch(std::vector<ReadRequest>& requests) override;
+    const char* name() const noexcept override;
+
+private:
+    class Ring;
+
+    unsigned queue_depth_;
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<Ring>> idle_;  // guarded by mutex_
+
+    std::unique_ptr<Ring> acquire();
+    void release(std::unique_ptr<Ring> ring);
+};
+
+} // namespace storage_engine
+
+#endif // CORE_IO_BACKEND_H
@@ -0,0 +1,61 @@
+// memory_tracker.cpp
+//
+// Implementation of MemoryTracker for the storage engine.
+
+#include "core/memory_tracker.h"
+
+namespace storage_engine {
+
+MemoryTracker::MemoryTracker(size_t budget) : budget_(budget) {}
+
+void MemoryTracker::consume(Component component, size_t bytes) noexcept {
+    usage_[static_cast<size_t>(component)].fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void MemoryTracker::release(Component component, size_t bytes) noexcept {
+    usage_[static_cast<size_t>(component)].fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+size_t MemoryTracker::usage(Component component) const noexcept {
+    return usage_[static_cast<size_t>(component)].load(std::memory_order_relaxed);
+}
+
+size_t MemoryTracker::total() const noexcept {
+    size_t total = 0;
+    for (const auto& usage : usage_) {
+        total += usage.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+size_t MemoryTracker::budget() const noexcept {
+    return budget_;
+}
+
+bool MemoryTracker::overBudget() const noexcept {
+    return budget_ != 0 && total() > budget_;
+}
+
+MemoryTracker::Snapshot MemoryTracker::snapshot() const noexcept {
+    Snapshot snapshot;
+    snapshot.memtables = usage(Component::kMemtables);
+    snapshot.object_cache = usage(Component::kObjectCache);
+    snapshot.block_cache = usage(Component::kBlockCache);
+    snapshot.node_id_index = usage(Component::kNodeIdIndex);
+    snapshot.node_data_index = usage(Component::kNodeDataIndex);
+    snapshot.total = snapshot.memtables + snapshot.object_cache + snapshot.block_cache +
+                     snapshot.node_id_index + snapshot.node_data_index;
+    snapshot.budget = budget_;
+    return snapshot;
+}
+
+size_t MemoryTracker::stringBytes(const std::string& str) noexcept {
+    // the buffer sits inside the object itself while the string is short
+    const char* self = reinterpret_cast<const char*>(&str);
+    if (str.data() >= self && str.data() < self + sizeof(std::string)) {
+        return sizeof(std::string);
+    }
+    return sizeof(std::string) + str.capacity() + 1;
+}
+
+} // namespace storage_engine
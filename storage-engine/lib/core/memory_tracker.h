@@ -0,0 +1,72 @@
+#pragma once
+
+#ifndef CORE_MEMORY_TRACKER_H
+#define CORE_MEMORY_TRACKER_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <string>
+
+namespace storage_engine {
+
+// Process-wide byte accounting for the in-memory structures of the engine.
+//
+// Every component charges what it allocates (consume) and gives it back when
+// it is freed (release), so total() is a live estimate of the engine's heap
+// footprint. The tracker doesn't refuse allocations itself; the owner polls
+// overBudget() and relieves the pressure (evict caches, flush memtables).
+class MemoryTracker {
+public:
+    enum class Component : size_t {
+        kMemtables,      // arenas of active and not yet flushed memtables
+        kObjectCache,
+        kBlockCache,
+        kNodeIdIndex,
+        kNodeDataIndex,
+        kCount,
+    };
+
+    // per component usage at one point in time
+    struct Snapshot {
+        size_t memtables = 0;
+        size_t object_cache = 0;
+        size_t block_cache = 0;
+        size_t node_id_index = 0;
+        size_t node_data_index = 0;
+        size_t total = 0;
+        size_t budget = 0;
+    };
+
+    // budget of 0 means unlimited
+    explicit MemoryTracker(size_t budget = 0);
+
+    MemoryTracker(const MemoryTracker&) = delete;
+    MemoryTracker& operator=(const MemoryTracker&) = delete;
+
+    void consume(Component component, size_t bytes) noexcept;
+    void release(Component component, size_t bytes) noexcept;
+
+    size_t usage(Component component) const noexcept;
+    size_t total() const noexcept;
+    size_t budget() const noexcept;
+    bool overBudget() const noexcept;
+
+    Snapshot snapshot() const noexcept;
+
+    // Heap bytes held by a std::string object, including the object itself.
+    // short strings live inline (SSO) and cost no extra allocation
+    static size_t stringBytes(const std::string& str) noexcept;
+
+    // bookkeeping of one node of a std::unordered_map/set (next pointer,
+    // cached hash) plus its bucket slot
+    static constexpr size_t kHashNodeOverhead = 3 * sizeof(void*);
+
+private:
+    const size_t budget_;
+    std::array<std::atomic<size_t>, static_cast<size_t>(Component::kCount)> usage_{};
+};
+
+} // namespace storage_engine
+
+#endif // CORE_MEMORY_TRACKER_H
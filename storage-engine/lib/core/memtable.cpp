@@ -3,12 +3,13 @@
 // Implementation of Memtable (in-memory data structure) for the storage engine.
 
 #include "core/memtable.h"
-#include <sstream>
+#include <cstring>
 #include <stdexcept>
 
 namespace storage_engine {
 
-Memtable::Memtable(size_t max_size) : max_size_(max_size) {}
+Memtable::Memtable(size_t max_size, MemoryTracker* tracker) 
+    : arena_(tracker), table_(std::make_unique<Table>(&arena_)), max_size_(max_size) {}
 
 Memtable::~Memtable() = default;
 
@@ -17,47 +18,119 @@ void Memtable::insert(std::string new_node_id, GraphNodeMeta& meta_node) {
         throw std::runtime_error("Cannot insert into frozen memtable");
     }
 
-    std::unique_lock<std::mutex> lock(mutex_);
-    
-    auto meta_ptr = std::make_shared<GraphNodeMeta>(meta_node);
     size_t entry_size = calculateEntrySize(new_node_id, meta_node);
     
-    if (size_ + entry_size > max_size_) {
-        is_frozen_ = true;
-        flush_needed_.notify_one();
-        throw std::runtime_error("Memtable full, needs flushing");
+    // crossing the limit doesn't fail the write, it only asks the owner
+    // to swap in a fresh memtable
+    if (size_.fetch_add(entry_size) + entry_size > max_size_) {
+        is_full_ = true;
     }
 
-    table_[std::move(new_node_id)] = std::move(meta_ptr);
-    size_ += entry_size;
-}
+    MetaEntry* entry = encodeEntry(meta_node);
 
-std::vector<std::pair<std::string, std::shared_ptr<GraphNodeMeta>>> Memtable::getEntries() const {
-    std::unique_lock<std::mutex> lock(mutex_);
-    
-    std::vector<std::pair<std::string, std::shared_ptr<GraphNodeMeta>>> entries;
-    entries.reserve(table_.size());
+    // only copy the key into the arena the first time we see it
+    auto* node = table_->find(new_node_id);
+    if (node == nullptr) {
+        std::string_view key(arena_.copy(new_node_id.data(), new_node_id.size()), new_node_id.size());
+        auto [inserted_node, inserted] = table_->insert(key);
+        node = inserted_node;
+        if (inserted) {
+            count_.fetch_add(1);
+        }
+    }
+
+    // prepend to the key's chain, a full record starts a new one
+    const MetaEntry* head = node->value.load(std::memory_order_acquire);
+    do {
+        entry->next = head;
+        entry->depth = (entry->type == GraphNodeMeta::Type::kDelta && head != nullptr) ? head->depth + 1 : 1;
+        // taken after head was published, so sequences grow along the chain
+        entry->sequence = sequence_.fetch_add(1) + 1;
+    } while (!node->value.compare_exchange_weak(head, entry, std::memory_order_release, std::memory_order_acquire));
 
-    for (const auto& [key, value] : table_) {
-        entries.emplace_back(key, value);
+    // deltas pile up on hot nodes, fold them so reads stay short
+    if (entry->depth >= kMaxChainDepth) {
+        foldChain(node);
     }
+}
+
+Memtable::Iterator Memtable::newIterator(std::string_view prefix) const {
+    Iterator it(table_.get(), prefix, sequence_.load());
+    it.SeekToFirst();
+    return it;
+}
+
+Memtable::Iterator::Iterator(const Table* table, std::string_view prefix, uint64_t snapshot)
+    : iter_(table), prefix_(prefix), snapshot_(snapshot) {}
+
+bool Memtable::Iterator::Valid() const {
+    return head_ != nullptr;
+}
+
+std::string_view Memtable::Iterator::key() const {
+    return iter_.key();
+}
+
+GraphNodeMeta::Type Memtable::Iterator::type() const {
+    return head_->type;
+}
+
+GraphNodeMeta Memtable::Iterator::value() const {
+    return *foldEntries(head_);
+}
+
+void Memtable::Iterator::Next() {
+    iter_.Next();
+    settle();
+}
+
+void Memtable::Iterator::Seek(std::string_view target) {
+    iter_.Seek(target < prefix_ ? std::string_view(prefix_) : target);
+    settle();
+}
+
+void Memtable::Iterator::SeekToFirst() {
+    Seek(prefix_);
+}
 
-    return entries;
+void Memtable::Iterator::settle() {
+    for (; iter_.Valid(); iter_.Next()) {
+        if (iter_.key().compare(0, prefix_.size(), prefix_) != 0) {
+            break;
+        }
+
+        // skip records written after the snapshot, the rest of the
+        // chain is older still
+        head_ = iter_.node()->value.load(std::memory_order_acquire);
+        while (head_ != nullptr && head_->sequence > snapshot_) {
+            head_ = head_->next;
+        }
+        if (head_ != nullptr) {
+            return;
+        }
+    }
+    head_ = nullptr;
 }
 
 std::ostream& Memtable::serialize(std::ostream& out) {
     std::unique_lock<std::mutex> lock(mutex_);
     
-    size_t count = table_.size();
+    size_t count = count_;
     out.write(reinterpret_cast<const char*>(&count), sizeof(count));
     
-    for (const auto& [key, value] : table_) {
+    Table::Iterator it(table_.get());
+    for (it.SeekToFirst(); it.Valid(); it.Next()) {
+        std::string_view key = it.key();
         size_t key_size = key.size();
         out.write(reinterpret_cast<const char*>(&key_size), sizeof(key_size));
-        out.write(key.c_str(), key_size);
+        out.write(key.data(), key_size);
         
-        // Serialize GraphNodeMeta (this is a placeholder for actual serialization)
-        // TODO: Implement proper serialization for GraphNodeMeta
+        // the folded record of the key, in the SSTable value format
+        std::string value;
+        foldEntries(it.node()->value.load(std::memory_order_acquire))->encodeTo(value);
+        size_t value_size = value.size();
+        out.write(reinterpret_cast<const char*>(&value_size), sizeof(value_size));
+        out.write(value.data(), value_size);
     }
 
     return out;
@@ -66,8 +139,7 @@ std::ostream& Memtable::serialize(std::ostream& out) {
 void Memtable::deserialize(std::istream& in) {
     std::unique_lock<std::mutex> lock(mutex_);
     
-    table_.clear();
-    size_ = 0;
+    resetTable();
     
     size_t count;
     in.read(reinterpret_cast<char*>(&count), sizeof(count));
@@ -79,63 +151,194 @@ void Memtable::deserialize(std::istream& in) {
         std::string key(key_size, '\0');
         in.read(&key[0], key_size);
         
-        // Deserialize GraphNodeMeta (this is a placeholder for actual deserialization)
-        auto meta = std::make_shared<GraphNodeMeta>();
-        // TODO: Implement proper deserialization for GraphNodeMeta
+        size_t value_size;
+        in.read(reinterpret_cast<char*>(&value_size), sizeof(value_size));
+        
+        std::string value(value_size, '\0');
+        in.read(&value[0], value_size);
+        
+        GraphNodeMeta meta;
+        if (!in || !meta.decodeFrom(value)) {
+            throw std::runtime_error("Corrupted memtable dump at key: " + key);
+        }
         
-        table_[std::move(key)] = std::move(meta);
+        std::string_view arena_key(arena_.copy(key.data(), key.size()), key.size());
+        auto [node, inserted] = table_->insert(arena_key);
+        MetaEntry* entry = encodeEntry(meta);
+        entry->next = node->value.load(std::memory_order_relaxed);
+        entry->sequence = sequence_.fetch_add(1) + 1;
+        node->value.store(entry, std::memory_order_release);
+        if (inserted) {
+            count_.fetch_add(1);
+        }
     }
 }
 
-void Memtable::dump() {
-    std::unique_lock<std::mutex> lock(mutex_);
-    
-    if (table_.empty()) {
-        return;
-    }
-    
-    // Create and serialize the memtable to SSTable
-    SSTable ss_table;
-    std::stringstream ss;
-    serialize(ss);
-    
-    // TODO: Write SSTable to disk (Placeholder for actual disk writing logic)
-    
-    // Clear the memtable
-    table_.clear();
-    size_ = 0;
-    is_frozen_ = false;
+void Memtable::freeze() noexcept {
+    is_frozen_ = true;
+}
+
+bool Memtable::is_full() const noexcept {
+    return is_full_;
 }
 
 bool Memtable::is_frozen() const noexcept {
     return is_frozen_;
 }
 
+void Memtable::markLogged(uint64_t position) noexcept {
+    uint64_t first = first_log_position_.load(std::memory_order_relaxed);
+    while (position < first && !first_log_position_.compare_exchange_weak(first, position)) {
+    }
+}
+
+uint64_t Memtable::firstLogPosition() const noexcept {
+    return first_log_position_.load();
+}
+
 size_t Memtable::size() const noexcept {
     return size_;
 }
 
+size_t Memtable::memoryUsage() const noexcept {
+    return arena_.memoryUsage();
+}
+
 bool Memtable::empty() const {
-    std::unique_lock<std::mutex> lock(mutex_);
-    return table_.empty();
+    return count_ == 0;
 }
 
 size_t Memtable::count() const {
-    std::unique_lock<std::mutex> lock(mutex_);
-    return table_.size();
+    return count_;
 }
 
 std::shared_ptr<GraphNodeMeta> Memtable::get(const std::string& node_id) const {
-    std::unique_lock<std::mutex> lock(mutex_);
-    auto it = table_.find(node_id);
-    if (it != table_.end()) {
-        return it->second;
+    auto* node = table_->find(node_id);
+    if (node != nullptr) {
+        return foldEntries(node->value.load(std::memory_order_acquire));
     }
     return nullptr;
 }
 
 size_t Memtable::calculateEntrySize(const std::string& key, const GraphNodeMeta& value) const {
-    return key.size() + sizeof(GraphNodeMeta); // Placeholder for actual size calculation
+    size_t size = key.size() + sizeof(Table::Node) + sizeof(MetaEntry) + value.get_data_id().size();
+    if (value.get_payload()) {
+        size += value.get_payload()->size();
+    }
+    for (const auto& conn : value.get_connections()) {
+        size += sizeof(ConnectionEntry) + conn.first.size();
+    }
+    return size;
+}
+
+Memtable::MetaEntry* Memtable::encodeEntry(const GraphNodeMeta& meta) {
+    const auto& connections = meta.get_connections();
+    std::string data_id = meta.get_data_id();
+    const auto& payload = meta.get_payload();
+
+    size_t bytes = sizeof(MetaEntry) + connections.size() * sizeof(ConnectionEntry) + data_id.size();
+    if (payload) {
+        bytes += payload->size();
+    }
+    for (const auto& conn : connections) {
+        bytes += conn.first.size();
+    }
+
+    // [MetaEntry][ConnectionEntry x n][string bytes...]
+    char* mem = arena_.allocateAligned(bytes);
+    auto* entry = reinterpret_cast<MetaEntry*>(mem);
+    auto* conn_entries = reinterpret_cast<ConnectionEntry*>(mem + sizeof(MetaEntry));
+    char* strings = mem + sizeof(MetaEntry) + connections.size() * sizeof(ConnectionEntry);
+
+    std::memcpy(strings, data_id.data(), data_id.size());
+    entry->data_id = std::string_view(strings, data_id.size());
+    strings += data_id.size();
+    entry->payload = std::nullopt;
+    if (payload) {
+        std::memcpy(strings, payload->data(), payload->size());
+        entry->payload = std::string_view(strings, payload->size());
+        strings += payload->size();
+    }
+
+    size_t i = 0;
+    for (const auto& conn : connections) {
+        std::memcpy(strings, conn.first.data(), conn.first.size());
+        conn_entries[i].node_id = std::string_view(strings, conn.first.size());
+        conn_entries[i].flag = conn.second;
+        strings += conn.first.size();
+        ++i;
+    }
+    entry->num_connections = connections.size();
+    entry->connections = conn_entries;
+    entry->type = meta.get_type();
+    entry->covers_older = false;
+    entry->depth = 1;
+    entry->sequence = 0;
+    entry->next = nullptr;
+
+    return entry;
+}
+
+GraphNodeMeta Memtable::decodeEntry(const MetaEntry* entry) {
+    GraphNodeMeta meta;
+    meta.set_type(entry->type);
+    meta.set_data_id(std::string(entry->data_id));
+    if (entry->payload) {
+        meta.set_payload(*entry->payload);
+    }
+    for (size_t i = 0; i < entry->num_connections; ++i) {
+        meta.add_connection(std::string(entry->connections[i].node_id), entry->connections[i].flag);
+    }
+    return meta;
+}
+
+std::shared_ptr<GraphNodeMeta> Memtable::foldEntries(const MetaEntry* head) {
+    if (head == nullptr) {
+        return nullptr;
+    }
+
+    // newest first, up to the record that makes everything older irrelevant
+    std::vector<const MetaEntry*> chain;
+    for (const MetaEntry* entry = head; entry != nullptr; entry = entry->next) {
+        chain.push_back(entry);
+        if (entry->type != GraphNodeMeta::Type::kDelta || entry->covers_older) {
+            break;
+        }
+    }
+
+    // then replay oldest to newest
+    auto meta = std::make_shared<GraphNodeMeta>(decodeEntry(chain.back()));
+    for (auto it = chain.rbegin() + 1; it != chain.rend(); ++it) {
+        meta->merge(decodeEntry(*it));
+    }
+    return meta;
+}
+
+void Memtable::foldChain(Table::Node* node) {
+    const MetaEntry* head = node->value.load(std::memory_order_acquire);
+    while (head != nullptr && head->depth >= kMaxChainDepth) {
+        auto folded = foldEntries(head);
+        MetaEntry* entry = encodeEntry(*folded);
+        entry->covers_older = true;
+        entry->next = head;
+        // visible exactly when the newest record it folds is
+        entry->sequence = head->sequence;
+        size_.fetch_add(calculateEntrySize("", *folded));
+
+        // a writer slipped in, fold again including its record
+        if (node->value.compare_exchange_strong(head, entry, std::memory_order_release, std::memory_order_acquire)) {
+            return;
+        }
+    }
+}
+
+void Memtable::resetTable() {
+    table_.reset();
+    arena_.reset();
+    table_ = std::make_unique<Table>(&arena_);
+    size_ = 0;
+    count_ = 0;
+    sequence_ = 0;
 }
 
 } // namespace storage_engine
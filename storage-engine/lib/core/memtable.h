@@ -3,30 +3,123 @@
 #ifndef CORE_MEMTABLE_H
 #define CORE_MEMTABLE_H
 
-#include <map>
+#include <cstdint>
 #include <memory>
 #include <mutex>
+#include <optional>
 #include <vector>
 #include <atomic>
-#include <condition_variable>
+#include <string_view>
+#include "core/arena.h"
 #include "core/graph_node.h"
+#include "core/memory_tracker.h"
+#include "core/skiplist.h"
 #include "core/sstable.h"
 
 namespace storage_engine {
 
 class Memtable {
 private:
-    std::map<std::string, std::shared_ptr<GraphNodeMeta>> table_;
+    // one adjacency entry, the id points into the arena
+    struct ConnectionEntry {
+        std::string_view node_id;
+        unsigned char flag;
+    };
+
+    // arena-resident copy of a GraphNodeMeta. the header, the connection
+    // array and every string byte come from a single arena allocation.
+    //
+    // writes are never applied in place: each one is prepended to the key's
+    // chain with a CAS, so an edge insert is O(1) whatever the node's degree.
+    // reads fold the chain from the newest record down to the first full
+    // node/tombstone (or an entry that already covers everything older)
+    struct MetaEntry {
+        std::string_view data_id;
+        std::optional<std::string_view> payload;
+        size_t num_connections;
+        const ConnectionEntry* connections;
+        GraphNodeMeta::Type type;
+        // a fold of every older entry of this key, reads can stop here
+        bool covers_older;
+        // entries a read has to walk to fold this chain
+        uint32_t depth;
+        // order of the write within the memtable, grows along the chain
+        uint64_t sequence;
+        // next older record of the same key
+        const MetaEntry* next;
+    };
+
+    // once a chain gets this deep a writer folds it into one entry
+    static constexpr uint32_t kMaxChainDepth = 32;
+
+    using Table = SkipList<std::string_view, std::atomic<const MetaEntry*>>;
+
+    // keys, entries and skiplist nodes all live in the arena, which is
+    // dropped in one go when the memtable is reloaded or destroyed
+    Arena arena_;
+
+    // inserts and lookups are lock-free on the skiplist, the mutex only
+    // serializes whole-table operations (serialize, deserialize)
+    // which expect writers to have moved on to another memtable
+    std::unique_ptr<Table> table_;
     mutable std::mutex mutex_;
     std::atomic<size_t> size_{0};
+    std::atomic<size_t> count_{0};
+    std::atomic<uint64_t> sequence_{0};
+    // lowest write-ahead log position a record of the table ends at
+    std::atomic<uint64_t> first_log_position_{UINT64_MAX};
     const size_t max_size_;
-    std::condition_variable flush_needed_;
+
+    // full: crossed max_size_, the owner should rotate it out (writes still land)
+    // frozen: rotated out and immutable, waiting to be flushed
+    std::atomic<bool> is_full_{false};
     std::atomic<bool> is_frozen_{false};
 
     size_t calculateEntrySize(const std::string& key, const GraphNodeMeta& value) const;
+    MetaEntry* encodeEntry(const GraphNodeMeta& meta);
+    static GraphNodeMeta decodeEntry(const MetaEntry* entry);
+    static std::shared_ptr<GraphNodeMeta> foldEntries(const MetaEntry* head);
+    void foldChain(Table::Node* node);
+    void resetTable();
 
 public:
-    explicit Memtable(size_t max_size = 1024 * 1024);
+    // Forward iterator over the memtable in key order. It walks the skiplist
+    // in place: keys point into the arena and a key's records are only
+    // folded when value() is called. The iterator sees the table as of its
+    // creation, records written afterwards are skipped (writes still in
+    // flight at that moment may or may not show up). An optional prefix
+    // bounds the range. The memtable must outlive its iterators.
+    class Iterator {
+    public:
+        bool Valid() const;
+        std::string_view key() const;
+        // type of the newest visible record of the key, nothing is decoded
+        GraphNodeMeta::Type type() const;
+        // the key's visible records folded into one, a delta if this
+        // memtable holds no full record of the node
+        GraphNodeMeta value() const;
+
+        void Next();
+        // first key >= target inside the prefix range
+        void Seek(std::string_view target);
+        void SeekToFirst();
+
+    private:
+        friend class Memtable;
+        Iterator(const Table* table, std::string_view prefix, uint64_t snapshot);
+
+        // move forward to the first key with a visible record, or stop
+        // once past the prefix range
+        void settle();
+
+        Table::Iterator iter_;
+        std::string prefix_;
+        uint64_t snapshot_;
+        const MetaEntry* head_ = nullptr;  // newest visible record of the current key
+    };
+
+    // the arena charges its blocks to `tracker` when one is given
+    explicit Memtable(size_t max_size = 1024 * 1024, MemoryTracker* tracker = nullptr);
     ~Memtable();
 
     // Delete copy semantics
@@ -34,17 +127,36 @@ public:
     Memtable& operator=(const Memtable&) = delete;
 
     // Operations
+    // never fails for lack of space, check is_full() afterwards
+    // records are appended per key and folded on read (see GraphNodeMeta::merge)
+    // throws std::runtime_error if the memtable is frozen
     void insert(std::string new_node_id, GraphNodeMeta& meta_node);
-    void dump();
+    void freeze() noexcept;
+    bool is_full() const noexcept;
     bool is_frozen() const noexcept;
     size_t size() const noexcept;
+    // bytes actually reserved by the arena, size() is the logical fill level
+    size_t memoryUsage() const noexcept;
     bool empty() const;
     size_t count() const;
+    // The table holds the log record ending at position, it has to stay in
+    // the log until the table is flushed
+    void markLogged(uint64_t position) noexcept;
+    // lowest position given to markLogged(), UINT64_MAX if none was
+    uint64_t firstLogPosition() const noexcept;
+    // folded view of the node in this memtable, nullptr if absent. the result
+    // is a delta when this memtable holds no full record of the node, the
+    // caller has to fold it onto older memtables/SSTables
     std::shared_ptr<GraphNodeMeta> get(const std::string& node_id) const;
-    std::vector<std::pair<std::string, std::shared_ptr<GraphNodeMeta>>> getEntries() const;
+
+    // Iterator over the keys starting with `prefix` (all keys if empty),
+    // positioned at the first of them
+    Iterator newIterator(std::string_view prefix = {}) const;
 
     // Serialization/Deserialization
+    // [count] then per key [key size][key][value size][GraphNodeMeta::encodeTo()]
     std::ostream& serialize(std::ostream& out);
+    // throws std::runtime_error if a record of the dump can't be decoded
     void deserialize(std::istream& in);
 };
 
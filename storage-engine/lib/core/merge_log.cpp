@@ -3,24 +3,573 @@
 // Implementation of MergeLog (sequential log of writes) for the storage engine.
 
 #include "core/merge_log.h"
+#include "core/utils.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <optional>
+#include <stdexcept>
 
 namespace storage_engine {
 
-std::ostream& MergeLog::serialize() {
-    // Placeholder for serialization logic, just returning std::cout for now
-    return std::cout;
+namespace {
+
+// [fixed32 length][fixed32 crc] in front of every record
+constexpr size_t kHeaderSize = 2 * sizeof(uint32_t);
+
+// segments are read this much at a time
+constexpr size_t kReadSize = 1 << 20;
+
+// records start 8 byte aligned in the ring, so a length word never wraps
+uint64_t slotSize(size_t record_size) {
+    return (static_cast<uint64_t>(record_size) + 7) & ~uint64_t(7);
+}
+
+// number of a segment file, named "<number>.log"
+std::optional<uint64_t> segmentNumber(const std::filesystem::path& path) {
+    if (path.extension() != ".log") {
+        return std::nullopt;
+    }
+    try {
+        return std::stoull(path.stem().string());
+    } catch (const std::exception&) {
+        return std::nullopt; // not one of ours
+    }
 }
 
-void MergeLog::deserialize(std::istream& in) {
-    // Placeholder for deserialization logic
+// log position of the first record of a segment, nothing if it holds none.
+// only the header is read, the record is checked when it is replayed
+std::optional<uint64_t> firstPosition(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return std::nullopt;
+    }
+    char header[kHeaderSize + sizeof(uint64_t)];
+    ssize_t n = ::pread(fd, header, sizeof(header), 0);
+    ::close(fd);
+    if (n != static_cast<ssize_t>(sizeof(header)) || Util::decodeFixed32(header) == 0) {
+        return std::nullopt;
+    }
+    return Util::decodeFixed64(header + kHeaderSize);
 }
 
-void MergeLog::add(const std::string& new_node_id, GraphNodeMeta& meta_node) {
-    // Placeholder for adding a new node to the log
+void writeAll(int fd, std::string_view data, const std::string& path) {
+    while (!data.empty()) {
+        ssize_t n = ::write(fd, data.data(), data.size());
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            throw std::runtime_error("Failed to write " + path + ": " + std::strerror(errno));
+        }
+        data.remove_prefix(static_cast<size_t>(n));
+    }
+}
+
+// a new file is only durable once the directory entry is
+void syncDirectory(const std::string& directory) {
+    int fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd >= 0) {
+        ::fsync(fd);
+        ::close(fd);
+    }
+}
+
+} // namespace
+
+MergeLog::MergeLog(const std::string& directory, const MergeLogOptions& options)
+    : directory_(directory), options_(options) {
+    capacity_ = 4096;
+    while (capacity_ < options_.buffer_size) {
+        capacity_ <<= 1;
+    }
+    mask_ = capacity_ - 1;
+    ring_ = std::make_unique<char[]>(capacity_);  // zeroed: no record is complete
+
+    std::filesystem::create_directories(directory_);
+    for (const auto& entry : std::filesystem::directory_iterator(directory_)) {
+        if (entry.path().extension() == ".free") {
+            free_.push_back(entry.path().string());
+        }
+    }
+
+    // positions go on from the newest record of the last run. a crash can
+    // only tear the newest segment, its tail is cut off so that replay
+    // finds nothing but valid records in front of ours
+    uint64_t position = 0;
+    auto existing = segments(directory_);
+    for (auto it = existing.rbegin(); it != existing.rend() && position == 0; ++it) {
+        Reader reader(*it);
+        LogRecord record;
+        while (reader.next(record)) {
+        }
+        if (reader.corrupted() && it == existing.rbegin() && ::truncate(it->c_str(), static_cast<off_t>(reader.validBytes())) != 0) {
+            throw std::runtime_error("Failed to truncate " + *it + ": " + std::strerror(errno));
+        }
+        position = reader.endPosition();
+    }
+
+    // a segment ends where the next one with records starts
+    uint64_t next_start = position;
+    for (auto it = existing.rbegin(); it != existing.rend(); ++it) {
+        closed_.emplace_front(next_start, *it);
+        if (auto start = firstPosition(*it)) {
+            next_start = *start;
+        }
+    }
+    position = std::max(position, (options_.first_position + 7) & ~uint64_t(7));
+    reserved_ = consumed_ = position;
+    write_requested_ = sync_requested_ = written_ = synced_ = position;
+
+    openSegment(existing.empty() ? 1 : *segmentNumber(existing.back()) + 1);
+    thread_ = std::thread(&MergeLog::run, this);
+}
+
+MergeLog::~MergeLog() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    work_.notify_one();
+    thread_.join();
+    try {
+        closeSegment();
+    } catch (const std::runtime_error&) {
+        // the newest segment may end in anything, the next open cuts it off
+    }
+}
+
+uint64_t MergeLog::add(const std::string& new_node_id, const GraphNodeMeta& meta_node) {
+    // encoded before claiming room, the ring only sees a copy
+    std::string record(kHeaderSize + sizeof(uint64_t), '\0');
+    Util::putLengthPrefixed(record, new_node_id);
+    meta_node.encodeTo(record);
+    uint64_t slot = slotSize(record.size());
+    if (slot > capacity_) {
+        throw std::invalid_argument("Log record of " + new_node_id + " is bigger than the log buffer");
+    }
+
+    uint64_t position = reserved_.fetch_add(slot, std::memory_order_acq_rel);
+    while (position + slot > consumed_.load(std::memory_order_acquire) + capacity_) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            ring_full_ = true;
+        }
+        work_.notify_one();
+        std::this_thread::yield();
+    }
+
+    std::string header;
+    Util::putFixed32(header, static_cast<uint32_t>(record.size() - kHeaderSize));
+    std::string encoded_position;
+    Util::putFixed64(encoded_position, position);
+    std::memcpy(&record[kHeaderSize], encoded_position.data(), sizeof(uint64_t));
+    std::string crc;
+    Util::putFixed32(crc, Util::crc32(std::string_view(record).substr(kHeaderSize)));
+    std::memcpy(&record[sizeof(uint32_t)], crc.data(), sizeof(uint32_t));
+
+    // everything but the length, which tells the log thread the record is complete
+    copyIn(position + sizeof(uint32_t), record.data() + sizeof(uint32_t), record.size() - sizeof(uint32_t));
+    uint32_t length;
+    std::memcpy(&length, header.data(), sizeof(length));
+    __atomic_store_n(reinterpret_cast<uint32_t*>(&ring_[position & mask_]), length, __ATOMIC_RELEASE);
+    return position + slot;
+}
+
+void MergeLog::waitFor(uint64_t position, bool sync) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    uint64_t& requested = sync ? sync_requested_ : write_requested_;
+    requested = std::max(requested, position);
+    work_.notify_one();
+    progress_.wait(lock, [&]() { return !error_.empty() || (sync ? synced_ : written_) >= position; });
+    if (!error_.empty()) {
+        throw std::runtime_error(error_);
+    }
+}
+
+void MergeLog::commit(uint64_t position, SyncMode mode) {
+    switch (mode) {
+    case SyncMode::kSync:
+        waitFor(position, true);
+        break;
+    case SyncMode::kPeriodic:
+        waitFor(position, false);
+        break;
+    case SyncMode::kAsync:
+        break;
+    default:
+        throw std::invalid_argument("No sync mode to commit the log with");
+    }
 }
 
 void MergeLog::toDisc() {
-    // Placeholder for writing the log to disk
+    waitFor(position(), true);
+}
+
+uint64_t MergeLog::position() const noexcept {
+    return reserved_.load(std::memory_order_acquire);
+}
+
+size_t MergeLog::removeSegments(uint64_t position) {
+    std::lock_guard<std::mutex> lock(segments_mutex_);
+    size_t removed = 0;
+    while (!closed_.empty() && closed_.front().first <= position) {
+        const std::string& path = closed_.front().second;
+        std::error_code error;
+        bool recycled = false;
+        if (free_.size() < options_.recycle_segments) {
+            std::string free_path = std::filesystem::path(path).replace_extension(".free").string();
+            std::filesystem::rename(path, free_path, error);
+            if (!error) {
+                free_.push_back(free_path);
+                recycled = true;
+            }
+        }
+        if (!recycled && !std::filesystem::remove(path, error) && error) {
+            throw std::runtime_error("Failed to remove " + path + ": " + error.message());
+        }
+        closed_.pop_front();
+        ++removed;
+    }
+    if (removed > 0) {
+        syncDirectory(directory_);
+    }
+    return removed;
+}
+
+const std::string& MergeLog::directory() const noexcept {
+    return directory_;
+}
+
+const MergeLogStats& MergeLog::stats() const noexcept {
+    return stats_;
+}
+
+std::vector<std::string> MergeLog::segments(const std::string& directory) {
+    std::vector<std::pair<uint64_t, std::string>> numbered;
+    if (std::filesystem::is_directory(directory)) {
+        for (const auto& entry : std::filesystem::directory_iterator(directory)) {
+            if (auto number = segmentNumber(entry.path())) {
+                numbered.emplace_back(*number, entry.path().string());
+            }
+        }
+    }
+    std::sort(numbered.begin(), numbered.end());
+
+    std::vector<std::string> paths;
+    for (auto& segment : numbered) {
+        paths.push_back(std::move(segment.second));
+    }
+    return paths;
+}
+
+SyncMode MergeLog::syncModeFromString(const std::string& name) {
+    if (name == "sync") {
+        return SyncMode::kSync;
+    }
+    if (name == "periodic") {
+        return SyncMode::kPeriodic;
+    }
+    if (name == "async") {
+        return SyncMode::kAsync;
+    }
+    throw std::invalid_argument("Unknown sync mode: " + name);
+}
+
+void MergeLog::run() {
+    using Clock = std::chrono::steady_clock;
+    std::string batch;
+    auto next_sync = Clock::now() + std::chrono::milliseconds(options_.sync_interval_ms);
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        auto wake = Clock::now() + std::chrono::milliseconds(options_.write_interval_ms);
+        if (options_.sync_interval_ms > 0) {
+            wake = std::min(wake, next_sync);
+        }
+        work_.wait_until(lock, wake, [this]() {
+            return stop_ || ring_full_ || write_requested_ > written_ || sync_requested_ > synced_;
+        });
+        bool stopping = stop_;
+        bool sync = stopping || sync_requested_ > synced_;
+        if (options_.sync_interval_ms > 0 && Clock::now() >= next_sync) {
+            sync = true;
+            next_sync = Clock::now() + std::chrono::milliseconds(options_.sync_interval_ms);
+        }
+        ring_full_ = false;
+        uint64_t synced = synced_;
+        std::string error = error_;
+        lock.unlock();
+
+        // writers keep appending meanwhile, the ones that ask for a
+        // position now are served by the next round: group commit
+        uint64_t position = drain(batch, error);
+        if (sync && position > synced && error.empty()) {
+            if (::fdatasync(segment_fd_) != 0) {
+                error = "Failed to sync the log: " + std::string(std::strerror(errno));
+            }
+            stats_.syncs.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        lock.lock();
+        if (position == written_ && !stopping) {
+            // a record someone waits for is still being copied in
+            lock.unlock();
+            std::this_thread::yield();
+            lock.lock();
+        }
+        written_ = position;
+        if (sync) {
+            synced_ = position;
+        }
+        error_ = error;
+        progress_.notify_all();
+        if (stopping && position == reserved_.load(std::memory_order_acquire)) {
+            return;
+        }
+    }
+}
+
+uint64_t MergeLog::drain(std::string& batch, std::string& error) {
+    // a write that failed leaves the segment in an unknown state, nothing
+    // more goes to disk but the ring keeps draining so writers don't hang
+    auto write = [&]() {
+        if (!batch.empty() && error.empty()) {
+            try {
+                writeAll(segment_fd_, batch, directory_);
+                stats_.writes.fetch_add(1, std::memory_order_relaxed);
+                stats_.bytes_written.fetch_add(batch.size(), std::memory_order_relaxed);
+            } catch (const std::exception& e) {
+                error = e.what();
+            }
+        }
+        segment_bytes_ += batch.size();
+        batch.clear();
+    };
+
+    uint64_t position = consumed_.load(std::memory_order_relaxed);
+    uint64_t reserved = reserved_.load(std::memory_order_acquire);
+    batch.clear();
+    while (position < reserved) {
+        uint32_t word = __atomic_load_n(reinterpret_cast<uint32_t*>(&ring_[position & mask_]), __ATOMIC_ACQUIRE);
+        if (word == 0) {
+            break;  // claimed, still being copied in
+        }
+        char encoded[sizeof(word)];
+        std::memcpy(encoded, &word, sizeof(word));
+        size_t size = kHeaderSize + Util::decodeFixed32(encoded);
+
+        // room is left for the zero length that ends the segment
+        if (segment_bytes_ + batch.size() + size + kHeaderSize > options_.segment_size &&
+            segment_bytes_ + batch.size() > 0) {
+            write();
+            try {
+                closeSegment();
+                {
+                    std::lock_guard<std::mutex> lock(segments_mutex_);
+                    closed_.emplace_back(position, segment_path_);
+                }
+                openSegment(segment_number_ + 1);
+            } catch (const std::exception& e) {
+                error = error.empty() ? e.what() : error;
+            }
+        }
+
+        copyOut(position, size, batch);
+        // the next lap over these bytes must find no complete record
+        uint64_t slot = slotSize(size);
+        size_t start = position & mask_;
+        size_t first = std::min<size_t>(slot, capacity_ - start);
+        std::memset(&ring_[start], 0, first);
+        std::memset(&ring_[0], 0, slot - first);
+        position += slot;
+        stats_.records.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // the copies are in batch, writers may reuse the room already
+    consumed_.store(position, std::memory_order_release);
+    write();
+    return position;
+}
+
+void MergeLog::openSegment(uint64_t number) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%06llu.log", static_cast<unsigned long long>(number));
+    std::string path = (std::filesystem::path(directory_) / name).string();
+
+    // a freed segment is written over from the start: its blocks are
+    // allocated and written already, syncing appends to it touches no
+    // metadata. the zero length in front, synced before the rename, tells
+    // readers none of the records left in it are ours
+    std::string free_path;
+    {
+        std::lock_guard<std::mutex> lock(segments_mutex_);
+        if (!free_.empty()) {
+            free_path = free_.front();
+            free_.pop_front();
+        }
+    }
+    segment_fd_ = -1;
+    if (!free_path.empty()) {
+        int fd = ::open(free_path.c_str(), O_WRONLY | O_CLOEXEC);
+        const char zeros[kHeaderSize] = {};
+        if (fd >= 0 && ::pwrite(fd, zeros, sizeof(zeros), 0) == static_cast<ssize_t>(sizeof(zeros)) &&
+            ::fdatasync(fd) == 0 && ::rename(free_path.c_str(), path.c_str()) == 0) {
+            segment_fd_ = fd;
+            stats_.segments_recycled.fetch_add(1, std::memory_order_relaxed);
+        } else if (fd >= 0) {
+            ::close(fd);
+            ::unlink(free_path.c_str());
+        }
+    }
+    if (segment_fd_ < 0) {
+        segment_fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (segment_fd_ < 0) {
+            throw std::runtime_error("Failed to create " + path + ": " + std::strerror(errno));
+        }
+        // allocated up front, appends never extend the file. not every file
+        // system can, the segment then grows as it is written
+        if (::fallocate(segment_fd_, 0, 0, static_cast<off_t>(options_.segment_size)) == 0) {
+            ::fsync(segment_fd_);
+        }
+        stats_.segments_created.fetch_add(1, std::memory_order_relaxed);
+    }
+    syncDirectory(directory_);
+    segment_number_ = number;
+    segment_bytes_ = 0;
+    segment_path_ = path;
+}
+
+void MergeLog::closeSegment() {
+    if (segment_fd_ < 0) {
+        return;
+    }
+    int fd = segment_fd_;
+    segment_fd_ = -1;
+
+    // a zero length ends the segment, behind it may be what is left of a
+    // record from its last use
+    const char end[kHeaderSize] = {};
+    bool ended = ::write(fd, end, sizeof(end)) == static_cast<ssize_t>(sizeof(end));
+    // what a waiter saw written must survive the switch to a new segment
+    ::fdatasync(fd);
+    ::close(fd);
+    if (!ended) {
+        throw std::runtime_error("Failed to end log segment " + segment_path_ + ": " + std::strerror(errno));
+    }
+}
+
+void MergeLog::copyIn(uint64_t position, const char* data, size_t size) {
+    size_t start = position & mask_;
+    size_t first = std::min(size, capacity_ - start);
+    std::memcpy(&ring_[start], data, first);
+    std::memcpy(&ring_[0], data + first, size - first);
+}
+
+void MergeLog::copyOut(uint64_t position, size_t size, std::string& dst) {
+    size_t start = position & mask_;
+    size_t first = std::min(size, capacity_ - start);
+    dst.append(&ring_[start], first);
+    dst.append(&ring_[0], size - first);
+}
+
+MergeLog::Reader::Reader(const std::string& path) : path_(path) {
+    fd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd_ < 0) {
+        throw std::runtime_error("Failed to open " + path + ": " + std::strerror(errno));
+    }
+    off_t end = ::lseek(fd_, 0, SEEK_END);
+    file_size_ = end > 0 ? static_cast<uint64_t>(end) : 0;
+    ::lseek(fd_, 0, SEEK_SET);
+    ::posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+}
+
+MergeLog::Reader::~Reader() {
+    ::close(fd_);
+}
+
+bool MergeLog::Reader::next(LogRecord& record) {
+    if (corrupted_ || !fill(kHeaderSize)) {
+        return false;
+    }
+    uint32_t length = Util::decodeFixed32(&buffer_[offset_]);
+    uint32_t crc = Util::decodeFixed32(&buffer_[offset_ + sizeof(uint32_t)]);
+
+    // zeros: the preallocated part of the segment nothing was written to
+    if (length == 0) {
+        return false;
+    }
+    // a length running past the file is a torn write, not a huge record
+    if (length < sizeof(uint64_t) || file_offset_ + kHeaderSize + length > file_size_ || !fill(kHeaderSize + length)) {
+        corrupted_ = true;
+        return false;
+    }
+    std::string_view payload(&buffer_[offset_ + kHeaderSize], length);
+    std::string_view key;
+    record.meta = GraphNodeMeta();
+    if (Util::crc32(payload) != crc) {
+        corrupted_ = true;
+        return false;
+    }
+    record.position = Util::decodeFixed64(payload.data());
+    if (file_offset_ > 0 && record.position != end_position_) {
+        return false;  // written before the segment was recycled
+    }
+    payload.remove_prefix(sizeof(uint64_t));
+    if (!Util::getLengthPrefixed(payload, key) || !record.meta.decodeFrom(payload)) {
+        corrupted_ = true;
+        return false;
+    }
+    record.key.assign(key.data(), key.size());
+
+    offset_ += kHeaderSize + length;
+    file_offset_ += kHeaderSize + length;
+    end_position_ = record.position + slotSize(kHeaderSize + length);
+    record.end_position = end_position_;
+    return true;
+}
+
+bool MergeLog::Reader::corrupted() const noexcept {
+    return corrupted_;
+}
+
+uint64_t MergeLog::Reader::endPosition() const noexcept {
+    return end_position_;
+}
+
+uint64_t MergeLog::Reader::validBytes() const noexcept {
+    return file_offset_;
+}
+
+bool MergeLog::Reader::fill(size_t bytes) {
+    while (buffer_.size() - offset_ < bytes) {
+        if (eof_) {
+            // trailing bytes too short for a record are a torn write too,
+            // unless they are the zeros of a preallocated segment
+            corrupted_ = std::any_of(buffer_.begin() + offset_, buffer_.end(), [](char c) { return c != 0; });
+            return false;
+        }
+        // keep the unread tail, read the next chunk behind it
+        buffer_.erase(0, offset_);
+        offset_ = 0;
+        size_t old_size = buffer_.size();
+        buffer_.resize(old_size + std::max(kReadSize, bytes));
+        ssize_t n = ::read(fd_, &buffer_[old_size], buffer_.size() - old_size);
+        if (n < 0 && errno == EINTR) {
+            buffer_.resize(old_size);
+            continue;
+        }
+        if (n < 0) {
+            throw std::runtime_error("Failed to read " + path_ + ": " + std::strerror(errno));
+        }
+        buffer_.resize(old_size + static_cast<size_t>(n));
+        eof_ = n == 0;
+    }
+    return true;
 }
 
 } // namespace storage_engine
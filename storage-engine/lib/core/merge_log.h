@@ -3,28 +3,236 @@
 #ifndef CORE_MERGE_LOG_H
 #define CORE_MERGE_LOG_H
 
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
 #include <string>
-#include <iostream>
+#include <thread>
+#include <vector>
 #include "core/graph_node.h"
 
 namespace storage_engine {
 
+// How long a write waits on the write-ahead log before it returns
+enum class SyncMode {
+    kDefault,   // whatever the engine is configured with
+    kSync,      // fdatasync'd: survives a power failure
+    kPeriodic,  // written to its segment: survives a crash of the process,
+                // on stable storage within the log's sync interval
+    kAsync,     // only in the ring: the log thread writes it within the
+                // write interval and syncs it within the sync interval
+};
+
+// How the write-ahead log is kept
+struct MergeLogOptions {
+    // bytes of the ring writers append to, rounded up to a power of two.
+    // writers wait for the log thread once it is full
+    size_t buffer_size = 4 << 20;
+
+    // a segment is closed and the next one started once it holds this
+    // many bytes. segments are allocated this big up front
+    uint64_t segment_size = 64ull << 20;
+
+    // segments a checkpoint freed that are kept to be written over instead
+    // of creating new ones, the ones beyond are deleted
+    size_t recycle_segments = 4;
+
+    // the log thread writes out what collected in the ring at least this
+    // often, even with no writer waiting on it
+    uint64_t write_interval_ms = 10;
+
+    // the log thread fdatasyncs what it wrote at least this often, even
+    // with no writer waiting on it. 0 syncs only when asked to
+    uint64_t sync_interval_ms = 0;
+
+    // positions start no lower than this (rounded up to 8), even if the
+    // segments end before it: a checkpoint may cover records that were
+    // flushed to SSTables but never written to the log
+    uint64_t first_position = 0;
+};
+
+// Counters of the log thread
+struct MergeLogStats {
+    std::atomic<uint64_t> records{0};
+    std::atomic<uint64_t> bytes_written{0};
+    std::atomic<uint64_t> writes{0};  // write() calls, each a batch of records
+    std::atomic<uint64_t> syncs{0};   // fdatasync() calls, shared by every waiter of a batch
+    std::atomic<uint64_t> segments_created{0};
+    std::atomic<uint64_t> segments_recycled{0};
+};
+
+// One logged write
+struct LogRecord {
+    uint64_t position = 0;      // log position of the record, grows with every record
+    uint64_t end_position = 0;  // just past the record, what add() returned for it
+    std::string key;
+    GraphNodeMeta meta;
+};
+
+// Write-ahead log of the node records going into the memtables.
+//
+// Writers encode a record, claim room for it in a ring buffer with one
+// atomic add and copy it in: no lock is taken on the write path. A log
+// thread drains the ring in order into large sequential writes to segment
+// files ("<number>.log"). Writers that need their record on disk wait for
+// a position; everyone waiting at the same time is covered by the same
+// write and the same fdatasync (group commit).
+//
+// Records are [fixed32 length][fixed32 crc][fixed64 position]
+// [length prefixed key][encoded GraphNodeMeta], in the ring padded to 8
+// bytes. the length doubles as the flag that the record is complete.
+//
+// Segments are preallocated with fallocate() and, once a checkpoint
+// covers them, renamed to "<number>.free" and written over as later
+// segments, so appends never grow a file. A segment ends at a zero length
+// (the preallocated tail) or at a record that doesn't continue the
+// positions before it (left from the segment's last use).
 class MergeLog {
 public:
-    MergeLog() = default;
-    ~MergeLog() = default;
+    // Segments of an earlier run in directory are left alone but for a torn
+    // tail of the newest one, which is cut off. records go to a new segment
+    // after them and continue their positions
+    // throws std::runtime_error if the directory or a segment can't be created
+    explicit MergeLog(const std::string& directory, const MergeLogOptions& options = MergeLogOptions());
+
+    // writes and syncs every record added, then stops the log thread
+    ~MergeLog();
+
+    MergeLog(const MergeLog&) = delete;
+    MergeLog& operator=(const MergeLog&) = delete;
 
-    // Serialize the log to an output stream
-    std::ostream& serialize();
+    // Append a record and return the log position just past it. The record
+    // is in memory until the log thread gets to it, see waitFor()
+    // throws std::invalid_argument if the record is bigger than the ring
+    uint64_t add(const std::string& new_node_id, const GraphNodeMeta& meta_node);
 
-    // Deserialize the log from an input stream
-    void deserialize(std::istream& in);
+    // Block until every record before position is written to its segment,
+    // and with sync also on stable storage
+    // throws std::runtime_error if the log can't be written
+    void waitFor(uint64_t position, bool sync);
 
-    // Add a new entry to the log (should maintain the order of arrival)
-    void add(const std::string& new_node_id, GraphNodeMeta& meta_node);
+    // waitFor() as much as mode asks for, nothing for kAsync
+    // throws std::invalid_argument on kDefault, which only the engine resolves
+    // throws std::runtime_error if the log can't be written
+    void commit(uint64_t position, SyncMode mode);
 
-    // Write the log to disk
+    // Write and sync every record added so far
+    // throws std::runtime_error if the log can't be written
     void toDisc();
+
+    // log position just past the last record added
+    uint64_t position() const noexcept;
+
+    // Recycle or delete the segments no longer written to whose records
+    // all end at or before position (a checkpoint: everything up to it is
+    // in SSTables). returns how many went
+    // throws std::runtime_error if a segment can't be deleted
+    size_t removeSegments(uint64_t position);
+
+    const std::string& directory() const noexcept;
+    const MergeLogStats& stats() const noexcept;
+
+    // Segment files of directory, oldest first
+    static std::vector<std::string> segments(const std::string& directory);
+
+    // "sync", "periodic" or "async"
+    // throws std::invalid_argument on any other name
+    static SyncMode syncModeFromString(const std::string& name);
+
+    // Records of one segment in log order. Reading stops at the end of the
+    // log in it, or at the first record that is torn or fails its
+    // checksum, the tail a crash left
+    class Reader {
+    public:
+        // throws std::runtime_error if the segment can't be opened
+        explicit Reader(const std::string& path);
+        ~Reader();
+
+        Reader(const Reader&) = delete;
+        Reader& operator=(const Reader&) = delete;
+
+        // false at the end of the valid records
+        // throws std::runtime_error on a read error
+        bool next(LogRecord& record);
+
+        // the segment ends in bytes that are not a valid record. zeros and
+        // records of an earlier use of the segment are not
+        bool corrupted() const noexcept;
+
+        // log position just past the last record read
+        uint64_t endPosition() const noexcept;
+
+        // bytes of the segment up to the end of the last record read
+        uint64_t validBytes() const noexcept;
+
+    private:
+        std::string path_;
+        int fd_ = -1;
+        uint64_t file_size_ = 0;
+        uint64_t file_offset_ = 0;  // of the next record
+        std::string buffer_;
+        size_t offset_ = 0;         // of the next record in buffer_
+        bool eof_ = false;
+        bool corrupted_ = false;
+        uint64_t end_position_ = 0;
+
+        // at least bytes past offset_ in buffer_, false at the end of file
+        bool fill(size_t bytes);
+    };
+
+private:
+    std::string directory_;
+    MergeLogOptions options_;
+    MergeLogStats stats_;
+
+    // the ring: a record at position p starts at p & mask_. writers claim
+    // room by moving reserved_, the log thread frees it by moving consumed_
+    std::unique_ptr<char[]> ring_;
+    size_t capacity_ = 0;
+    uint64_t mask_ = 0;
+    std::atomic<uint64_t> reserved_{0};
+    std::atomic<uint64_t> consumed_{0};
+
+    // the segment being appended to, only touched by the log thread
+    int segment_fd_ = -1;
+    uint64_t segment_number_ = 0;
+    uint64_t segment_bytes_ = 0;
+    std::string segment_path_;
+
+    // segments done with, oldest first, each with the log position its
+    // last record ends at
+    std::mutex segments_mutex_;
+    std::deque<std::pair<uint64_t, std::string>> closed_;  // guarded by segments_mutex_
+    std::deque<std::string> free_;                          // recycled, guarded by segments_mutex_
+
+    std::mutex mutex_;
+    std::condition_variable work_;      // wakes the log thread
+    std::condition_variable progress_;  // wakes writers waiting on positions
+    uint64_t write_requested_ = 0;      // guarded by mutex_ from here on
+    uint64_t sync_requested_ = 0;
+    uint64_t written_ = 0;
+    uint64_t synced_ = 0;
+    bool ring_full_ = false;
+    bool stop_ = false;
+    std::string error_;  // the log can't be written anymore
+    std::thread thread_;
+
+    void run();
+
+    // Move every complete record from the ring into segments, returns the
+    // position up to which they were written. once error is set records
+    // are dropped instead
+    uint64_t drain(std::string& batch, std::string& error);
+
+    void openSegment(uint64_t number);
+    // throws std::runtime_error if the end of the segment can't be written
+    void closeSegment();
+
+    void copyIn(uint64_t position, const char* data, size_t size);
+    void copyOut(uint64_t position, size_t size, std::string& dst);
 };
 
 } // namespace storage_engine
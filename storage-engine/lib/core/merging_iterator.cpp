@@ -0,0 +1,159 @@
+// merging_iterator.cpp
+//
+// Implementation of MergingIterator (k-way merge of memtables and SSTables) for the storage engine.
+
+#include "core/merging_iterator.h"
+#include <algorithm>
+#include <stdexcept>
+
+namespace storage_engine {
+
+MemtableSource::MemtableSource(Memtable::Iterator it) : it_(std::move(it)) {}
+
+bool MemtableSource::Valid() const {
+    return it_.Valid();
+}
+
+std::string_view MemtableSource::key() const {
+    return it_.key();
+}
+
+GraphNodeMeta MemtableSource::value() const {
+    return it_.value();
+}
+
+void MemtableSource::Next() {
+    it_.Next();
+}
+
+void MemtableSource::Seek(std::string_view target) {
+    it_.Seek(target);
+}
+
+void MemtableSource::SeekToFirst() {
+    it_.SeekToFirst();
+}
+
+SSTableSource::SSTableSource(const SSTableReader* reader) : reader_(reader), it_(reader) {}
+
+bool SSTableSource::Valid() const {
+    return it_.Valid();
+}
+
+std::string_view SSTableSource::key() const {
+    return it_.key();
+}
+
+GraphNodeMeta SSTableSource::value() const {
+    GraphNodeMeta meta;
+    if (!meta.decodeFrom(it_.value())) {
+        throw std::runtime_error("Corrupted record of " + std::string(it_.key()) + " in " + reader_->filename());
+    }
+    return meta;
+}
+
+void SSTableSource::Next() {
+    it_.Next();
+}
+
+void SSTableSource::Seek(std::string_view target) {
+    it_.Seek(target);
+}
+
+void SSTableSource::SeekToFirst() {
+    it_.SeekToFirst();
+}
+
+MergingIterator::MergingIterator(std::vector<std::unique_ptr<MergeSource>> sources) : sources_(std::move(sources)) {
+    heap_.reserve(sources_.size());
+}
+
+bool MergingIterator::Valid() const {
+    return valid_;
+}
+
+std::string_view MergingIterator::key() const {
+    return key_;
+}
+
+const GraphNodeMeta& MergingIterator::value() const {
+    return value_;
+}
+
+const std::vector<std::string>& MergingIterator::replacedDataIds() const {
+    return replaced_data_ids_;
+}
+
+void MergingIterator::Next() {
+    fold();
+}
+
+void MergingIterator::Seek(std::string_view target) {
+    for (auto& source : sources_) {
+        source->Seek(target);
+    }
+    rebuildHeap();
+    fold();
+}
+
+void MergingIterator::SeekToFirst() {
+    for (auto& source : sources_) {
+        source->SeekToFirst();
+    }
+    rebuildHeap();
+    fold();
+}
+
+bool MergingIterator::after(size_t a, size_t b) const {
+    int cmp = sources_[a]->key().compare(sources_[b]->key());
+    return cmp != 0 ? cmp > 0 : a > b;
+}
+
+void MergingIterator::rebuildHeap() {
+    heap_.clear();
+    for (size_t i = 0; i < sources_.size(); ++i) {
+        if (sources_[i]->Valid()) {
+            heap_.push_back(i);
+        }
+    }
+    std::make_heap(heap_.begin(), heap_.end(), [this](size_t a, size_t b) { return after(a, b); });
+}
+
+void MergingIterator::fold() {
+    auto cmp = [this](size_t a, size_t b) { return after(a, b); };
+    valid_ = !heap_.empty();
+    if (!valid_) {
+        return;
+    }
+
+    // the sources sharing the smallest key pop oldest first
+    replaced_data_ids_.clear();
+    bool first = true;
+    while (!heap_.empty() && (first || sources_[heap_.front()]->key() == key_)) {
+        std::pop_heap(heap_.begin(), heap_.end(), cmp);
+        size_t i = heap_.back();
+        heap_.pop_back();
+
+        auto& source = sources_[i];
+        if (first) {
+            key_.assign(source->key().data(), source->key().size());
+            value_ = source->value();
+            first = false;
+        } else {
+            GraphNodeMeta newer = source->value();
+            if (!newer.is_delta() && value_.get_type() == GraphNodeMeta::Type::kNode &&
+                !value_.get_data_id().empty() && value_.get_data_id() != newer.get_data_id()) {
+                replaced_data_ids_.push_back(value_.get_data_id());
+            }
+            value_.merge(newer);
+        }
+
+        source->Next();
+        if (source->Valid()) {
+            heap_.push_back(i);
+            std::push_heap(heap_.begin(), heap_.end(), cmp);
+        }
+    }
+}
+
+} // namespace storage_engine
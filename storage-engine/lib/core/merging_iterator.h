@@ -0,0 +1,105 @@
+#pragma once
+
+#ifndef CORE_MERGING_ITERATOR_H
+#define CORE_MERGING_ITERATOR_H
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "core/graph_node.h"
+#include "core/memtable.h"
+#include "core/sstable.h"
+
+namespace storage_engine {
+
+// One sorted input of a MergingIterator, each key at most once
+class MergeSource {
+public:
+    virtual ~MergeSource() = default;
+
+    virtual bool Valid() const = 0;
+    virtual std::string_view key() const = 0;
+    // throws std::runtime_error on a corrupted record
+    virtual GraphNodeMeta value() const = 0;
+
+    virtual void Next() = 0;
+    virtual void Seek(std::string_view target) = 0;
+    virtual void SeekToFirst() = 0;
+};
+
+// Records of a memtable, the memtable must outlive the source
+class MemtableSource : public MergeSource {
+public:
+    explicit MemtableSource(Memtable::Iterator it);
+
+    bool Valid() const override;
+    std::string_view key() const override;
+    GraphNodeMeta value() const override;
+    void Next() override;
+    void Seek(std::string_view target) override;
+    void SeekToFirst() override;
+
+private:
+    Memtable::Iterator it_;
+};
+
+// Records of an SSTable, one block in memory at a time. the reader must
+// outlive the source
+class SSTableSource : public MergeSource {
+public:
+    explicit SSTableSource(const SSTableReader* reader);
+
+    bool Valid() const override;
+    std::string_view key() const override;
+    GraphNodeMeta value() const override;
+    void Next() override;
+    void Seek(std::string_view target) override;
+    void SeekToFirst() override;
+
+private:
+    const SSTableReader* reader_;
+    SSTableReader::Iterator it_;
+};
+
+// Merge of sorted sources in key order, with a min-heap over their current
+// keys. Every key shows up once: its records are folded in the order the
+// sources were given, oldest first, so newer records land on top. Only the
+// current record of each source and the folded one are held in memory.
+class MergingIterator {
+public:
+    // sources oldest first
+    explicit MergingIterator(std::vector<std::unique_ptr<MergeSource>> sources);
+
+    bool Valid() const;
+    // valid until the iterator moves
+    std::string_view key() const;
+    const GraphNodeMeta& value() const;
+    // data ids of node records the current one replaced, nothing refers to
+    // them anymore once the folded record is written
+    const std::vector<std::string>& replacedDataIds() const;
+
+    // throws std::runtime_error on a corrupted record
+    void Next();
+    void Seek(std::string_view target);
+    void SeekToFirst();
+
+private:
+    std::vector<std::unique_ptr<MergeSource>> sources_;
+    std::vector<size_t> heap_;  // indexes of the valid sources
+    bool valid_ = false;
+    std::string key_;
+    GraphNodeMeta value_;
+    std::vector<std::string> replaced_data_ids_;
+
+    // heap order: smallest key on top, the older source first on a tie
+    bool after(size_t a, size_t b) const;
+
+    void rebuildHeap();
+    // pop every source at the smallest key and fold their records
+    void fold();
+};
+
+} // namespace storage_engine
+
+#endif // CORE_MERGING_ITERATOR_H
@@ -7,10 +7,35 @@
 
 namespace storage_engine {
 
-ObjectCache::ObjectCache() = default;
+ObjectCache::ObjectCache(size_t capacity, MemoryTracker* tracker)
+    : capacity_(capacity), tracker_(tracker) {}
+
+ObjectCache::~ObjectCache() {
+    if (tracker_ != nullptr) {
+        tracker_->release(MemoryTracker::Component::kObjectCache, memory_usage_);
+    }
+}
 
 void ObjectCache::put(const std::string& key, const GraphNodeData<void*>& data) {
-    cache_[key] = data;
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = cache_.find(key);
+    if (it != cache_.end()) {
+        erase(it);
+    }
+
+    lru_.emplace_front(key, data);
+    cache_[key] = lru_.begin();
+
+    size_t bytes = entrySize(lru_.front());
+    memory_usage_ += bytes;
+    if (tracker_ != nullptr) {
+        tracker_->consume(MemoryTracker::Component::kObjectCache, bytes);
+    }
+
+    // keep the newest entry even if it is bigger than the whole cache
+    if (capacity_ != 0 && memory_usage_ > capacity_ && lru_.size() > 1) {
+        evictLocked(memory_usage_ - capacity_);
+    }
 }
 
 void ObjectCache::put(const std::string& key, const std::vector<std::string>& connections) {
@@ -18,10 +43,12 @@ void ObjectCache::put(const std::string& key, const std::vector<std::string>& co
 }
 
 GraphNodeData<void*> ObjectCache::get(const std::string& key, uint8_t& error_code) {
+    std::lock_guard<std::mutex> lock(mutex_);
     auto it = cache_.find(key);
     if (it != cache_.end()) {
         error_code = 0; // No error
-        return it->second;
+        lru_.splice(lru_.begin(), lru_, it->second);
+        return it->second->second;
     } else {
         error_code = 1; // Cache miss
         return GraphNodeData<void*>(); // Return a default-constructed object
@@ -29,7 +56,51 @@ GraphNodeData<void*> ObjectCache::get(const std::string& key, uint8_t& error_cod
 }
 
 void ObjectCache::invalidate(const std::string& key) {
-    cache_.erase(key);
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = cache_.find(key);
+    if (it != cache_.end()) {
+        erase(it);
+    }
+}
+
+size_t ObjectCache::evict(size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return evictLocked(bytes);
+}
+
+size_t ObjectCache::memoryUsage() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return memory_usage_;
+}
+
+size_t ObjectCache::capacity() const noexcept {
+    return capacity_;
+}
+
+size_t ObjectCache::entrySize(const Entry& entry) noexcept {
+    // the key is stored twice, in the list entry and in the map
+    return 2 * MemoryTracker::stringBytes(entry.first) + entry.second.get_memory_usage() +
+           2 * sizeof(void*) + sizeof(std::list<Entry>::iterator) + MemoryTracker::kHashNodeOverhead;
+}
+
+void ObjectCache::erase(std::unordered_map<std::string, std::list<Entry>::iterator>::iterator it) {
+    size_t bytes = entrySize(*it->second);
+    memory_usage_ -= bytes;
+    if (tracker_ != nullptr) {
+        tracker_->release(MemoryTracker::Component::kObjectCache, bytes);
+    }
+    lru_.erase(it->second);
+    cache_.erase(it);
+}
+
+size_t ObjectCache::evictLocked(size_t bytes) {
+    size_t freed = 0;
+    while (freed < bytes && !lru_.empty()) {
+        size_t before = memory_usage_;
+        erase(cache_.find(lru_.back().first));
+        freed += before - memory_usage_;
+    }
+    return freed;
 }
 
 } // namespace storage_engine
@@ -3,17 +3,24 @@
 #ifndef CORE_OBJECT_CACHE_H
 #define CORE_OBJECT_CACHE_H
 
+#include <list>
+#include <mutex>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 #include <string>
 #include "core/graph_node.h"
+#include "core/memory_tracker.h"
 
 namespace storage_engine {
 
+// LRU cache of node data, bounded in bytes. Entries are charged to the
+// object cache component of `tracker` when one is given.
 class ObjectCache {
 public:
-    ObjectCache() = default;
-    ~ObjectCache() = default;
+    // capacity of 0 means unbounded
+    explicit ObjectCache(size_t capacity = 0, MemoryTracker* tracker = nullptr);
+    ~ObjectCache();
 
     // Store an object in the cache
     void put(const std::string& key, const GraphNodeData<void*>& data);
@@ -25,8 +32,28 @@ public:
     // Invalidate an entry in the cache
     void invalidate(const std::string& key);
 
+    // Drop least recently used entries until at least `bytes` are freed,
+    // returns the bytes actually freed
+    size_t evict(size_t bytes);
+
+    // Estimated heap bytes held by the cache
+    size_t memoryUsage() const;
+    size_t capacity() const noexcept;
+
 private:
-    std::unordered_map<std::string, GraphNodeData<void*>> cache_; // Map to store cached objects
+    using Entry = std::pair<std::string, GraphNodeData<void*>>;
+
+    std::list<Entry> lru_; // most recently used first
+    std::unordered_map<std::string, std::list<Entry>::iterator> cache_; // Map to store cached objects
+    mutable std::mutex mutex_; // writers invalidate concurrently from every shard
+    const size_t capacity_;
+    size_t memory_usage_ = 0;
+    MemoryTracker* tracker_ = nullptr;
+
+    static size_t entrySize(const Entry& entry) noexcept;
+    // callers hold mutex_
+    void erase(std::unordered_map<std::string, std::list<Entry>::iterator>::iterator it);
+    size_t evictLocked(size_t bytes);
 };
 
 } // namespace storage_engine
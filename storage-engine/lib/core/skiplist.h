@@ -0,0 +1,211 @@
+#pragma once
+
+#ifndef CORE_SKIPLIST_H
+#define CORE_SKIPLIST_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include "core/arena.h"
+
+namespace storage_engine {
+
+// Concurrent skiplist backing the memtable.
+//
+// Reads never take a lock, inserts link new nodes with CAS, bottom level
+// first, so a node is visible to readers as soon as it is linked at level 0.
+// Nodes are never unlinked while the list is alive. They live in the
+// memtable's arena and are released with it, so keys and values must be
+// trivially destructible (views and pointers into the same arena).
+template <typename Key, typename Value, typename Comparator = std::less<Key>>
+class SkipList {
+    static_assert(std::is_trivially_destructible<Key>::value &&
+                  std::is_trivially_destructible<Value>::value,
+                  "skiplist nodes are never destroyed, they live in the arena");
+
+public:
+    static constexpr int kMaxHeight = 12;
+
+    struct Node {
+        const Key key;
+        Value value;
+
+        Node(const Key& k) : key(k), value() {}
+
+        Node* next(int level) const {
+            return next_[level].load(std::memory_order_acquire);
+        }
+
+        void setNext(int level, Node* node) {
+            next_[level].store(node, std::memory_order_release);
+        }
+
+        bool casNext(int level, Node* expected, Node* node) {
+            return next_[level].compare_exchange_strong(
+                expected, node, std::memory_order_acq_rel, std::memory_order_acquire);
+        }
+
+    private:
+        friend class SkipList;
+        int height_ = 1;
+        // over-allocated to hold `height_` links
+        std::atomic<Node*> next_[1];
+    };
+
+    explicit SkipList(Arena* arena, Comparator cmp = Comparator())
+        : compare_(cmp), arena_(arena), head_(newNode(Key(), kMaxHeight)) {}
+
+    // nodes are owned by the arena
+    ~SkipList() = default;
+
+    SkipList(const SkipList&) = delete;
+    SkipList& operator=(const SkipList&) = delete;
+
+    // Returns the node for `key`, linking a new one if it is not present.
+    // The bool is true when this call created the node. `key` is stored as
+    // is, so any memory it refers to must outlive the list.
+    std::pair<Node*, bool> insert(const Key& key) {
+        Node* preds[kMaxHeight];
+        Node* succs[kMaxHeight];
+        Node* node = nullptr;
+
+        while (true) {
+            findSplice(key, preds, succs);
+            if (succs[0] != nullptr && equal(succs[0]->key, key)) {
+                // lost the race to another writer (or the key was already there),
+                // an unlinked node just stays unused in the arena
+                return {succs[0], false};
+            }
+
+            if (node == nullptr) {
+                node = newNode(key, randomHeight());
+            }
+            for (int level = 0; level < node->height_; ++level) {
+                node->next_[level].store(succs[level], std::memory_order_relaxed);
+            }
+
+            // publishing at level 0 makes the node visible
+            if (preds[0]->casNext(0, succs[0], node)) {
+                break;
+            }
+        }
+
+        // upper levels are only shortcuts, retry each until it sticks
+        for (int level = 1; level < node->height_; ++level) {
+            while (!preds[level]->casNext(level, succs[level], node)) {
+                findSpliceForLevel(node->key, level, preds, succs);
+                node->setNext(level, succs[level]);
+            }
+        }
+
+        return {node, true};
+    }
+
+    // Returns the node holding `key` or nullptr
+    Node* find(const Key& key) const {
+        Node* node = findGreaterOrEqual(key);
+        if (node != nullptr && equal(node->key, key)) {
+            return node;
+        }
+        return nullptr;
+    }
+
+    // Forward iterator over the bottom level, in key order
+    class Iterator {
+    public:
+        explicit Iterator(const SkipList* list) : list_(list), node_(nullptr) {}
+
+        bool Valid() const { return node_ != nullptr; }
+        const Key& key() const { return node_->key; }
+        Node* node() const { return node_; }
+
+        void Next() { node_ = node_->next(0); }
+        void Seek(const Key& target) { node_ = list_->findGreaterOrEqual(target); }
+        void SeekToFirst() { node_ = list_->head_->next(0); }
+
+    private:
+        const SkipList* list_;
+        Node* node_;
+    };
+
+private:
+    Comparator compare_;
+    Arena* const arena_;
+    Node* const head_;
+
+    bool equal(const Key& a, const Key& b) const {
+        return !compare_(a, b) && !compare_(b, a);
+    }
+
+    Node* newNode(const Key& key, int height) {
+        size_t bytes = sizeof(Node) + sizeof(std::atomic<Node*>) * (height - 1);
+        char* mem = arena_->allocateAligned(bytes);
+        Node* node = new (mem) Node(key);
+        node->height_ = height;
+        for (int level = 0; level < height; ++level) {
+            new (&node->next_[level]) std::atomic<Node*>(nullptr);
+        }
+        return node;
+    }
+
+    static int randomHeight() {
+        // xorshift per thread, promote with probability 1/4
+        thread_local uint32_t state = 0x9E3779B9u ^
+            static_cast<uint32_t>(reinterpret_cast<uintptr_t>(&state));
+        int height = 1;
+        while (height < kMaxHeight) {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            if ((state & 3) != 0) break;
+            ++height;
+        }
+        return height;
+    }
+
+    Node* findGreaterOrEqual(const Key& key) const {
+        Node* node = head_;
+        Node* next = nullptr;
+        for (int level = kMaxHeight - 1; level >= 0; --level) {
+            next = node->next(level);
+            while (next != nullptr && compare_(next->key, key)) {
+                node = next;
+                next = node->next(level);
+            }
+        }
+        return next;
+    }
+
+    // fills preds/succs such that preds[i]->key < key <= succs[i]->key
+    void findSplice(const Key& key, Node** preds, Node** succs) const {
+        Node* node = head_;
+        for (int level = kMaxHeight - 1; level >= 0; --level) {
+            Node* next = node->next(level);
+            while (next != nullptr && compare_(next->key, key)) {
+                node = next;
+                next = node->next(level);
+            }
+            preds[level] = node;
+            succs[level] = next;
+        }
+    }
+
+    void findSpliceForLevel(const Key& key, int level, Node** preds, Node** succs) const {
+        // the predecessor found earlier is still <= key, resume from there
+        Node* node = preds[level];
+        Node* next = node->next(level);
+        while (next != nullptr && compare_(next->key, key)) {
+            node = next;
+            next = node->next(level);
+        }
+        preds[level] = node;
+        succs[level] = next;
+    }
+};
+
+} // namespace storage_engine
+
+#endif // CORE_SKIPLIST_H
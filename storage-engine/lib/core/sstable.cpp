@@ -3,12 +3,69 @@
 // Implementation of SSTable (Sorted String Table) for the storage engine.
 
 #include "core/sstable.h"
+#include "core/bloom_filter.h"
+#include "core/utils.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
 #include <fstream>
+#include <iterator>
+#include <map>
 #include <stdexcept>
 
 namespace storage_engine {
 
-SSTable::SSTable() = default;
+namespace {
+
+// Block as stored on disk: the compressed bytes if they shrink by at least
+// 1/8, the raw ones otherwise, followed by the codec byte
+std::string encodeBlock(std::string_view raw, CompressionType type, CompressionStats* stats) {
+    std::string stored;
+    if (Compression::compress(type, raw, stored) && stored.size() < raw.size() - raw.size() / 8) {
+        if (stats != nullptr) {
+            stats->blocks_compressed.fetch_add(1, std::memory_order_relaxed);
+        }
+    } else {
+        stored.assign(raw.data(), raw.size());
+        type = CompressionType::kNone;
+        if (stats != nullptr) {
+            stats->blocks_stored_raw.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    stored.push_back(static_cast<char>(type));
+
+    if (stats != nullptr) {
+        stats->bytes_in.fetch_add(raw.size(), std::memory_order_relaxed);
+        stats->bytes_out.fetch_add(stored.size(), std::memory_order_relaxed);
+    }
+    return stored;
+}
+
+// Contents of a stored block. uncompressed blocks stay a view of `stored`,
+// the others are decompressed into scratch (stored may point into it)
+std::string_view decodeBlock(std::string_view stored, std::string& scratch, CompressionStats* stats) {
+    if (stored.empty()) {
+        throw std::runtime_error("Corrupted SSTable: empty block");
+    }
+    auto type = static_cast<CompressionType>(stored.back());
+    stored.remove_suffix(1);
+    if (type == CompressionType::kNone) {
+        return stored;
+    }
+
+    std::string raw = Compression::decompress(type, stored);
+    if (stats != nullptr) {
+        stats->bytes_decompressed.fetch_add(raw.size(), std::memory_order_relaxed);
+    }
+    scratch = std::move(raw);
+    return scratch;
+}
+
+} // namespace
+
+SSTable::SSTable(const SSTableOptions& options) : options_(options) {}
 
 void SSTable::insert(const std::pair<std::string, std::shared_ptr<GraphNodeMeta>>& entry) {
     // Serialize GraphNodeMeta into a vector of bytes
@@ -18,9 +75,9 @@ void SSTable::insert(const std::pair<std::string, std::shared_ptr<GraphNodeMeta>
 }
 
 std::vector<unsigned char> SSTable::serializeGraphNodeMeta(const GraphNodeMeta& meta) {
-    // Implement serialization logic for GraphNodeMeta here
-    // This is a placeholder for actual serialization logic
-    return std::vector<unsigned char>(); // Return empty vector for now
+    std::string encoded;
+    meta.encodeTo(encoded);
+    return std::vector<unsigned char>(encoded.begin(), encoded.end());
 }
 
 void SSTable::writeToDisk(const std::string& filename) const {
@@ -30,80 +87,587 @@ void SSTable::writeToDisk(const std::string& filename) const {
     }
     serialize(out); // Serialize the SSTable contents to the file
     out.close();
+    if (!out) {
+        throw std::runtime_error("Failed to write SSTable: " + filename);
+    }
 }
 
 std::vector<unsigned char> SSTable::readFromDisk(const std::string& filename, const std::string& key) {
-    std::ifstream in(filename, std::ios::binary);
-    if (!in) {
+    SSTableReader reader(filename);
+    auto value = reader.get(key);
+    if (!value) {
+        throw std::runtime_error("Key not found in SSTable: " + key);
+    }
+    return std::move(*value);
+}
+
+void SSTable::serialize(std::ostream& out) const {
+    SSTableBuilder builder(out, options_);
+    for (const auto& [key, value] : table_) {
+        builder.add(key, std::string_view(reinterpret_cast<const char*>(value.data()), value.size()));
+    }
+    builder.finish();
+}
+
+void SSTable::deserialize(std::istream& in) {
+    std::string contents((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    if (contents.size() < kFooterSize ||
+        Util::decodeFixed64(contents.data() + contents.size() - sizeof(uint64_t)) != kTableMagic) {
+        throw std::runtime_error("Not an SSTable");
+    }
+
+    const char* footer = contents.data() + contents.size() - kFooterSize;
+    uint64_t filter_offset = Util::decodeFixed64(footer);
+    uint64_t index_offset = Util::decodeFixed64(footer + 2 * sizeof(uint64_t));
+    uint64_t index_size = Util::decodeFixed64(footer + 3 * sizeof(uint64_t));
+    if (!BlockHandle{index_offset, index_size}.fitsWithin(contents.size() - kFooterSize) ||
+        filter_offset > index_offset) {
+        throw std::runtime_error("Corrupted SSTable: bad index handle");
+    }
+
+    std::string index_scratch;
+    BlockReader index(decodeBlock(std::string_view(contents).substr(index_offset, index_size), index_scratch, nullptr));
+    std::string block_scratch;
+    for (BlockReader::Iterator it(&index); it.Valid(); it.Next()) {
+        std::string_view encoded = it.value();
+        BlockHandle handle;
+        if (!handle.decodeFrom(encoded) || !handle.fitsWithin(filter_offset)) {
+            throw std::runtime_error("Corrupted SSTable: bad block handle");
+        }
+
+        BlockReader block(decodeBlock(std::string_view(contents).substr(handle.offset, handle.size), block_scratch,
+                                      options_.compression_stats));
+        for (BlockReader::Iterator entry(&block); entry.Valid(); entry.Next()) {
+            table_[std::string(entry.key())].assign(entry.value().begin(), entry.value().end());
+        }
+    }
+}
+
+std::vector<unsigned char> SSTable::get(const std::string& key) const {
+    auto it = table_.find(key);
+    if (it != table_.end()) {
+        return it->second; // Return the associated value
+    }
+    throw std::runtime_error("Key not found in SSTable.");
+}
+
+size_t SSTable::size() const noexcept {
+    return table_.size();
+}
+
+bool SSTable::empty() const noexcept {
+    return table_.empty();
+}
+
+const std::string& SSTable::firstKey() const {
+    return table_.begin()->first;
+}
+
+const std::string& SSTable::lastKey() const {
+    return table_.rbegin()->first;
+}
+
+// every index entry is a restart, a lookup binary searches all of them
+SSTableBuilder::SSTableBuilder(std::ostream& out, const SSTableOptions& options)
+    : out_(out), options_(options), data_block_(options.block_restart_interval), index_block_(1) {}
+
+void SSTableBuilder::add(std::string_view key, std::string_view value) {
+    if (num_entries_++ == 0) {
+        first_key_.assign(key.data(), key.size());
+    }
+    last_key_.assign(key.data(), key.size());
+    if (options_.bloom_bits_per_key > 0) {
+        key_hashes_.push_back(BloomFilter::hash(key));
+    }
+
+    data_block_.add(key, value);
+    if (data_block_.sizeEstimate() >= options_.block_size) {
+        flushBlock();
+    }
+}
+
+void SSTableBuilder::finish() {
+    if (!data_block_.empty()) {
+        flushBlock();
+    }
+
+    std::string filter;
+    if (options_.bloom_bits_per_key > 0) {
+        filter = BloomFilter(options_.bloom_bits_per_key).buildFromHashes(key_hashes_);
+    }
+    const uint64_t filter_offset = offset_;
+    out_.write(filter.data(), filter.size());
+    offset_ += filter.size();
+
+    // the index is read once per open and searched on every lookup, keep it raw
+    std::string index = encodeBlock(index_block_.finish(), CompressionType::kNone, nullptr);
+    out_.write(index.data(), index.size());
+
+    std::string footer;
+    Util::putFixed64(footer, filter_offset);
+    Util::putFixed64(footer, filter.size());
+    Util::putFixed64(footer, offset_);
+    Util::putFixed64(footer, index.size());
+    Util::putFixed64(footer, SSTable::kTableMagic);
+    out_.write(footer.data(), footer.size());
+    offset_ += index.size() + footer.size();
+}
+
+uint64_t SSTableBuilder::numEntries() const noexcept {
+    return num_entries_;
+}
+
+uint64_t SSTableBuilder::fileSize() const noexcept {
+    return offset_ + (data_block_.empty() ? 0 : data_block_.sizeEstimate());
+}
+
+const std::string& SSTableBuilder::firstKey() const noexcept {
+    return first_key_;
+}
+
+const std::string& SSTableBuilder::lastKey() const noexcept {
+    return last_key_;
+}
+
+void SSTableBuilder::flushBlock() {
+    std::string last_key = data_block_.lastKey();
+    std::string block = encodeBlock(data_block_.finish(), options_.compression, options_.compression_stats);
+    out_.write(block.data(), block.size());
+
+    std::string handle;
+    BlockHandle{offset_, block.size()}.encodeTo(handle);
+    index_block_.add(last_key, handle);
+    offset_ += block.size();
+}
+
+SSTableReader::SSTableReader(const std::string& filename, const SSTableOptions& options,
+                             SSTableReadStats* stats)
+    : filename_(filename), stats_(stats), options_(options) {
+    fd_ = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd_ < 0) {
         throw std::runtime_error("Failed to open file for reading: " + filename);
     }
 
-    size_t count;
-    in.read(reinterpret_cast<char*>(&count), sizeof(count)); // Read number of entries
+    try {
+        off_t end = ::lseek(fd_, 0, SEEK_END);
+        if (end < static_cast<off_t>(SSTable::kFooterSize)) {
+            throw std::runtime_error("Not an SSTable: " + filename);
+        }
+        file_size_ = static_cast<uint64_t>(end);
 
-    for (size_t i = 0; i < count; ++i) {
-        size_t key_size;
-        in.read(reinterpret_cast<char*>(&key_size), sizeof(key_size)); // Read key size
+        // the file is immutable, so a read-only shared mapping never changes
+        // under us and lookups read straight out of the page cache
+        if (options.use_mmap) {
+            void* mapping = ::mmap(nullptr, file_size_, PROT_READ, MAP_SHARED, fd_, 0);
+            if (mapping == MAP_FAILED) {
+                throw std::runtime_error("Failed to mmap " + filename + ": " + std::strerror(errno));
+            }
+            mapping_ = static_cast<const char*>(mapping);
+        }
+        adviseAccessPattern(AccessPattern::kRandom);
 
-        std::string current_key(key_size, '\0');
-        in.read(&current_key[0], key_size); // Read key
+        std::string footer_scratch;
+        std::string_view footer = readBlock({file_size_ - SSTable::kFooterSize, SSTable::kFooterSize}, footer_scratch);
+        if (Util::decodeFixed64(footer.data() + 4 * sizeof(uint64_t)) != SSTable::kTableMagic) {
+            throw std::runtime_error("Not an SSTable: " + filename);
+        }
 
-        size_t value_size;
-        in.read(reinterpret_cast<char*>(&value_size), sizeof(value_size)); // Read value size
+        BlockHandle filter_handle{Util::decodeFixed64(footer.data()),
+                                  Util::decodeFixed64(footer.data() + sizeof(uint64_t))};
+        BlockHandle index_handle{Util::decodeFixed64(footer.data() + 2 * sizeof(uint64_t)),
+                                 Util::decodeFixed64(footer.data() + 3 * sizeof(uint64_t))};
+        if (!index_handle.fitsWithin(file_size_ - SSTable::kFooterSize) ||
+            !filter_handle.fitsWithin(index_handle.offset)) {
+            throw std::runtime_error("Corrupted SSTable: bad footer in " + filename);
+        }
 
-        std::vector<unsigned char> value(value_size);
-        in.read(reinterpret_cast<char*>(value.data()), value_size); // Read value
+        index_handle_ = index_handle;
+        filter_handle_ = filter_handle;
+        cache_ = options.block_cache;
+        if (cache_ != nullptr) {
+            // warm the cache, and fail now rather than on the first lookup
+            // if the index is corrupted
+            cache_id_ = cache_->newFileId();
+            BlockCache::Handle pin;
+            std::string scratch;
+            BlockReader index(cachedBlock(index_handle_, BlockKind::kIndex, pin, scratch));
+            return;
+        }
 
-        if (current_key == key) {
-            return value; // Return the value corresponding to the requested key
+        // with a mapping both stay views into it, otherwise we keep the copy
+        std::string index_scratch;
+        std::string_view index = readContents(index_handle, index_scratch);
+        if (mapping_ != nullptr && index.data() != index_scratch.data()) {
+            index_ = std::make_unique<BlockReader>(index);
+        } else {
+            // the contents start at index_scratch, only the trailer goes
+            index_scratch.resize(index.size());
+            index_ = std::make_unique<BlockReader>(std::move(index_scratch));
         }
+        filter_ = readBlock(filter_handle, filter_storage_);
+    } catch (...) {
+        close();
+        throw;
     }
+}
 
-    throw std::runtime_error("Key not found in SSTable: " + key);
+SSTableReader::~SSTableReader() {
+    close();
 }
 
-void SSTable::serialize(std::ostream& out) const {
-    size_t count = table_.size();
-    out.write(reinterpret_cast<const char*>(&count), sizeof(count)); // Write number of entries
+std::optional<std::vector<unsigned char>> SSTableReader::get(const std::string& key) const {
+    std::string scratch;
+    auto value = getView(key, scratch);
+    if (!value) {
+        return std::nullopt;
+    }
+    return std::vector<unsigned char>(value->begin(), value->end());
+}
 
-    for (const auto& [key, value] : table_) {
-        size_t key_size = key.size();
-        out.write(reinterpret_cast<const char*>(&key_size), sizeof(key_size)); // Write key size
-        out.write(key.c_str(), key_size); // Write key
+std::optional<std::string_view> SSTableReader::getView(const std::string& key, std::string& scratch) const {
+    auto handle = dataBlockFor(key);
+    if (!handle) {
+        return std::nullopt;
+    }
+
+    // keys are compared in place, in the cache, the mapping or scratch
+    BlockCache::Handle block_pin;
+    auto value = searchBlock(cachedBlock(*handle, BlockKind::kData, block_pin, scratch), key);
 
-        size_t value_size = value.size();
-        out.write(reinterpret_cast<const char*>(&value_size), sizeof(value_size)); // Write value size
-        out.write(reinterpret_cast<const char*>(value.data()), value_size); // Write value
+    // the cache may drop the block as soon as we let go of it
+    if (value && block_pin) {
+        scratch.assign(value->data(), value->size());
+        return std::string_view(scratch);
     }
+    return value;
 }
 
-void SSTable::deserialize(std::istream& in) {
-    size_t count;
-    in.read(reinterpret_cast<char*>(&count), sizeof(count)); // Read number of entries
+void SSTableReader::multiGet(std::vector<TableLookup>& lookups, IOBackend* io) {
+    // a data block still to be read and the lookups waiting on it
+    struct PendingBlock {
+        const SSTableReader* reader;
+        BlockHandle handle;
+        std::string stored;
+        std::vector<size_t> lookups;
+    };
+    std::vector<PendingBlock> pending;
+    std::map<std::pair<const SSTableReader*, uint64_t>, size_t> by_block;
 
-    for (size_t i = 0; i < count; ++i) {
-        size_t key_size;
-        in.read(reinterpret_cast<char*>(&key_size), sizeof(key_size)); // Read key size
+    // blocks already in memory are searched right away
+    for (size_t i = 0; i < lookups.size(); ++i) {
+        auto& lookup = lookups[i];
+        const SSTableReader* reader = lookup.reader;
+        lookup.value.reset();
+        auto handle = reader->dataBlockFor(lookup.key);
+        if (!handle) {
+            continue;
+        }
 
-        std::string key(key_size, '\0');
-        in.read(&key[0], key_size); // Read key
+        BlockCache::Handle pin;
+        if (reader->cache_ != nullptr) {
+            pin = reader->cache_->lookup(reader->cache_id_, handle->offset);
+        }
+        if (!pin && reader->mapping_ == nullptr && io != nullptr) {
+            auto inserted = by_block.emplace(std::make_pair(reader, handle->offset), pending.size());
+            if (inserted.second) {
+                pending.push_back({reader, *handle, std::string(), {}});
+            }
+            pending[inserted.first->second].lookups.push_back(i);
+            continue;
+        }
 
-        size_t value_size;
-        in.read(reinterpret_cast<char*>(&value_size), sizeof(value_size)); // Read value size
+        std::string scratch;
+        std::string_view contents = pin ? std::string_view(*pin)
+                                        : reader->cachedBlock(*handle, BlockKind::kData, pin, scratch);
+        if (auto value = reader->searchBlock(contents, lookup.key)) {
+            lookup.value.emplace(value->data(), value->size());
+        }
+    }
+    if (pending.empty()) {
+        return;
+    }
+
+    std::vector<ReadRequest> requests;
+    requests.reserve(pending.size());
+    for (auto& block : pending) {
+        if (!block.handle.fitsWithin(block.reader->file_size_)) {
+            throw std::runtime_error("Corrupted SSTable: block past end of " + block.reader->filename_);
+        }
+        requests.push_back({block.reader->fd_, block.handle.offset, block.handle.size, &block.stored});
+    }
+    io->readBatch(requests);
 
-        std::vector<unsigned char> value(value_size);
-        in.read(reinterpret_cast<char*>(value.data()), value_size); // Read value
+    for (size_t k = 0; k < pending.size(); ++k) {
+        auto& block = pending[k];
+        const SSTableReader* reader = block.reader;
+        if (requests[k].error != 0) {
+            throw std::runtime_error("Failed to read " + reader->filename_ + ": " + std::strerror(requests[k].error));
+        }
+        if (reader->stats_ != nullptr) {
+            reader->stats_->block_reads.fetch_add(1, std::memory_order_relaxed);
+        }
 
-        table_[key] = std::move(value); // Store the key-value pair
+        std::string_view contents = decodeBlock(block.stored, block.stored, reader->options_.compression_stats);
+        BlockCache::Handle pin;
+        if (reader->cache_ != nullptr) {
+            // the contents start at block.stored unless they were decompressed
+            block.stored.resize(contents.size());
+            pin = reader->cache_->insert(reader->cache_id_, block.handle.offset, std::move(block.stored),
+                                         BlockCache::Priority::kLow);
+            contents = *pin;
+        }
+        for (size_t i : block.lookups) {
+            if (auto value = reader->searchBlock(contents, lookups[i].key)) {
+                lookups[i].value.emplace(value->data(), value->size());
+            }
+        }
     }
 }
 
-std::vector<unsigned char> SSTable::get(const std::string& key) const {
-    auto it = table_.find(key);
-    if (it != table_.end()) {
-        return it->second; // Return the associated value
+std::optional<BlockHandle> SSTableReader::dataBlockFor(const std::string& key) const {
+    if (!mayContain(key)) {
+        return std::nullopt;
+    }
+
+    const BlockReader* index = index_.get();
+    BlockCache::Handle index_pin;
+    std::string index_scratch;
+    std::optional<BlockReader> cached_index;
+    if (cache_ != nullptr) {
+        cached_index.emplace(cachedBlock(index_handle_, BlockKind::kIndex, index_pin, index_scratch));
+        index = &*cached_index;
+    }
+
+    // the first block whose last key is >= key is the only one that can hold it
+    BlockReader::Iterator index_it(index);
+    index_it.Seek(key);
+    if (!index_it.Valid()) {
+        // past the last key, the filter let it through all the same
+        if (stats_ != nullptr && filter_handle_.size > 0) {
+            stats_->filter_false_positives.fetch_add(1, std::memory_order_relaxed);
+        }
+        return std::nullopt;
+    }
+
+    std::string_view encoded = index_it.value();
+    BlockHandle handle;
+    if (!handle.decodeFrom(encoded)) {
+        throw std::runtime_error("Corrupted SSTable: bad block handle in " + filename_);
+    }
+    return handle;
+}
+
+std::optional<std::string_view> SSTableReader::searchBlock(std::string_view contents, const std::string& key) const {
+    BlockReader block(contents);
+    std::string_view value;
+    if (!block.get(key, value)) {
+        if (stats_ != nullptr && filter_handle_.size > 0) {
+            stats_->filter_false_positives.fetch_add(1, std::memory_order_relaxed);
+        }
+        return std::nullopt;
+    }
+    return value;
+}
+
+bool SSTableReader::mayContain(const std::string& key) const {
+    std::string_view filter = filter_;
+    BlockCache::Handle pin;
+    std::string scratch;
+    if (cache_ != nullptr && filter_handle_.size > 0) {
+        filter = cachedBlock(filter_handle_, BlockKind::kFilter, pin, scratch);
+    }
+    if (filter.empty()) {
+        return true;
+    }
+
+    bool may_contain = BloomFilter::mayContain(filter, key);
+    if (stats_ != nullptr) {
+        stats_->filter_checks.fetch_add(1, std::memory_order_relaxed);
+        if (!may_contain) {
+            stats_->filter_skips.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    return may_contain;
+}
+
+void SSTableReader::adviseAccessPattern(AccessPattern pattern) const {
+    // only hints, a kernel that ignores them costs us nothing
+    if (mapping_ != nullptr) {
+        ::madvise(const_cast<char*>(mapping_), file_size_,
+                  pattern == AccessPattern::kRandom ? MADV_RANDOM : MADV_SEQUENTIAL);
+    } else {
+        ::posix_fadvise(fd_, 0, 0,
+                        pattern == AccessPattern::kRandom ? POSIX_FADV_RANDOM : POSIX_FADV_SEQUENTIAL);
+    }
+}
+
+bool SSTableReader::isMapped() const noexcept {
+    return mapping_ != nullptr;
+}
+
+const std::string& SSTableReader::filename() const noexcept {
+    return filename_;
+}
+
+uint64_t SSTableReader::fileSize() const noexcept {
+    return file_size_;
+}
+
+std::vector<std::pair<std::string, uint64_t>> SSTableReader::blockAnchors() const {
+    const BlockReader* index = index_.get();
+    BlockCache::Handle index_pin;
+    std::string index_scratch;
+    std::optional<BlockReader> cached_index;
+    if (cache_ != nullptr) {
+        cached_index.emplace(cachedBlock(index_handle_, BlockKind::kIndex, index_pin, index_scratch));
+        index = &*cached_index;
+    }
+
+    std::vector<std::pair<std::string, uint64_t>> anchors;
+    BlockReader::Iterator it(index);
+    for (it.SeekToFirst(); it.Valid(); it.Next()) {
+        std::string_view encoded = it.value();
+        BlockHandle handle;
+        if (!handle.decodeFrom(encoded)) {
+            throw std::runtime_error("Corrupted SSTable: bad block handle in " + filename_);
+        }
+        anchors.emplace_back(std::string(it.key()), handle.size);
+    }
+    return anchors;
+}
+
+SSTableReader::Iterator::Iterator(const SSTableReader* reader) : reader_(reader) {
+    const BlockReader* index = reader_->index_.get();
+    if (reader_->cache_ != nullptr) {
+        cached_index_ = std::make_unique<BlockReader>(
+            reader_->cachedBlock(reader_->index_handle_, BlockKind::kIndex, index_pin_, index_scratch_));
+        index = cached_index_.get();
+    }
+    index_it_ = std::make_unique<BlockReader::Iterator>(index);
+}
+
+bool SSTableReader::Iterator::Valid() const {
+    return block_it_ != nullptr && block_it_->Valid();
+}
+
+std::string_view SSTableReader::Iterator::key() const {
+    return block_it_->key();
+}
+
+std::string_view SSTableReader::Iterator::value() const {
+    return block_it_->value();
+}
+
+void SSTableReader::Iterator::Next() {
+    block_it_->Next();
+    if (!block_it_->Valid()) {
+        index_it_->Next();
+        loadBlock();
+    }
+}
+
+void SSTableReader::Iterator::Seek(std::string_view target) {
+    // the first block whose last key is >= target
+    index_it_->Seek(target);
+    loadBlock();
+    if (block_it_ != nullptr) {
+        block_it_->Seek(target);
+    }
+}
+
+void SSTableReader::Iterator::SeekToFirst() {
+    index_it_->SeekToFirst();
+    loadBlock();
+}
+
+void SSTableReader::Iterator::loadBlock() {
+    block_it_.reset();
+    block_.reset();
+    for (; index_it_->Valid(); index_it_->Next()) {
+        std::string_view encoded = index_it_->value();
+        BlockHandle handle;
+        if (!handle.decodeFrom(encoded)) {
+            throw std::runtime_error("Corrupted SSTable: bad block handle in " + reader_->filename_);
+        }
+
+        block_ = std::make_unique<BlockReader>(reader_->readContents(handle, block_scratch_));
+        block_it_ = std::make_unique<BlockReader::Iterator>(block_.get());
+        block_it_->SeekToFirst();
+        if (block_it_->Valid()) {
+            return;
+        }
+    }
+    block_it_.reset();
+    block_.reset();
+}
+
+std::string_view SSTableReader::readBlock(const BlockHandle& handle, std::string& scratch) const {
+    if (!handle.fitsWithin(file_size_)) {
+        throw std::runtime_error("Corrupted SSTable: block past end of " + filename_);
+    }
+
+    if (mapping_ != nullptr) {
+        return std::string_view(mapping_ + handle.offset, handle.size);
+    }
+
+    // pread keeps no file position, concurrent readers don't interfere
+    scratch.resize(handle.size);
+    size_t done = 0;
+    while (done < handle.size) {
+        ssize_t n = ::pread(fd_, &scratch[done], handle.size - done, handle.offset + done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            throw std::runtime_error("Failed to read " + filename_ + ": " + std::strerror(errno));
+        }
+        if (n == 0) {
+            throw std::runtime_error("Unexpected end of file: " + filename_);
+        }
+        done += static_cast<size_t>(n);
+    }
+    return scratch;
+}
+
+std::string_view SSTableReader::readContents(const BlockHandle& handle, std::string& scratch) const {
+    return decodeBlock(readBlock(handle, scratch), scratch, options_.compression_stats);
+}
+
+std::string_view SSTableReader::cachedBlock(const BlockHandle& handle, BlockKind kind, BlockCache::Handle& pin,
+                                           std::string& scratch) const {
+    if (cache_ != nullptr) {
+        pin = cache_->lookup(cache_id_, handle.offset);
+        if (pin) {
+            return *pin;
+        }
+    }
+
+    if (kind == BlockKind::kData && stats_ != nullptr) {
+        stats_->block_reads.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // the filter is stored without a codec trailer
+    std::string_view contents = kind == BlockKind::kFilter ? readBlock(handle, scratch) : readContents(handle, scratch);
+
+    // a view into the mapping costs nothing to read again
+    if (cache_ == nullptr || contents.data() != scratch.data()) {
+        return contents;
+    }
+    scratch.resize(contents.size());
+    pin = cache_->insert(cache_id_, handle.offset, std::move(scratch),
+                         kind == BlockKind::kData ? BlockCache::Priority::kLow : BlockCache::Priority::kHigh);
+    return *pin;
+}
+
+void SSTableReader::close() noexcept {
+    if (mapping_ != nullptr) {
+        ::munmap(const_cast<char*>(mapping_), file_size_);
+        mapping_ = nullptr;
+    }
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
     }
-    throw std::runtime_error("Key not found in SSTable.");
 }
 
 } // namespace storage_engine
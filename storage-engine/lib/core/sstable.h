@@ -3,44 +3,294 @@
 #ifndef CORE_SSTABLE_H
 #define CORE_SSTABLE_H
 
+#include <atomic>
 #include <map>
 #include <vector>
 #include <string>
 #include <memory>
+#include <optional>
 #include <stdexcept>
 #include <fstream>
+#include "core/block.h"
+#include "core/block_cache.h"
+#include "core/compression.h"
 #include "core/graph_node.h"
+#include "core/io_backend.h"
 
 namespace storage_engine {
 
+// How SSTables are written and read
+struct SSTableOptions {
+    // data blocks are cut once they reach this many bytes
+    size_t block_size = 4096;
+
+    // full keys are written every this many entries, the rest share a
+    // prefix with the key before them (node ids share class prefixes)
+    int block_restart_interval = 16;
+
+    // bloom filter bits per key, 0 writes no filter
+    int bloom_bits_per_key = 10;
+
+    // readers map the whole file instead of pread-ing each block
+    bool use_mmap = false;
+
+    // codec of the data blocks. a block that doesn't shrink by at least
+    // 1/8 is stored raw, decompressing it would cost more than it saves
+    CompressionType compression = CompressionType::kLZ;
+
+    // codec of tables written by compaction into the bottom level, which
+    // holds most of the data and is rewritten least often
+    CompressionType bottommost_compression = CompressionType::kZlib;
+
+    // bytes in/out of the codecs, optional
+    CompressionStats* compression_stats = nullptr;
+
+    // readers keep uncompressed blocks here instead of re-reading them,
+    // index and filter blocks with high priority. optional
+    BlockCache* block_cache = nullptr;
+
+    // lookups of many keys read their data blocks through it in one batch,
+    // without one they read them one at a time. optional
+    IOBackend* io_backend = nullptr;
+};
+
+// Counters shared by the readers of all SSTables
+struct SSTableReadStats {
+    std::atomic<uint64_t> filter_checks{0};          // lookups that consulted a filter
+    std::atomic<uint64_t> filter_skips{0};           // ... and skipped the table
+    std::atomic<uint64_t> filter_false_positives{0}; // passed the filter, key absent
+    std::atomic<uint64_t> block_reads{0};            // data blocks read
+};
+
+// On-disk layout of an SSTable:
+//
+//   [data block 0] ... [data block n-1]
+//   [filter block]  bloom filter over every key (may be empty)
+//   [index block]   one entry per data block: its last key -> BlockHandle
+//   [footer]        fixed kFooterSize bytes at the end of the file
+//
+// Data blocks are cut once they reach the target block size, so a point
+// lookup reads the footer, filter and index once and then at most one
+// data block.
+//
+// Data and index blocks end in a one byte trailer holding the
+// CompressionType of the bytes before it; handles cover the trailer too.
+// The filter block is never compressed.
 class SSTable {
 private:
     std::map<std::string, std::vector<unsigned char>> table_; // Key-value store (node_id -> serialized data)
+    SSTableOptions options_;
 
 public:
-    SSTable() = default;
+    // footer: [fixed64 filter offset][fixed64 filter size]
+    //         [fixed64 index offset][fixed64 index size][fixed64 magic]
+    static constexpr size_t kFooterSize = 5 * sizeof(uint64_t);
+    static constexpr uint64_t kTableMagic = 0x53535442474e4553ull;
+
+    explicit SSTable(const SSTableOptions& options = SSTableOptions());
     ~SSTable() = default;
 
     // Insert a new entry into the SSTable
     void insert(const std::pair<std::string, std::shared_ptr<GraphNodeMeta>>& entry);
 
-    // Serialize GraphNodeMeta to bytes (placeholder implementation)
+    // Serialize GraphNodeMeta to bytes, see GraphNodeMeta::encodeTo()
     std::vector<unsigned char> serializeGraphNodeMeta(const GraphNodeMeta& meta);
 
     // Write the SSTable to disk
     void writeToDisk(const std::string& filename) const;
 
     // Read an object from the SSTable using its key
+    // throws std::runtime_error if the file doesn't hold the key
     std::vector<unsigned char> readFromDisk(const std::string& filename, const std::string& key);
 
     // Serialize the SSTable to an output stream
     void serialize(std::ostream& out) const;
 
     // Deserialize from an input stream (for loading SSTables)
+    // throws std::runtime_error if the stream is not a valid SSTable
     void deserialize(std::istream& in);
 
     // Optional: Get a value by key
     std::vector<unsigned char> get(const std::string& key) const;
+
+    size_t size() const noexcept;
+    bool empty() const noexcept;
+    // smallest and largest key, the table must not be empty
+    const std::string& firstKey() const;
+    const std::string& lastKey() const;
+};
+
+// Writes an SSTable entry by entry, in key order, straight to a stream.
+// Only the data block being filled, the index and a 4 byte hash per key
+// (for the filter) are held in memory, whatever the size of the table.
+class SSTableBuilder {
+public:
+    // blocks are written to out as they fill up, out must outlive the builder
+    explicit SSTableBuilder(std::ostream& out, const SSTableOptions& options = SSTableOptions());
+
+    SSTableBuilder(const SSTableBuilder&) = delete;
+    SSTableBuilder& operator=(const SSTableBuilder&) = delete;
+
+    // keys must be added in strictly increasing order
+    void add(std::string_view key, std::string_view value);
+
+    // Write the last data block, the filter, the index and the footer.
+    // the stream reports any write error
+    void finish();
+
+    uint64_t numEntries() const noexcept;
+    // bytes written so far, plus the data block being filled
+    uint64_t fileSize() const noexcept;
+    // smallest and largest key added
+    const std::string& firstKey() const noexcept;
+    const std::string& lastKey() const noexcept;
+
+private:
+    std::ostream& out_;
+    SSTableOptions options_;
+    BlockBuilder data_block_;
+    BlockBuilder index_block_;
+    std::vector<uint32_t> key_hashes_;
+    uint64_t offset_ = 0;
+    uint64_t num_entries_ = 0;
+    std::string first_key_;
+    std::string last_key_;
+
+    void flushBlock();
+};
+
+// Point lookups on one SSTable file. The footer, filter and index block
+// are read once when the file is opened and kept in memory; a lookup then
+// costs at most a single data block read. Safe to share between threads.
+//
+// With use_mmap the file is mapped read-only instead: blocks are parsed in
+// place, the index and filter are views into the mapping and getView()
+// returns values without copying them.
+//
+// With a block cache the index and filter aren't held by the reader, they
+// go through the cache like the data blocks do (at high priority). Blocks
+// that are views into a mapping are not cached, only the ones read with
+// pread or decompressed.
+class SSTableReader;
+
+// One key to look up in one table, see SSTableReader::multiGet()
+struct TableLookup {
+    const SSTableReader* reader = nullptr;
+    std::string key;
+    std::optional<std::string> value;  // set when the table holds key
+};
+
+class SSTableReader {
+public:
+    enum class AccessPattern { kRandom, kSequential };
+
+    // throws std::runtime_error if the file can't be opened or is not an SSTable
+    explicit SSTableReader(const std::string& filename, const SSTableOptions& options = SSTableOptions(),
+                           SSTableReadStats* stats = nullptr);
+    ~SSTableReader();
+
+    SSTableReader(const SSTableReader&) = delete;
+    SSTableReader& operator=(const SSTableReader&) = delete;
+
+    // Serialized value stored under key, std::nullopt if the table doesn't have it
+    // throws std::runtime_error on a read error or a corrupted block
+    std::optional<std::vector<unsigned char>> get(const std::string& key) const;
+
+    // Same as get() without the copy: the view points into the mapping, or
+    // into `scratch` when the file isn't mapped. valid while both live
+    std::optional<std::string_view> getView(const std::string& key, std::string& scratch) const;
+
+    // get() of many keys across any tables. data blocks that are neither
+    // cached nor mapped are read with one batch on io, all in flight at
+    // once, and each block is read once however many keys it holds. a null
+    // io reads them one after the other
+    // throws std::runtime_error on a read error or a corrupted block
+    static void multiGet(std::vector<TableLookup>& lookups, IOBackend* io);
+
+    // Tell the kernel how the file is about to be read (madvise/fadvise).
+    // readers start out random, full scans should switch to sequential
+    void adviseAccessPattern(AccessPattern pattern) const;
+
+    bool isMapped() const noexcept;
+
+    // false if the table definitely doesn't hold key, no disk access
+    bool mayContain(const std::string& key) const;
+
+    const std::string& filename() const noexcept;
+    uint64_t fileSize() const noexcept;
+
+    // Last key and size of every data block, in key order: points that cut
+    // the table into pieces of known size
+    // throws std::runtime_error on a corrupted index
+    std::vector<std::pair<std::string, uint64_t>> blockAnchors() const;
+
+    // Scan of the table in key order, one data block in memory at a time.
+    // blocks are read past the block cache so a scan doesn't flush it.
+    // the reader must outlive the iterator
+    // throws std::runtime_error on a read error or a corrupted block
+    class Iterator {
+    public:
+        explicit Iterator(const SSTableReader* reader);
+
+        bool Valid() const;
+        // valid until the iterator moves
+        std::string_view key() const;
+        std::string_view value() const;
+
+        void Next();
+        void Seek(std::string_view target);
+        void SeekToFirst();
+
+    private:
+        const SSTableReader* reader_;
+        BlockCache::Handle index_pin_;
+        std::string index_scratch_;
+        std::unique_ptr<BlockReader> cached_index_;
+        std::unique_ptr<BlockReader::Iterator> index_it_;
+        std::string block_scratch_;
+        std::unique_ptr<BlockReader> block_;
+        std::unique_ptr<BlockReader::Iterator> block_it_;
+
+        // open the block under index_it_, skipping to later blocks while empty
+        void loadBlock();
+    };
+
+private:
+    std::string filename_;
+    int fd_ = -1;
+    uint64_t file_size_ = 0;
+    const char* mapping_ = nullptr;
+    std::unique_ptr<BlockReader> index_;
+    std::string filter_storage_;
+    std::string_view filter_;
+    SSTableReadStats* stats_ = nullptr;
+    SSTableOptions options_;
+    BlockCache* cache_ = nullptr;
+    uint64_t cache_id_ = 0;
+    BlockHandle index_handle_;
+    BlockHandle filter_handle_;
+
+    enum class BlockKind { kData, kIndex, kFilter };
+
+    // bytes of the block, in the mapping or read into scratch
+    std::string_view readBlock(const BlockHandle& handle, std::string& scratch) const;
+
+    // readBlock() without the trailer, decompressed into scratch if needed
+    std::string_view readContents(const BlockHandle& handle, std::string& scratch) const;
+
+    // contents of a block through the block cache. the view points into
+    // `pin` on a cached block, otherwise into the mapping or scratch
+    std::string_view cachedBlock(const BlockHandle& handle, BlockKind kind, BlockCache::Handle& pin,
+                                 std::string& scratch) const;
+
+    // the data block that may hold key, std::nullopt if the filter or the
+    // index rule it out
+    std::optional<BlockHandle> dataBlockFor(const std::string& key) const;
+
+    // value of key in a data block, a view into contents
+    std::optional<std::string_view> searchBlock(std::string_view contents, const std::string& key) const;
+
+    void close() noexcept;
 };
 
 } // namespace storage_engine
@@ -3,10 +3,100 @@
 // Utility functions for the storage engine.
 
 #include "core/utils.h"
+#include <boost/crc.hpp>
 
 namespace storage_engine {
 
-// Utility class implementation can be added here as needed
-Util::Util() = default;
+void Util::putFixed32(std::string& dst, uint32_t value) {
+    char buf[sizeof(value)];
+    for (size_t i = 0; i < sizeof(value); ++i) {
+        buf[i] = static_cast<char>((value >> (8 * i)) & 0xff);
+    }
+    dst.append(buf, sizeof(buf));
+}
+
+void Util::putFixed64(std::string& dst, uint64_t value) {
+    char buf[sizeof(value)];
+    for (size_t i = 0; i < sizeof(value); ++i) {
+        buf[i] = static_cast<char>((value >> (8 * i)) & 0xff);
+    }
+    dst.append(buf, sizeof(buf));
+}
+
+uint32_t Util::decodeFixed32(const char* ptr) {
+    uint32_t value = 0;
+    for (size_t i = 0; i < sizeof(value); ++i) {
+        value |= static_cast<uint32_t>(static_cast<unsigned char>(ptr[i])) << (8 * i);
+    }
+    return value;
+}
+
+uint64_t Util::decodeFixed64(const char* ptr) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < sizeof(value); ++i) {
+        value |= static_cast<uint64_t>(static_cast<unsigned char>(ptr[i])) << (8 * i);
+    }
+    return value;
+}
+
+void Util::putVarint32(std::string& dst, uint32_t value) {
+    putVarint64(dst, value);
+}
+
+void Util::putVarint64(std::string& dst, uint64_t value) {
+    while (value >= 0x80) {
+        dst.push_back(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    dst.push_back(static_cast<char>(value));
+}
+
+void Util::putLengthPrefixed(std::string& dst, std::string_view value) {
+    putVarint32(dst, static_cast<uint32_t>(value.size()));
+    dst.append(value.data(), value.size());
+}
+
+bool Util::getVarint32(std::string_view& input, uint32_t& value) {
+    uint64_t wide = 0;
+    std::string_view rest = input;
+    if (!getVarint64(rest, wide) || wide > UINT32_MAX) {
+        return false;
+    }
+    value = static_cast<uint32_t>(wide);
+    input = rest;
+    return true;
+}
+
+bool Util::getVarint64(std::string_view& input, uint64_t& value) {
+    uint64_t result = 0;
+    for (size_t i = 0, shift = 0; i < input.size() && shift <= 63; ++i, shift += 7) {
+        uint64_t byte = static_cast<unsigned char>(input[i]);
+        result |= (byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            value = result;
+            input.remove_prefix(i + 1);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Util::getLengthPrefixed(std::string_view& input, std::string_view& value) {
+    uint32_t len = 0;
+    std::string_view rest = input;
+    if (!getVarint32(rest, len) || rest.size() < len) {
+        return false;
+    }
+    value = rest.substr(0, len);
+    rest.remove_prefix(len);
+    input = rest;
+    return true;
+}
+
+uint32_t Util::crc32(std::string_view data) {
+    boost::crc_32_type crc;
+    crc.process_bytes(data.data(), data.size());
+    return crc.checksum();
+}
 
 } // namespace storage_engine
@@ -3,6 +3,10 @@
 #ifndef CORE_UTILS_H
 #define CORE_UTILS_H
 
+#include <cstdint>
+#include <string>
+#include <string_view>
+
 namespace storage_engine {
 
 class Util {
@@ -11,6 +15,28 @@ public:
     ~Util() = default;
 
     // Add utility functions here as needed
+
+    // Binary encoding of on-disk structures. Fixed-width integers are
+    // little-endian, varints use 7 bits per byte (LEB128).
+    static void putFixed32(std::string& dst, uint32_t value);
+    static void putFixed64(std::string& dst, uint64_t value);
+    static uint32_t decodeFixed32(const char* ptr);
+    static uint64_t decodeFixed64(const char* ptr);
+
+    static void putVarint32(std::string& dst, uint32_t value);
+    static void putVarint64(std::string& dst, uint64_t value);
+
+    // Varint prefixed byte string
+    static void putLengthPrefixed(std::string& dst, std::string_view value);
+
+    // Decode from the front of `input` and advance past it, false if the
+    // input is truncated or malformed
+    static bool getVarint32(std::string_view& input, uint32_t& value);
+    static bool getVarint64(std::string_view& input, uint64_t& value);
+    static bool getLengthPrefixed(std::string_view& input, std::string_view& value);
+
+    // CRC-32 (IEEE) checksum of on-disk records
+    static uint32_t crc32(std::string_view data);
 };
 
 } // namespace storage_engine
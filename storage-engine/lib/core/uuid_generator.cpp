@@ -6,12 +6,14 @@
 #include <boost/lexical_cast.hpp>
 #include <boost/uuid/uuid.hpp>
 #include <boost/uuid/random_generator.hpp>
+#include <boost/uuid/uuid_io.hpp>  // operator<< for lexical_cast
 
 namespace storage_engine {
 
 std::string UUIDGenerator::generateUUID() noexcept {
-    // Create a UUID generator
-    boost::uuids::random_generator uuid_generator;
+    // One generator per thread: seeding a new one on every call is slow
+    // and the generator itself is not thread safe
+    thread_local boost::uuids::random_generator uuid_generator;
 
     // Generate a UUID
     boost::uuids::uuid uuid = uuid_generator();
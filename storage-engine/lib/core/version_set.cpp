@@ -0,0 +1,473 @@
+// version_set.cpp
+//
+// Implementation of VersionSet (live SSTables and their manifest) for the storage engine.
+
+#include "core/version_set.h"
+#include "core/utils.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+
+namespace storage_engine {
+
+namespace {
+
+enum EditTag : uint32_t {
+    kNextFileNumber = 1,
+    kLastSequence = 2,
+    kDeletedFile = 3,
+    kNewFile = 4,
+    kLogCheckpoint = 5,
+};
+
+constexpr size_t kRecordHeaderSize = 2 * sizeof(uint32_t);
+
+void writeAll(int fd, std::string_view data, const std::string& path) {
+    while (!data.empty()) {
+        ssize_t n = ::write(fd, data.data(), data.size());
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            throw std::runtime_error("Failed to write " + path + ": " + std::strerror(errno));
+        }
+        data.remove_prefix(static_cast<size_t>(n));
+    }
+}
+
+// a rename is only durable once the directory entry is
+void syncDirectory(const std::string& directory) {
+    int fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd >= 0) {
+        ::fsync(fd);
+        ::close(fd);
+    }
+}
+
+} // namespace
+
+void VersionEdit::addFile(int level, const FileMetaData& file) {
+    new_files_.emplace_back(level, file);
+}
+
+void VersionEdit::deleteFile(int level, uint64_t number) {
+    deleted_files_.emplace_back(level, number);
+}
+
+void VersionEdit::setNextFileNumber(uint64_t number) {
+    next_file_number_ = number;
+}
+
+void VersionEdit::setLastSequence(uint64_t sequence) {
+    last_sequence_ = sequence;
+}
+
+void VersionEdit::setLogCheckpoint(uint64_t position) {
+    log_checkpoint_ = position;
+}
+
+bool VersionEdit::empty() const {
+    return new_files_.empty() && deleted_files_.empty();
+}
+
+void VersionEdit::encodeTo(std::string& dst) const {
+    if (next_file_number_) {
+        Util::putVarint32(dst, kNextFileNumber);
+        Util::putVarint64(dst, *next_file_number_);
+    }
+    if (last_sequence_) {
+        Util::putVarint32(dst, kLastSequence);
+        Util::putVarint64(dst, *last_sequence_);
+    }
+    if (log_checkpoint_) {
+        Util::putVarint32(dst, kLogCheckpoint);
+        Util::putVarint64(dst, *log_checkpoint_);
+    }
+    for (const auto& [level, number] : deleted_files_) {
+        Util::putVarint32(dst, kDeletedFile);
+        Util::putVarint32(dst, static_cast<uint32_t>(level));
+        Util::putVarint64(dst, number);
+    }
+    for (const auto& [level, file] : new_files_) {
+        Util::putVarint32(dst, kNewFile);
+        Util::putVarint32(dst, static_cast<uint32_t>(level));
+        Util::putVarint64(dst, file.number);
+        Util::putLengthPrefixed(dst, file.path);
+        Util::putVarint64(dst, file.file_size);
+        Util::putVarint64(dst, file.num_entries);
+        Util::putLengthPrefixed(dst, file.smallest);
+        Util::putLengthPrefixed(dst, file.largest);
+        Util::putVarint64(dst, file.smallest_sequence);
+        Util::putVarint64(dst, file.largest_sequence);
+    }
+}
+
+bool VersionEdit::decodeFrom(std::string_view input) {
+    *this = VersionEdit();
+    while (!input.empty()) {
+        uint32_t tag = 0;
+        uint32_t level = 0;
+        uint64_t value = 0;
+        if (!Util::getVarint32(input, tag)) {
+            return false;
+        }
+
+        switch (tag) {
+            case kNextFileNumber:
+                if (!Util::getVarint64(input, value)) {
+                    return false;
+                }
+                next_file_number_ = value;
+                break;
+            case kLastSequence:
+                if (!Util::getVarint64(input, value)) {
+                    return false;
+                }
+                last_sequence_ = value;
+                break;
+            case kLogCheckpoint:
+                if (!Util::getVarint64(input, value)) {
+                    return false;
+                }
+                log_checkpoint_ = value;
+                break;
+            case kDeletedFile:
+                if (!Util::getVarint32(input, level) || !Util::getVarint64(input, value)) {
+                    return false;
+                }
+                deleted_files_.emplace_back(static_cast<int>(level), value);
+                break;
+            case kNewFile: {
+                FileMetaData file;
+                std::string_view path;
+                std::string_view smallest;
+                std::string_view largest;
+                if (!Util::getVarint32(input, level) || !Util::getVarint64(input, file.number) ||
+                    !Util::getLengthPrefixed(input, path) || !Util::getVarint64(input, file.file_size) ||
+                    !Util::getVarint64(input, file.num_entries) || !Util::getLengthPrefixed(input, smallest) ||
+                    !Util::getLengthPrefixed(input, largest) || !Util::getVarint64(input, file.smallest_sequence) ||
+                    !Util::getVarint64(input, file.largest_sequence)) {
+                    return false;
+                }
+                file.path = std::string(path);
+                file.smallest = std::string(smallest);
+                file.largest = std::string(largest);
+                new_files_.emplace_back(static_cast<int>(level), std::move(file));
+                break;
+            }
+            default:
+                return false;
+        }
+    }
+    return true;
+}
+
+Version::Version(int num_levels) : levels_(num_levels) {}
+
+int Version::numLevels() const noexcept {
+    return static_cast<int>(levels_.size());
+}
+
+const Version::FileList& Version::files(int level) const {
+    return levels_.at(level);
+}
+
+uint64_t Version::levelBytes(int level) const {
+    uint64_t bytes = 0;
+    for (const auto& file : levels_.at(level)) {
+        bytes += file->file_size;
+    }
+    return bytes;
+}
+
+size_t Version::numFiles() const noexcept {
+    size_t count = 0;
+    for (const auto& level : levels_) {
+        count += level.size();
+    }
+    return count;
+}
+
+Version::FileList Version::filesForKey(std::string_view key) const {
+    FileList result;
+    for (const auto& file : levels_[0]) {
+        if (key >= file->smallest && key <= file->largest) {
+            result.push_back(file);
+        }
+    }
+
+    // deeper levels are disjoint, at most one file each can hold the key
+    for (size_t level = 1; level < levels_.size(); ++level) {
+        const auto& files = levels_[level];
+        auto it = std::lower_bound(files.begin(), files.end(), key,
+                                   [](const auto& file, std::string_view k) { return file->largest < k; });
+        if (it != files.end() && key >= (*it)->smallest) {
+            result.push_back(*it);
+        }
+    }
+    return result;
+}
+
+Version::FileList Version::overlappingFiles(int level, std::string_view smallest, std::string_view largest) const {
+    FileList result;
+    for (const auto& file : levels_.at(level)) {
+        if (file->largest >= smallest && file->smallest <= largest) {
+            result.push_back(file);
+        }
+    }
+    return result;
+}
+
+VersionSet::VersionSet(const std::string& directory, int num_levels, uint64_t max_manifest_size)
+    : directory_(directory), num_levels_(std::max(2, num_levels)), max_manifest_size_(max_manifest_size),
+      current_(std::make_shared<Version>(num_levels_)) {}
+
+VersionSet::~VersionSet() {
+    if (manifest_fd_ >= 0) {
+        ::close(manifest_fd_);
+    }
+}
+
+bool VersionSet::recover() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (directory_.empty()) {
+        return false;
+    }
+    std::filesystem::create_directories(directory_);
+
+    std::string old_manifest;
+    std::ifstream current(currentPath());
+    if (current) {
+        std::getline(current, old_manifest);
+        old_manifest = (std::filesystem::path(directory_) / old_manifest).string();
+
+        std::ifstream in(old_manifest, std::ios::binary);
+        if (!in) {
+            throw std::runtime_error("CURRENT names a missing manifest: " + old_manifest);
+        }
+        std::string contents((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+        auto version = std::make_shared<Version>(num_levels_);
+        std::string_view input(contents);
+        while (input.size() >= kRecordHeaderSize) {
+            uint32_t length = Util::decodeFixed32(input.data());
+            uint32_t crc = Util::decodeFixed32(input.data() + sizeof(uint32_t));
+            // a torn tail is the edit that was being written when we crashed,
+            // it was never applied
+            if (input.size() - kRecordHeaderSize < length) {
+                break;
+            }
+            std::string_view record = input.substr(kRecordHeaderSize, length);
+            input.remove_prefix(kRecordHeaderSize + length);
+
+            VersionEdit edit;
+            if (Util::crc32(record) != crc || !edit.decodeFrom(record)) {
+                throw std::runtime_error("Corrupted manifest: " + old_manifest);
+            }
+            version = apply(*version, edit);
+            if (edit.next_file_number_) {
+                next_file_number_ = std::max<uint64_t>(next_file_number_, *edit.next_file_number_);
+            }
+            if (edit.last_sequence_) {
+                last_sequence_ = std::max<uint64_t>(last_sequence_, *edit.last_sequence_);
+            }
+            if (edit.log_checkpoint_) {
+                log_checkpoint_ = std::max<uint64_t>(log_checkpoint_, *edit.log_checkpoint_);
+            }
+        }
+
+        for (int level = 0; level < num_levels_; ++level) {
+            for (const auto& file : version->files(level)) {
+                next_file_number_ = std::max<uint64_t>(next_file_number_, file->number + 1);
+                last_sequence_ = std::max<uint64_t>(last_sequence_, file->largest_sequence);
+            }
+        }
+        current_ = version;
+    }
+
+    manifest_path_ = old_manifest;
+    startManifest();
+    return !old_manifest.empty();
+}
+
+void VersionSet::logAndApply(VersionEdit& edit) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    edit.setNextFileNumber(next_file_number_);
+    edit.setLastSequence(last_sequence_);
+
+    auto version = apply(*current_, edit);
+    if (manifest_fd_ >= 0) {
+        // every flush logs an edit, fold them into a snapshot now and then.
+        // a snapshot that alone is past the limit must not roll on every edit
+        if (manifest_size_ >= std::max(max_manifest_size_, 2 * snapshot_size_)) {
+            startManifest();
+        }
+        std::string record;
+        edit.encodeTo(record);
+        appendRecord(manifest_fd_, record);
+        manifest_size_ += kRecordHeaderSize + record.size();
+    }
+    current_ = version;
+    if (edit.log_checkpoint_ && *edit.log_checkpoint_ > log_checkpoint_) {
+        log_checkpoint_ = *edit.log_checkpoint_;
+    }
+}
+
+std::shared_ptr<const Version> VersionSet::current() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return current_;
+}
+
+uint64_t VersionSet::newFileNumber() noexcept {
+    return next_file_number_.fetch_add(1);
+}
+
+void VersionSet::markFileNumberUsed(uint64_t number) noexcept {
+    uint64_t next = next_file_number_.load();
+    while (next <= number && !next_file_number_.compare_exchange_weak(next, number + 1)) {
+    }
+}
+
+uint64_t VersionSet::allocateSequences(uint64_t count) noexcept {
+    return last_sequence_.fetch_add(count) + 1;
+}
+
+uint64_t VersionSet::lastSequence() const noexcept {
+    return last_sequence_;
+}
+
+uint64_t VersionSet::logCheckpoint() const noexcept {
+    return log_checkpoint_;
+}
+
+const std::string& VersionSet::directory() const noexcept {
+    return directory_;
+}
+
+int VersionSet::numLevels() const noexcept {
+    return num_levels_;
+}
+
+std::shared_ptr<Version> VersionSet::apply(const Version& base, const VersionEdit& edit) const {
+    auto version = std::make_shared<Version>(base);
+    for (const auto& [level, number] : edit.deleted_files_) {
+        if (level < 0 || level >= num_levels_) {
+            throw std::runtime_error("Version edit names level " + std::to_string(level));
+        }
+        auto& files = version->levels_[level];
+        files.erase(std::remove_if(files.begin(), files.end(),
+                                   [number = number](const auto& file) { return file->number == number; }),
+                    files.end());
+    }
+    for (const auto& [level, file] : edit.new_files_) {
+        if (level < 0 || level >= num_levels_) {
+            throw std::runtime_error("Version edit names level " + std::to_string(level));
+        }
+        version->levels_[level].push_back(std::make_shared<const FileMetaData>(file));
+    }
+
+    // level 0 newest first, the rest by key
+    auto& level0 = version->levels_[0];
+    std::sort(level0.begin(), level0.end(), [](const auto& a, const auto& b) {
+        return a->largest_sequence != b->largest_sequence ? a->largest_sequence > b->largest_sequence
+                                                          : a->number > b->number;
+    });
+    for (int level = 1; level < num_levels_; ++level) {
+        auto& files = version->levels_[level];
+        std::sort(files.begin(), files.end(), [](const auto& a, const auto& b) { return a->smallest < b->smallest; });
+    }
+    return version;
+}
+
+void VersionSet::startManifest() {
+    uint64_t number = newFileNumber();
+    std::string path = manifestPath(number);
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("Failed to create manifest " + path + ": " + std::strerror(errno));
+    }
+
+    // the new manifest starts with every live file, older edits are folded in
+    VersionEdit snapshot;
+    for (int level = 0; level < num_levels_; ++level) {
+        for (const auto& file : current_->files(level)) {
+            snapshot.addFile(level, *file);
+        }
+    }
+    snapshot.setNextFileNumber(next_file_number_);
+    snapshot.setLastSequence(last_sequence_);
+    snapshot.setLogCheckpoint(log_checkpoint_);
+    std::string record;
+    snapshot.encodeTo(record);
+
+    std::string temp = currentPath() + ".tmp";
+    int current_fd = -1;
+    try {
+        appendRecord(fd, record);
+
+        current_fd = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (current_fd < 0) {
+            throw std::runtime_error("Failed to create " + temp + ": " + std::strerror(errno));
+        }
+        writeAll(current_fd, std::filesystem::path(path).filename().string() + "\n", temp);
+        if (::fsync(current_fd) != 0) {
+            throw std::runtime_error("Failed to sync " + temp + ": " + std::strerror(errno));
+        }
+        ::close(current_fd);
+        current_fd = -1;
+        std::filesystem::rename(temp, currentPath());
+    } catch (...) {
+        if (current_fd >= 0) {
+            ::close(current_fd);
+        }
+        ::close(fd);
+        std::error_code ignored;
+        std::filesystem::remove(path, ignored);
+        throw;
+    }
+    syncDirectory(directory_);
+
+    if (manifest_fd_ >= 0) {
+        ::close(manifest_fd_);
+    }
+    if (!manifest_path_.empty()) {
+        // CURRENT moved on, a leftover is harmless
+        std::error_code ignored;
+        std::filesystem::remove(manifest_path_, ignored);
+    }
+    manifest_fd_ = fd;
+    manifest_path_ = path;
+    snapshot_size_ = kRecordHeaderSize + record.size();
+    manifest_size_ = snapshot_size_;
+}
+
+void VersionSet::appendRecord(int fd, const std::string& edit) {
+    std::string record;
+    Util::putFixed32(record, static_cast<uint32_t>(edit.size()));
+    Util::putFixed32(record, Util::crc32(edit));
+    record += edit;
+
+    writeAll(fd, record, "manifest");
+    if (::fdatasync(fd) != 0) {
+        throw std::runtime_error(std::string("Failed to sync manifest: ") + std::strerror(errno));
+    }
+}
+
+std::string VersionSet::currentPath() const {
+    return (std::filesystem::path(directory_) / "CURRENT").string();
+}
+
+std::string VersionSet::manifestPath(uint64_t number) const {
+    char name[32];
+    std::snprintf(name, sizeof(name), "MANIFEST-%06llu", static_cast<unsigned long long>(number));
+    return (std::filesystem::path(directory_) / name).string();
+}
+
+} // namespace storage_engine
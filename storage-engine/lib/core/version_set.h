@@ -0,0 +1,161 @@
+#pragma once
+
+#ifndef CORE_VERSION_SET_H
+#define CORE_VERSION_SET_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace storage_engine {
+
+// One live SSTable
+struct FileMetaData {
+    uint64_t number = 0;
+    std::string path;
+    uint64_t file_size = 0;
+    uint64_t num_entries = 0;
+    std::string smallest;  // first and last key in the file
+    std::string largest;
+    // writes the file holds, newer files have higher sequences
+    uint64_t smallest_sequence = 0;
+    uint64_t largest_sequence = 0;
+};
+
+// A change to the set of live files, applied atomically. This is the unit
+// written to the manifest.
+class VersionEdit {
+public:
+    void addFile(int level, const FileMetaData& file);
+    void deleteFile(int level, uint64_t number);
+    void setNextFileNumber(uint64_t number);
+    void setLastSequence(uint64_t sequence);
+    // every write-ahead log record ending at or before position is in a live file
+    void setLogCheckpoint(uint64_t position);
+
+    bool empty() const;
+
+    void encodeTo(std::string& dst) const;
+    // false if the input is truncated or malformed
+    bool decodeFrom(std::string_view input);
+
+private:
+    friend class VersionSet;
+
+    std::vector<std::pair<int, FileMetaData>> new_files_;
+    std::vector<std::pair<int, uint64_t>> deleted_files_;
+    std::optional<uint64_t> next_file_number_;
+    std::optional<uint64_t> last_sequence_;
+    std::optional<uint64_t> log_checkpoint_;
+};
+
+// Immutable snapshot of the live files, by level. Level 0 holds flushed
+// tables whose key ranges may overlap, newest first. Every deeper level
+// holds tables with disjoint key ranges, sorted by smallest key.
+class Version {
+public:
+    using FileList = std::vector<std::shared_ptr<const FileMetaData>>;
+
+    explicit Version(int num_levels);
+
+    int numLevels() const noexcept;
+    const FileList& files(int level) const;
+    uint64_t levelBytes(int level) const;
+    size_t numFiles() const noexcept;
+
+    // Files that may hold key in the order a lookup reads them, newest
+    // data first. files whose key range excludes key are skipped
+    FileList filesForKey(std::string_view key) const;
+
+    // Files of level whose key range intersects [smallest, largest]
+    FileList overlappingFiles(int level, std::string_view smallest, std::string_view largest) const;
+
+private:
+    friend class VersionSet;
+
+    std::vector<FileList> levels_;
+};
+
+// The current Version plus the manifest that makes it durable.
+//
+// The manifest is a log of VersionEdits, each framed as
+// [fixed32 length][fixed32 crc32][edit]. A new manifest is started on
+// every open, and whenever the current one grows past max_manifest_size,
+// with a snapshot of the live files, and the CURRENT file names it. CURRENT
+// is replaced with a rename, so a crash leaves either the old or the new
+// manifest in charge.
+//
+// With an empty directory nothing is persisted, the set only lives in memory.
+class VersionSet {
+public:
+    static constexpr int kNumLevels = 7;
+    static constexpr uint64_t kMaxManifestSize = 4 << 20;
+
+    explicit VersionSet(const std::string& directory = "", int num_levels = kNumLevels,
+                        uint64_t max_manifest_size = kMaxManifestSize);
+    ~VersionSet();
+
+    VersionSet(const VersionSet&) = delete;
+    VersionSet& operator=(const VersionSet&) = delete;
+
+    // Load the manifest named by CURRENT and start a fresh one. a missing
+    // CURRENT starts an empty set. true if a manifest was loaded
+    // throws std::runtime_error if the manifest is corrupted or can't be written
+    bool recover();
+
+    // Log the edit to the manifest (synced) and make it current. readers
+    // holding the previous Version keep it
+    // throws std::runtime_error if the manifest can't be written, the
+    // current Version is unchanged then
+    void logAndApply(VersionEdit& edit);
+
+    std::shared_ptr<const Version> current() const;
+
+    uint64_t newFileNumber() noexcept;
+    // a file numbered outside of newFileNumber(), later numbers skip it
+    void markFileNumberUsed(uint64_t number) noexcept;
+    // Reserve `count` sequence numbers, returns the first
+    uint64_t allocateSequences(uint64_t count) noexcept;
+    uint64_t lastSequence() const noexcept;
+    // highest log checkpoint of any edit, 0 before the first one. replay of
+    // the write-ahead log starts after it
+    uint64_t logCheckpoint() const noexcept;
+
+    const std::string& directory() const noexcept;
+    int numLevels() const noexcept;
+
+private:
+    const std::string directory_;
+    const int num_levels_;
+    const uint64_t max_manifest_size_;
+
+    mutable std::mutex mutex_;  // guards current_ and the manifest
+    std::shared_ptr<const Version> current_;
+    std::atomic<uint64_t> next_file_number_{1};
+    std::atomic<uint64_t> last_sequence_{0};
+    std::atomic<uint64_t> log_checkpoint_{0};
+    int manifest_fd_ = -1;
+    std::string manifest_path_;
+    uint64_t manifest_size_ = 0;
+    uint64_t snapshot_size_ = 0;  // of the first record of the manifest
+
+    std::shared_ptr<Version> apply(const Version& base, const VersionEdit& edit) const;
+
+    // callers hold mutex_. startManifest() switches CURRENT to a new
+    // manifest and removes the previous one, which stays in charge if it throws
+    void startManifest();
+    void appendRecord(int fd, const std::string& edit);
+
+    std::string currentPath() const;
+    std::string manifestPath(uint64_t number) const;
+};
+
+} // namespace storage_engine
+
+#endif // CORE_VERSION_SET_H
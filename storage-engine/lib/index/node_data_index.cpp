@@ -8,21 +8,30 @@
 
 namespace storage_engine {
 
-NodeDataIndex::NodeDataIndex() = default;
+NodeDataIndex::NodeDataIndex(MemoryTracker* tracker) : tracker_(tracker) {}
+
+NodeDataIndex::~NodeDataIndex() {
+    uncharge(memory_usage_.load());
+}
 
 void NodeDataIndex::insert(const std::string& new_node_data_id, const GraphNodeData<void*>& data_node) {
     if (data_node.get_id().empty()) {
         throw std::invalid_argument("Data node ID cannot be empty.");
     }
-    auto result = index_.emplace(new_node_data_id, data_node);
+    auto& stripe = stripeFor(new_node_data_id);
+    std::lock_guard<std::mutex> lock(stripe.mutex);
+    auto result = stripe.index.emplace(new_node_data_id, data_node);
     if (!result.second) {
         throw std::invalid_argument("Node data ID already exists.");
     }
+    charge(entrySize(result.first->first, result.first->second));
 }
 
 GraphNodeData<void*> NodeDataIndex::get(const std::string& node_data_id) const {
-    auto it = index_.find(node_data_id);
-    if (it != index_.end()) {
+    auto& stripe = stripeFor(node_data_id);
+    std::lock_guard<std::mutex> lock(stripe.mutex);
+    auto it = stripe.index.find(node_data_id);
+    if (it != stripe.index.end()) {
         return it->second;
     } else {
         throw std::invalid_argument("Node data ID does not exist.");
@@ -30,12 +39,46 @@ GraphNodeData<void*> NodeDataIndex::get(const std::string& node_data_id) const {
 }
 
 void NodeDataIndex::remove(const std::string& node_data_id) {
-    auto it = index_.find(node_data_id);
-    if (it != index_.end()) {
-        index_.erase(it);
+    auto& stripe = stripeFor(node_data_id);
+    std::lock_guard<std::mutex> lock(stripe.mutex);
+    auto it = stripe.index.find(node_data_id);
+    if (it != stripe.index.end()) {
+        uncharge(entrySize(it->first, it->second));
+        stripe.index.erase(it);
     } else {
         throw std::invalid_argument("Node data ID does not exist.");
     }
 }
 
+size_t NodeDataIndex::memoryUsage() const noexcept {
+    return memory_usage_.load(std::memory_order_relaxed);
+}
+
+size_t NodeDataIndex::entrySize(const std::string& node_data_id, const GraphNodeData<void*>& data_node) noexcept {
+    return MemoryTracker::stringBytes(node_data_id) + data_node.get_memory_usage() +
+           MemoryTracker::kHashNodeOverhead;
+}
+
+void NodeDataIndex::charge(size_t bytes) noexcept {
+    memory_usage_.fetch_add(bytes, std::memory_order_relaxed);
+    if (tracker_ != nullptr) {
+        tracker_->consume(MemoryTracker::Component::kNodeDataIndex, bytes);
+    }
+}
+
+void NodeDataIndex::uncharge(size_t bytes) noexcept {
+    memory_usage_.fetch_sub(bytes, std::memory_order_relaxed);
+    if (tracker_ != nullptr) {
+        tracker_->release(MemoryTracker::Component::kNodeDataIndex, bytes);
+    }
+}
+
+NodeDataIndex::Stripe& NodeDataIndex::stripeFor(const std::string& node_data_id) {
+    return stripes_[std::hash<std::string>{}(node_data_id) % kStripes];
+}
+
+const NodeDataIndex::Stripe& NodeDataIndex::stripeFor(const std::string& node_data_id) const {
+    return stripes_[std::hash<std::string>{}(node_data_id) % kStripes];
+}
+
 } // namespace storage_engine
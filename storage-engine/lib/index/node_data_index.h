@@ -3,17 +3,22 @@
 #ifndef CORE_NODE_DATA_INDEX_H
 #define CORE_NODE_DATA_INDEX_H
 
+#include <array>
+#include <atomic>
+#include <mutex>
 #include <unordered_map>
 #include <string>
 #include <stdexcept>
 #include "core/graph_node.h"
+#include "core/memory_tracker.h"
 
 namespace storage_engine {
 
 class NodeDataIndex {
 public:
-    NodeDataIndex() = default;
-    ~NodeDataIndex() = default;
+    // entries are charged to `tracker` when one is given
+    explicit NodeDataIndex(MemoryTracker* tracker = nullptr);
+    ~NodeDataIndex();
 
     // Insert a new node data entry into the index
     void insert(const std::string& new_node_data_id, const GraphNodeData<void*>& data_node);
@@ -24,8 +29,28 @@ public:
     // Remove a node data entry from the index
     void remove(const std::string& node_data_id);
 
+    // Estimated heap bytes held by the index
+    size_t memoryUsage() const noexcept;
+
 private:
-    std::unordered_map<std::string, GraphNodeData<void*>> index_; // Map to store node data entries
+    // lock striping, same scheme as NodeIDIndex
+    static constexpr size_t kStripes = 64;
+
+    struct Stripe {
+        std::unordered_map<std::string, GraphNodeData<void*>> index; // Map to store node data entries
+        mutable std::mutex mutex;
+    };
+
+    std::array<Stripe, kStripes> stripes_;
+    std::atomic<size_t> memory_usage_{0};
+    MemoryTracker* tracker_ = nullptr;
+
+    static size_t entrySize(const std::string& node_data_id, const GraphNodeData<void*>& data_node) noexcept;
+    void charge(size_t bytes) noexcept;
+    void uncharge(size_t bytes) noexcept;
+
+    Stripe& stripeFor(const std::string& node_data_id);
+    const Stripe& stripeFor(const std::string& node_data_id) const;
 };
 
 } // namespace storage_engine
@@ -8,27 +8,67 @@
 
 namespace storage_engine {
 
-NodeIDIndex::NodeIDIndex() = default;
+NodeIDIndex::NodeIDIndex(MemoryTracker* tracker) : tracker_(tracker) {}
+
+NodeIDIndex::~NodeIDIndex() {
+    uncharge(memory_usage_.load());
+}
 
 void NodeIDIndex::insert(const std::string& node_id) {
-    if (!exists(node_id)) {
-        node_ids_.insert(node_id);
-    } else {
+    auto& stripe = stripeFor(node_id);
+    std::lock_guard<std::mutex> lock(stripe.mutex);
+    if (!stripe.node_ids.insert(node_id).second) {
         throw std::invalid_argument("Node ID already exists.");
     }
+    charge(entrySize(node_id));
 }
 
 void NodeIDIndex::remove(const std::string& node_id) {
-    auto it = node_ids_.find(node_id);
-    if (it != node_ids_.end()) {
-        node_ids_.erase(it);
+    auto& stripe = stripeFor(node_id);
+    std::lock_guard<std::mutex> lock(stripe.mutex);
+    auto it = stripe.node_ids.find(node_id);
+    if (it != stripe.node_ids.end()) {
+        uncharge(entrySize(*it));
+        stripe.node_ids.erase(it);
     } else {
         throw std::invalid_argument("Node ID does not exist.");
     }
 }
 
 bool NodeIDIndex::exists(const std::string& node_id) const {
-    return node_ids_.find(node_id) != node_ids_.end();
+    auto& stripe = stripeFor(node_id);
+    std::lock_guard<std::mutex> lock(stripe.mutex);
+    return stripe.node_ids.find(node_id) != stripe.node_ids.end();
+}
+
+size_t NodeIDIndex::memoryUsage() const noexcept {
+    return memory_usage_.load(std::memory_order_relaxed);
+}
+
+size_t NodeIDIndex::entrySize(const std::string& node_id) noexcept {
+    return MemoryTracker::stringBytes(node_id) + MemoryTracker::kHashNodeOverhead;
+}
+
+void NodeIDIndex::charge(size_t bytes) noexcept {
+    memory_usage_.fetch_add(bytes, std::memory_order_relaxed);
+    if (tracker_ != nullptr) {
+        tracker_->consume(MemoryTracker::Component::kNodeIdIndex, bytes);
+    }
+}
+
+void NodeIDIndex::uncharge(size_t bytes) noexcept {
+    memory_usage_.fetch_sub(bytes, std::memory_order_relaxed);
+    if (tracker_ != nullptr) {
+        tracker_->release(MemoryTracker::Component::kNodeIdIndex, bytes);
+    }
+}
+
+NodeIDIndex::Stripe& NodeIDIndex::stripeFor(const std::string& node_id) {
+    return stripes_[std::hash<std::string>{}(node_id) % kStripes];
+}
+
+const NodeIDIndex::Stripe& NodeIDIndex::stripeFor(const std::string& node_id) const {
+    return stripes_[std::hash<std::string>{}(node_id) % kStripes];
 }
 
 } // namespace storage_engine
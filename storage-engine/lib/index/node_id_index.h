@@ -3,16 +3,21 @@
 #ifndef CORE_NODE_ID_INDEX_H
 #define CORE_NODE_ID_INDEX_H
 
+#include <array>
+#include <atomic>
+#include <mutex>
 #include <unordered_set>
 #include <string>
 #include <stdexcept>
+#include "core/memory_tracker.h"
 
 namespace storage_engine {
 
 class NodeIDIndex {
 public:
-    NodeIDIndex() = default;
-    ~NodeIDIndex() = default;
+    // ids are charged to `tracker` when one is given
+    explicit NodeIDIndex(MemoryTracker* tracker = nullptr);
+    ~NodeIDIndex();
 
     // Insert a new node ID into the index
     void insert(const std::string& node_id);
@@ -23,8 +28,29 @@ public:
     // Check if a node ID exists in the index
     bool exists(const std::string& node_id) const;
 
+    // Estimated heap bytes held by the index
+    size_t memoryUsage() const noexcept;
+
 private:
-    std::unordered_set<std::string> node_ids_; // Set to store unique node IDs
+    // lock striping: ids hash to one of kStripes sets, each with its own
+    // mutex, so concurrent writers on different nodes rarely collide
+    static constexpr size_t kStripes = 64;
+
+    struct Stripe {
+        std::unordered_set<std::string> node_ids; // Set to store unique node IDs
+        mutable std::mutex mutex;
+    };
+
+    std::array<Stripe, kStripes> stripes_;
+    std::atomic<size_t> memory_usage_{0};
+    MemoryTracker* tracker_ = nullptr;
+
+    static size_t entrySize(const std::string& node_id) noexcept;
+    void charge(size_t bytes) noexcept;
+    void uncharge(size_t bytes) noexcept;
+
+    Stripe& stripeFor(const std::string& node_id);
+    const Stripe& stripeFor(const std::string& node_id) const;
 };
 
 } // namespace storage_engine
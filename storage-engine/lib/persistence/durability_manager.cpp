@@ -3,12 +3,85 @@
 // Implementation of DurabilityManager for the storage engine.
 
 #include "persistence/durability_manager.h"
+#include "concurrency/thread_pool.h"
+#include <sys/stat.h>
+#include <algorithm>
+#include <chrono>
+#include <exception>
 #include <fstream>
+#include <future>
 #include <stdexcept>
+#include <vector>
 
 namespace storage_engine {
 
-DurabilityManager::DurabilityManager() = default;
+namespace {
+
+double secondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Records of one segment, split by partition
+struct SegmentRecords {
+    std::string path;
+    uint64_t bytes = 0;
+    uint64_t records = 0;
+    uint64_t skipped = 0;
+    uint64_t end_position = 0;
+    std::vector<std::vector<LogRecord>> partitions;
+};
+
+void scanSegment(SegmentRecords& segment, uint64_t checkpoint, size_t partitions,
+                 const DurabilityManager::PartitionFunction& partition_of) {
+    MergeLog::Reader reader(segment.path);
+    segment.partitions.resize(partitions);
+    LogRecord record;
+    while (reader.next(record)) {
+        if (record.end_position <= checkpoint) {
+            ++segment.skipped;
+            continue;
+        }
+        size_t partition = partition_of(record.key);
+        if (partition >= partitions) {
+            throw std::runtime_error("Partition of " + record.key + " is out of range");
+        }
+        segment.partitions[partition].push_back(std::move(record));
+        ++segment.records;
+    }
+    if (reader.corrupted()) {
+        throw std::runtime_error("Corrupted log record in " + segment.path + " at byte " +
+                                 std::to_string(reader.validBytes()));
+    }
+    segment.bytes = reader.validBytes();
+    segment.end_position = reader.endPosition();
+}
+
+// every task is done before the first error is rethrown, they all point
+// into the caller's frame
+void waitAll(std::vector<std::future<void>>& pending) {
+    std::exception_ptr error;
+    for (auto& future : pending) {
+        try {
+            future.get();
+        } catch (...) {
+            error = error ? error : std::current_exception();
+        }
+    }
+    pending.clear();
+    if (error) {
+        std::rethrow_exception(error);
+    }
+}
+
+} // namespace
+
+double ReplayStats::recordsPerSecond() const noexcept {
+    return seconds > 0 ? records / seconds : 0;
+}
+
+double ReplayStats::bytesPerSecond() const noexcept {
+    return seconds > 0 ? bytes / seconds : 0;
+}
 
 void DurabilityManager::persistData(const std::string& filename, const std::string& data) {
     std::ofstream out(filename, std::ios::binary);
@@ -24,9 +97,72 @@ std::string DurabilityManager::recoverData(const std::string& filename) {
     if (!in) {
         throw std::runtime_error("Failed to open file for reading: " + filename);
     }
-    std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    // sized up front and read in one go, not a character at a time
+    struct stat st;
+    if (::stat(filename.c_str(), &st) != 0) {
+        throw std::runtime_error("Failed to stat file: " + filename);
+    }
+    std::string data(static_cast<size_t>(st.st_size), '\0');
+    in.read(&data[0], static_cast<std::streamsize>(data.size()));
+    data.resize(static_cast<size_t>(in.gcount()));
+    if (in.bad()) {
+        throw std::runtime_error("Failed to read file: " + filename);
+    }
     in.close();
     return data;
 }
 
+ReplayStats DurabilityManager::replayLog(const std::string& directory, uint64_t checkpoint, size_t partitions,
+                                         const PartitionFunction& partition_of, const ApplyFunction& apply,
+                                         size_t threads) {
+    if (partitions == 0) {
+        throw std::invalid_argument("Replay needs at least one partition");
+    }
+    auto start = std::chrono::steady_clock::now();
+    ReplayStats stats;
+    auto paths = MergeLog::segments(directory);
+    threads = std::max<size_t>(1, std::min(threads, std::max(paths.size(), partitions)));
+    ThreadPool pool(threads);
+
+    // a wave of segments is held in memory at a time: scanned side by side,
+    // then applied partition by partition in segment order
+    for (size_t first = 0; first < paths.size(); first += threads) {
+        std::vector<SegmentRecords> wave(std::min(threads, paths.size() - first));
+        auto scan_start = std::chrono::steady_clock::now();
+        std::vector<std::future<void>> pending;
+        for (size_t i = 0; i < wave.size(); ++i) {
+            wave[i].path = paths[first + i];
+            pending.push_back(pool.submitTask([&segment = wave[i], checkpoint, partitions, &partition_of]() {
+                scanSegment(segment, checkpoint, partitions, partition_of);
+            }));
+        }
+        waitAll(pending);
+        stats.scan_seconds += secondsSince(scan_start);
+
+        auto apply_start = std::chrono::steady_clock::now();
+        for (size_t partition = 0; partition < partitions; ++partition) {
+            pending.push_back(pool.submitTask([&wave, partition, &apply]() {
+                for (const auto& segment : wave) {
+                    for (const auto& record : segment.partitions[partition]) {
+                        apply(partition, record);
+                    }
+                }
+            }));
+        }
+        waitAll(pending);
+        stats.apply_seconds += secondsSince(apply_start);
+
+        for (const auto& segment : wave) {
+            ++stats.segments;
+            stats.records += segment.records;
+            stats.skipped += segment.skipped;
+            stats.bytes += segment.bytes;
+            stats.end_position = std::max(stats.end_position, segment.end_position);
+        }
+    }
+
+    stats.seconds = secondsSince(start);
+    return stats;
+}
+
 } // namespace storage_engine
@@ -3,10 +3,37 @@
 #ifndef CORE_DURABILITY_MANAGER_H
 #define CORE_DURABILITY_MANAGER_H
 
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <thread>
+#include "core/merge_log.h"
+
 namespace storage_engine {
 
+// What a replay of the write-ahead log did
+struct ReplayStats {
+    uint64_t segments = 0;
+    uint64_t records = 0;         // applied
+    uint64_t skipped = 0;         // covered by the checkpoint replay started from
+    uint64_t bytes = 0;           // of the segments read
+    uint64_t end_position = 0;    // log position just past the last record
+    double scan_seconds = 0;      // reading and checking the segments
+    double apply_seconds = 0;     // handing the records to apply
+    double seconds = 0;           // the whole replay
+    double ready_seconds = 0;     // from opening the engine until it takes requests, set by the engine
+
+    double recordsPerSecond() const noexcept;
+    double bytesPerSecond() const noexcept;
+};
+
 class DurabilityManager {
 public:
+    // partition of a record's key, below the number of partitions
+    using PartitionFunction = std::function<size_t(const std::string& key)>;
+    // takes the records of one partition, in log order
+    using ApplyFunction = std::function<void(size_t partition, const LogRecord& record)>;
+
     DurabilityManager() = default;
     ~DurabilityManager() = default;
 
@@ -14,6 +41,17 @@ public:
     std::string recoverData(const std::string& filename);
     void persistData(const std::string& filename, const std::string& data);
 
+    // Replay the segments of a MergeLog directory, oldest first, leaving
+    // out records ending at or before checkpoint. Up to
+    // threads segments are read and checksummed at a time, each on its own
+    // thread in large sequential reads. their records are then split by
+    // partition and every partition applied on its own thread, so records
+    // of one key still come in log order
+    // throws std::runtime_error if a segment ends in a torn or corrupted
+    // record (MergeLog cuts those off when it opens), or apply throws
+    ReplayStats replayLog(const std::string& directory, uint64_t checkpoint, size_t partitions, const PartitionFunction& partition_of,
+                          const ApplyFunction& apply, size_t threads = std::thread::hardware_concurrency());
+
 };
 
 } // namespace storage_engine
@@ -4,25 +4,77 @@
 
 #include "persistence/flushing_manager.h"
 #include "core/memtable.h"  // Include necessary headers
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
 
 namespace storage_engine {
 
 FlushingManager::FlushingManager() = default;
 
-FlushingManager::FlushingManager(std::vector<std::unique_ptr<Memtable>>* old_memtables)
-    : old_memtables_(old_memtables), is_active_(true) {}
+FlushingManager::FlushingManager(const std::string& data_directory, CompactionManager* compaction_manager,
+                                 const SSTableOptions& options)
+    : data_directory_(data_directory), compaction_manager_(compaction_manager), options_(options), is_active_(true) {
+    std::filesystem::create_directories(data_directory_);
+
+    // never reuse the number of a table left behind by an earlier run
+    for (const auto& file : std::filesystem::directory_iterator(data_directory_)) {
+        if (file.path().extension() == ".sst") {
+            try {
+                next_file_number_ = std::max<uint64_t>(next_file_number_, std::stoull(file.path().stem().string()) + 1);
+            } catch (const std::exception&) {
+                // not one of ours
+            }
+        }
+    }
+}
+
+void FlushingManager::schedule(std::shared_ptr<Memtable> memtable) {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    queue_.push_back(std::move(memtable));
+}
 
 void FlushingManager::run() {
     if (!is_active_) {
         return;
     }
 
-    // Iterate through old memtables and flush each one
-    for (auto& memtable : *old_memtables_) {
-        if (memtable) {
-            memtable->dump();  // Assuming 'dump' writes the memtable to disk
+    std::lock_guard<std::mutex> flush_lock(flush_mutex_);
+
+    // Drain the queue, oldest memtable first
+    while (true) {
+        std::shared_ptr<Memtable> memtable;
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex_);
+            if (queue_.empty()) {
+                break;
+            }
+            memtable = queue_.front();
+        }
+
+        if (!memtable->empty()) {
+            FileMetaData file = flush(*memtable);
+            if (compaction_manager_ != nullptr) {
+                compaction_manager_->addFlushedFile(std::move(file));
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(queue_mutex_);
+            queue_.pop_front();
+        }
+
+        // readers may still hold the memtable, it is freed with the last reference
+        if (on_flushed_) {
+            on_flushed_(memtable);
         }
     }
+
+    // level 0 may have just crossed its limit
+    if (compaction_manager_ != nullptr) {
+        compaction_manager_->run();
+    }
 }
 
 void FlushingManager::triggerFlush() {
@@ -33,8 +85,49 @@ void FlushingManager::shutdown() {
     is_active_ = false;  // Disable flushing
 }
 
+size_t FlushingManager::pending() const {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    return queue_.size();
+}
+
+void FlushingManager::setFlushCallback(FlushCallback callback) {
+    on_flushed_ = std::move(callback);
+}
+
 FlushingManager* FlushingManager::get() {
     return this;
 }
 
+FileMetaData FlushingManager::flush(const Memtable& memtable) {
+    FileMetaData file;
+    file.number = compaction_manager_ != nullptr ? compaction_manager_->newFileNumber() : next_file_number_++;
+    file.path = (std::filesystem::path(data_directory_) / (std::to_string(file.number) + ".sst")).string();
+
+    // the memtable iterator is already in key order, records go to disk
+    // block by block without a copy of the table in between
+    std::ofstream out(file.path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        throw std::runtime_error("Failed to open file for writing: " + file.path);
+    }
+    SSTableBuilder builder(out, options_);
+    std::string encoded;
+    for (auto it = memtable.newIterator(); it.Valid(); it.Next()) {
+        encoded.clear();
+        it.value().encodeTo(encoded);
+        builder.add(it.key(), encoded);
+    }
+    builder.finish();
+    out.close();
+    if (!out) {
+        std::filesystem::remove(file.path);
+        throw std::runtime_error("Failed to write SSTable: " + file.path);
+    }
+
+    file.file_size = builder.fileSize();
+    file.num_entries = builder.numEntries();
+    file.smallest = builder.firstKey();
+    file.largest = builder.lastKey();
+    return file;
+}
+
 } // namespace storage_engine
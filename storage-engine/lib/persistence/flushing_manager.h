@@ -3,22 +3,30 @@
 #ifndef CORE_FLUSHING_MANAGER_H
 #define CORE_FLUSHING_MANAGER_H
 
+#include <deque>
+#include <functional>
 #include <vector>
 #include <memory>
+#include <mutex>
+#include <string>
+#include "core/compaction_manager.h"
 #include "core/memtable.h"
 
 namespace storage_engine {
 
 class FlushingManager {
-private:
-    std::vector<std::unique_ptr<Memtable>>* old_memtables_;
-    bool is_active_;
-
 public:
+    // called once a memtable is safely on disk and may be dropped
+    using FlushCallback = std::function<void(const std::shared_ptr<Memtable>&)>;
+
     FlushingManager();
-    FlushingManager(std::vector<std::unique_ptr<Memtable>>* old_memtables);
+    FlushingManager(const std::string& data_directory, CompactionManager* compaction_manager,
+                    const SSTableOptions& options = SSTableOptions());
 
-    // Run the flushing process for old memtables
+    // Queue a frozen memtable for flushing, in rotation order
+    void schedule(std::shared_ptr<Memtable> memtable);
+
+    // Run the flushing process for queued memtables
     void run();
 
     // Trigger a flush manually
@@ -27,8 +35,31 @@ public:
     // Shutdown the flushing manager (stop further flushing)
     void shutdown();
 
+    // Number of memtables waiting to be flushed
+    size_t pending() const;
+
+    void setFlushCallback(FlushCallback callback);
+
     // Get the instance of FlushingManager
     FlushingManager* get();
+
+private:
+    std::string data_directory_;
+    CompactionManager* compaction_manager_ = nullptr;
+    SSTableOptions options_;
+    FlushCallback on_flushed_;
+    bool is_active_ = false;
+
+    std::deque<std::shared_ptr<Memtable>> queue_;  // guarded by queue_mutex_
+    mutable std::mutex queue_mutex_;
+
+    // flushes run one at a time so SSTables are registered in rotation order
+    std::mutex flush_mutex_;
+    // file numbers when there is no compaction manager to hand them out
+    uint64_t next_file_number_ = 1;
+
+    // Write one memtable to a new SSTable, returns what the table holds
+    FileMetaData flush(const Memtable& memtable);
 };
 
 } // namespace storage_engine
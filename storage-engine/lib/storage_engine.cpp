@@ -1,23 +1,79 @@
 #include "storage_engine.h"
 
 #include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <queue>
 #include <stdexcept>
 #include <unordered_set>
 
 namespace storage_engine {
 
 // Keeping existing constructor
-StorageEngine::StorageEngine() {
-    active_memtable_ = std::make_unique<Memtable>();
-    merge_log_ = std::make_unique<MergeLog>();
-    compaction_manager_ = std::make_unique<CompactionManager>();
-    object_cache_ = std::make_unique<ObjectCache>();
-    node_id_index_ = std::make_unique<NodeIDIndex>();
-    node_data_index_ = std::make_unique<NodeDataIndex>();
+StorageEngine::StorageEngine() : StorageEngine(EngineConfig()) {}
+
+StorageEngine::StorageEngine(const EngineConfig& config) : config_(config) {
+    auto opened = std::chrono::steady_clock::now();
+
+    // created first, every in-memory structure below charges to it
+    memory_tracker_ = std::make_unique<MemoryTracker>(config_.memory_budget);
+
+    size_t num_shards = config_.memtable_shards != 0
+        ? config_.memtable_shards
+        : std::max(1u, std::thread::hardware_concurrency());
+    shard_memtable_size_ = std::max<size_t>(1, config_.memtable_size / num_shards);
+    for (size_t i = 0; i < num_shards; ++i) {
+        auto shard = std::make_unique<MemtableShard>();
+        shard->active = std::make_shared<Memtable>(shard_memtable_size_, memory_tracker_.get());
+        memtable_shards_.push_back(std::move(shard));
+    }
+
+    block_cache_ = std::make_unique<BlockCache>(config_.block_cache_size, config_.block_cache_policy,
+                                                config_.block_cache_shards, 0.5, memory_tracker_.get());
+    SSTableOptions sstable_options;
+    sstable_options.bloom_bits_per_key = config_.bloom_bits_per_key;
+    sstable_options.use_mmap = config_.sstable_use_mmap;
+    sstable_options.compression = config_.compression;
+    sstable_options.bottommost_compression = config_.bottommost_compression;
+    sstable_options.block_cache = block_cache_.get();
+    io_backend_ = IOBackend::create(config_.io_backend, config_.io_queue_depth);
+    sstable_options.io_backend = io_backend_.get();
+    CompactionOptions compaction_options;
+    compaction_options.style = config_.compaction_style;
+    compaction_options.level0_file_trigger = config_.compaction_threshold;
+    compaction_options.level1_max_files = config_.max_sstables;
+    compaction_options.level1_max_bytes = config_.level1_max_bytes;
+    compaction_options.level_size_multiplier = config_.level_size_multiplier;
+    compaction_options.size_ratio_percent = config_.compaction_size_ratio;
+    compaction_options.max_size_amplification_percent = config_.max_size_amplification_percent;
+    compaction_options.target_file_size = config_.target_file_size;
+    compaction_options.max_subcompactions = config_.max_subcompactions;
+    compaction_manager_ = std::make_unique<CompactionManager>(config_.data_directory, sstable_options,
+                                                              compaction_options);
+    // after the compaction manager, positions have to go on past the
+    // checkpoint of its manifest
+    MergeLogOptions log_options;
+    log_options.segment_size = config_.wal_segment_size;
+    log_options.recycle_segments = config_.wal_recycle_segments;
+    log_options.sync_interval_ms = config_.flush_interval;
+    log_options.first_position = compaction_manager_->logCheckpoint();
+    merge_log_ = std::make_unique<MergeLog>((std::filesystem::path(config_.data_directory) / "wal").string(),
+                                            log_options);
+    object_cache_ = std::make_unique<ObjectCache>(config_.cache_size, memory_tracker_.get());
+    node_id_index_ = std::make_unique<NodeIDIndex>(memory_tracker_.get());
+    node_data_index_ = std::make_unique<NodeDataIndex>(memory_tracker_.get());
     thread_pool_ = std::make_unique<ThreadPool>();
+    compaction_manager_->setThreadPool(thread_pool_.get());
     lock_manager_ = std::make_unique<LockManager>();
-    flushing_manager_ = std::make_unique<FlushingManager>();
+    flushing_manager_ = std::make_unique<FlushingManager>(config_.data_directory, compaction_manager_.get(),
+                                                           compaction_manager_->sstableOptions());
     durability_manager_ = std::make_unique<DurabilityManager>();
+
+    // retire old memtables as soon as they are on disk
+    flushing_manager_->setFlushCallback(
+        std::bind(&StorageEngine::_on_memtable_flushed, this, std::placeholders::_1));
+    compaction_manager_->setDataReleaseCallback(
+        std::bind(&StorageEngine::_on_node_data_released, this, std::placeholders::_1));
     
     // set this to an active state
     is_active = true;
@@ -25,22 +81,55 @@ StorageEngine::StorageEngine() {
     // start background processes
     thread_pool_->submitTask(std::bind(&CompactionManager::run, compaction_manager_.get()));
     thread_pool_->submitTask(std::bind(&FlushingManager::run, flushing_manager_.get()));
+
+    // what is in the SSTables exists unless its newest record deletes it,
+    // the log replayed on top adds and deletes the rest
+    compaction_manager_->forEachLiveNode([this](std::string_view node_id) {
+        node_id_index_->insert(std::string(node_id));
+    });
+
+    // after the background processes: memtables filling up during replay
+    // are flushed like any others
+    _replay_log();
+    recovery_stats_.ready_seconds =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - opened).count();
 }
 
 // Keeping existing destructor
 StorageEngine::~StorageEngine() {
+    _shutdown();
+}
+
+void StorageEngine::_shutdown() {
+    // nothing to shut down in a moved-from engine
+    if (!thread_pool_) {
+        return;
+    }
+
     // first set this is no longer active
     is_active = false;
 
-    // then dump all the active memtable first
-    active_memtable_->dump();
+    // then rotate the active memtables out so they are flushed with the rest
+    for (auto& shard : memtable_shards_) {
+        std::unique_lock<std::shared_mutex> lock(shard->mutex);
+        if (!shard->active->empty()) {
+            shard->active->freeze();
+            shard->old.push_back(shard->active);
+            flushing_manager_->schedule(shard->active);
+            shard->active = std::make_shared<Memtable>(shard_memtable_size_, memory_tracker_.get());
+        }
+    }
 
     // and if there are any tasks in the threadpool, cancel them
+    // and wait for the ones already running (they may be mid-flush). the
+    // compaction manager lets go of the pool before it goes away
     thread_pool_->cancelAllTasks();
+    compaction_manager_->setThreadPool(nullptr);
+    thread_pool_.reset();
 
     // flush everything to disc first
     // flushing only works on old (inactive) memtables, so it is 
-    // essential to first dump all active memtables before flushing
+    // essential to first rotate the active memtable before flushing
     flushing_manager_->run();
 
     // push all merge log to disc as well 
@@ -52,9 +141,13 @@ StorageEngine::~StorageEngine() {
 
 // Keeping existing move operations
 StorageEngine::StorageEngine(StorageEngine&& other) 
-    : active_memtable_(std::move(other.active_memtable_))
-    , old_memtables_(std::move(other.old_memtables_))
+    : config_(std::move(other.config_))
+    , memory_tracker_(std::move(other.memory_tracker_))
+    , memtable_shards_(std::move(other.memtable_shards_))
+    , shard_memtable_size_(other.shard_memtable_size_)
     , merge_log_(std::move(other.merge_log_))
+    , block_cache_(std::move(other.block_cache_))
+    , io_backend_(std::move(other.io_backend_))
     , compaction_manager_(std::move(other.compaction_manager_))
     , object_cache_(std::move(other.object_cache_))
     , node_id_index_(std::move(other.node_id_index_))
@@ -63,84 +156,119 @@ StorageEngine::StorageEngine(StorageEngine&& other)
     , lock_manager_(std::move(other.lock_manager_))
     , flushing_manager_(std::move(other.flushing_manager_))
     , durability_manager_(std::move(other.durability_manager_))
+    , recovery_stats_(other.recovery_stats_)
     , is_active(other.is_active) {
+    if (flushing_manager_) {
+        flushing_manager_->setFlushCallback(
+            std::bind(&StorageEngine::_on_memtable_flushed, this, std::placeholders::_1));
+    }
+    if (compaction_manager_) {
+        compaction_manager_->setDataReleaseCallback(
+            std::bind(&StorageEngine::_on_node_data_released, this, std::placeholders::_1));
+    }
 }
 
 StorageEngine& StorageEngine::operator=(StorageEngine&& other) {
     if (this != &other) {
-        active_memtable_ = std::move(other.active_memtable_);
-        old_memtables_ = std::move(other.old_memtables_);
+        // our background work may still be flushing into the members
+        // replaced below, stop it and put everything on disc first
+        _shutdown();
+
+        config_ = std::move(other.config_);
+        memtable_shards_ = std::move(other.memtable_shards_);
+        shard_memtable_size_ = other.shard_memtable_size_;
         merge_log_ = std::move(other.merge_log_);
         compaction_manager_ = std::move(other.compaction_manager_);
+        block_cache_ = std::move(other.block_cache_);
+        io_backend_ = std::move(other.io_backend_);
         object_cache_ = std::move(other.object_cache_);
         node_id_index_ = std::move(other.node_id_index_);
         node_data_index_ = std::move(other.node_data_index_);
         thread_pool_ = std::move(other.thread_pool_);
         lock_manager_ = std::move(other.lock_manager_);
         flushing_manager_ = std::move(other.flushing_manager_);
-        compaction_manager_ = std::move(other.compaction_manager_);
+        durability_manager_ = std::move(other.durability_manager_);
+        recovery_stats_ = other.recovery_stats_;
+        // last, our old memtables, cache and indexes are charged to it
+        memory_tracker_ = std::move(other.memory_tracker_);
         is_active = other.is_active;
+        if (flushing_manager_) {
+            flushing_manager_->setFlushCallback(
+                std::bind(&StorageEngine::_on_memtable_flushed, this, std::placeholders::_1));
+        }
+        if (compaction_manager_) {
+            compaction_manager_->setDataReleaseCallback(
+                std::bind(&StorageEngine::_on_node_data_released, this, std::placeholders::_1));
+        }
     }
     return *this;
 }
 
 // Keeping existing node creation methods
-std::string StorageEngine::create_node(std::vector<unsigned char>& node_data) {
+std::string StorageEngine::create_node(std::vector<unsigned char>& node_data, SyncMode sync) {
     GraphNodeData<void*> data_node(node_data);
-    return _create_node(data_node);
+    return _create_node(data_node, sync);
 }
 
-std::string StorageEngine::_create_node(const GraphNodeData<void*>& data_node) {
+std::string StorageEngine::_create_node(const GraphNodeData<void*>& data_node, SyncMode sync) {
     GraphNodeMeta meta_node;
     std::string new_node_id = UUIDGenerator::generateUUID();
 
-    // first write data to data index
+    // the payload goes with the record, so the log and the SSTables have it
     std::string new_node_data_id = data_node.get_id();
-    node_data_index_->insert(new_node_data_id, data_node);
-
+    const auto& bytes = data_node.get_data();
     meta_node.set_data_id(new_node_data_id);
+    meta_node.set_payload(std::string_view(reinterpret_cast<const char*>(bytes.data()), bytes.size()));
 
-    // then push to active memtable
-    active_memtable_->insert(new_node_id, meta_node);
+    // log it and push it to the active memtable while the log thread writes
+    uint64_t logged = _write_to_memtable(new_node_id, meta_node);
 
-    // add to merge log also
-    merge_log_->add(new_node_id, meta_node);
+    // then to the data index, reads skip decoding it from the record
+    node_data_index_->insert(new_node_data_id, data_node);
     
     // Add to node ID index
     node_id_index_->insert(new_node_id);
 
+    _commit_log(logged, sync);
     return new_node_id;
 }
 
 // Keeping existing connection methods
-void StorageEngine::add_connection(const std::string& from_node_id, const std::string& to_node_id) {
-    this->_insert_connection(from_node_id, to_node_id, '1');
+void StorageEngine::add_connection(const std::string& from_node_id, const std::string& to_node_id, SyncMode sync) {
+    this->_insert_connection(from_node_id, to_node_id, '1', sync);
 }
 
-void StorageEngine::delete_connection(const std::string& from_node_id, const std::string& to_node_id) {
-    this->_insert_connection(from_node_id, to_node_id, '0');
+void StorageEngine::delete_connection(const std::string& from_node_id, const std::string& to_node_id, SyncMode sync) {
+    this->_insert_connection(from_node_id, to_node_id, '0', sync);
 }
 
-void StorageEngine::_insert_connection(const std::string& from_node_id, const std::string& to_node_id, unsigned char flag_byte) {
+void StorageEngine::_insert_connection(const std::string& from_node_id, const std::string& to_node_id,
+                                       unsigned char flag_byte, SyncMode sync) {
     // Verify both nodes exist
     if (!node_id_index_->exists(from_node_id) || !node_id_index_->exists(to_node_id)) {
         throw std::invalid_argument("One or both nodes don't exist");
     }
 
+    // only the change is written, it is folded with the node's earlier
+    // records on read, so no read-modify-write on the insert path
     GraphNodeMeta meta_node;
+    meta_node.set_type(GraphNodeMeta::Type::kDelta);
     // add a connection to the node_id
     meta_node.add_connection(to_node_id, flag_byte);
-    // insert this node to active memtable
-    active_memtable_->insert(from_node_id, meta_node);
-
-    merge_log_->add(from_node_id, meta_node);
+    // log it and insert this node to active memtable
+    uint64_t logged = _write_to_memtable(from_node_id, meta_node);
     
     // Invalidate cache entries for this connection
     object_cache_->invalidate(from_node_id + "_connections");
+    _commit_log(logged, sync);
+}
+
+void StorageEngine::_commit_log(uint64_t position, SyncMode sync) {
+    merge_log_->commit(position, sync == SyncMode::kDefault ? config_.wal_sync_mode : sync);
 }
 
 // Implementing the remaining methods from storage_engine.h
-void StorageEngine::delete_node(std::string node_id) {
+void StorageEngine::delete_node(std::string node_id, SyncMode sync) {
     if (!node_id_index_->exists(node_id)) {
         throw std::invalid_argument("Node doesn't exist");
     }
@@ -148,9 +276,15 @@ void StorageEngine::delete_node(std::string node_id) {
     auto lock = lock_manager_->acquireLock(node_id);
     
     // Get node data to clean up associated resources
-    auto node_data = get_node_data(node_id);
-    if (!node_data.get_id().empty()) {
-        node_data_index_->remove(node_data.get_id());
+    try {
+        auto node_data = get_node_data(node_id);
+        if (!node_data.get_id().empty()) {
+            node_data_index_->remove(node_data.get_id());
+        }
+    } catch (const std::invalid_argument&) {
+        // written before a restart, its data was read back from the record
+    } catch (const std::runtime_error&) {
+        // its record carries no data, nothing to clean up
     }
     
     // Remove from indexes
@@ -162,11 +296,10 @@ void StorageEngine::delete_node(std::string node_id) {
     
     // Mark as deleted in active memtable
     GraphNodeMeta deleted_meta;
+    deleted_meta.set_type(GraphNodeMeta::Type::kTombstone);
     deleted_meta.set_data_id(""); // Empty data ID indicates deletion
-    active_memtable_->insert(node_id, deleted_meta);
-    
-    // Log deletion
-    merge_log_->add(node_id, deleted_meta);
+    uint64_t logged = _write_to_memtable(node_id, deleted_meta);
+    _commit_log(logged, sync);
 }
 
 GraphNodeData<void*> StorageEngine::get_node_data(const std::string& node_id) {
@@ -181,26 +314,94 @@ GraphNodeData<void*> StorageEngine::get_node_data(const std::string& node_id) {
         return cached_data;
     }
     
-    // Check active memtable
-    auto meta = active_memtable_->get(node_id);
-    if (meta) {
-        auto data = node_data_index_->get(meta->get_data_id());
+    // Check active memtable, then old memtables newest first. edge deltas
+    // don't carry the data pointer, only a full node record does
+    auto meta = _resolve_node_meta(node_id);
+    if (meta && !meta->is_delta()) {
+        if (meta->is_tombstone()) {
+            throw std::invalid_argument("Node doesn't exist");
+        }
+        auto data = _get_node_payload(node_id, *meta);
         object_cache_->put(node_id, data);
+        _enforce_memory_budget();
         return data;
     }
     
-    // Check old memtables
-    for (auto* memtable : old_memtables_) {
-        meta = memtable->get(node_id);
-        if (meta) {
-            auto data = node_data_index_->get(meta->get_data_id());
-            object_cache_->put(node_id, data);
-            return data;
+    // the newest full record in the SSTables holds the data pointer
+    auto disk = compaction_manager_->getNodeMeta(node_id);
+    if (!disk || disk->is_delta()) {
+        throw std::runtime_error("Node record not found: " + node_id);
+    }
+    if (disk->is_tombstone()) {
+        throw std::invalid_argument("Node doesn't exist");
+    }
+    auto data = _get_node_payload(node_id, *disk);
+    object_cache_->put(node_id, data);
+    _enforce_memory_budget();
+    return data;
+}
+
+std::vector<GraphNodeData<void*>> StorageEngine::get_nodes_data(const std::vector<std::string>& node_ids) {
+    std::vector<GraphNodeData<void*>> results(node_ids.size());
+
+    // cache and memtables first, what is left goes to the SSTables together
+    std::vector<std::string> disk_ids;
+    std::vector<size_t> disk_slots;
+    for (size_t i = 0; i < node_ids.size(); ++i) {
+        const std::string& node_id = node_ids[i];
+        if (!node_id_index_->exists(node_id)) {
+            throw std::invalid_argument("Node doesn't exist");
+        }
+
+        uint8_t cache_error = 0;
+        auto cached_data = object_cache_->get(node_id, cache_error);
+        if (cache_error == 0) {
+            results[i] = cached_data;
+            continue;
         }
+
+        auto meta = _resolve_node_meta(node_id);
+        if (meta && !meta->is_delta()) {
+            if (meta->is_tombstone()) {
+                throw std::invalid_argument("Node doesn't exist");
+            }
+            results[i] = _get_node_payload(node_id, *meta);
+            object_cache_->put(node_id, results[i]);
+            continue;
+        }
+        disk_ids.push_back(node_id);
+        disk_slots.push_back(i);
     }
-    
-    // Check SSTable through compaction manager
-    return GraphNodeData<void*>(compaction_manager_->getNodeData(node_id));
+
+    auto disk = compaction_manager_->multiGetNodeMeta(disk_ids);
+    for (size_t j = 0; j < disk.size(); ++j) {
+        if (!disk[j] || disk[j]->is_delta()) {
+            throw std::runtime_error("Node record not found: " + disk_ids[j]);
+        }
+        if (disk[j]->is_tombstone()) {
+            throw std::invalid_argument("Node doesn't exist");
+        }
+        results[disk_slots[j]] = _get_node_payload(disk_ids[j], *disk[j]);
+        object_cache_->put(disk_ids[j], results[disk_slots[j]]);
+    }
+    _enforce_memory_budget();
+    return results;
+}
+
+GraphNodeData<void*> StorageEngine::_get_node_payload(const std::string& node_id, const GraphNodeMeta& meta) {
+    try {
+        return node_data_index_->get(meta.get_data_id());
+    } catch (const std::invalid_argument&) {
+        // written before a restart, the replayed or flushed record has it
+    }
+    if (!meta.get_payload()) {
+        throw std::runtime_error("Node record carries no data: " + node_id);
+    }
+    return GraphNodeData<void*>(meta.get_data_id(), *meta.get_payload());
+}
+
+bool StorageEngine::node_exists(const std::string& node_id) const {
+    return node_id_index_->exists(node_id);
 }
 
 std::vector<std::string> StorageEngine::match_connections(const std::string node_id, std::string condition) {
@@ -233,17 +434,25 @@ std::vector<std::string> StorageEngine::_get_all_connections(const std::string&
     // Combine all sources and remove duplicates
     std::unordered_set<std::string> unique_connections;
     
-    // Get from active memtable
-    auto active = _get_connections_from_active_memtable(node_id, "");
-    unique_connections.insert(active.begin(), active.end());
+    // Fold the memtables (active, then old ones newest first)
+    auto meta = _resolve_node_meta(node_id);
     
-    // Get from old memtables
-    auto old = _get_connections_from_old_memtables(node_id, "");
-    unique_connections.insert(old.begin(), old.end());
+    // a full record in memory is the complete list, a delta still has to
+    // be applied on top of what was already flushed to SSTables
+    if (!meta || meta->is_delta()) {
+        auto disk = _get_connections_from_sstables(node_id, "");
+        unique_connections.insert(disk.begin(), disk.end());
+    }
     
-    // Get from SSTables
-    auto disk = _get_connections_from_sstables(node_id, "");
-    unique_connections.insert(disk.begin(), disk.end());
+    if (meta) {
+        for (const auto& conn : meta->get_connections()) {
+            if (conn.second != '0') { // Only include non-deleted connections
+                unique_connections.insert(conn.first);
+            } else {
+                unique_connections.erase(conn.first);
+            }
+        }
+    }
     
     all_connections.assign(unique_connections.begin(), unique_connections.end());
     
@@ -256,61 +465,73 @@ std::vector<std::string> StorageEngine::_get_connections(
     const std::string& node_id, const std::string& node_prefix) {
     std::vector<std::string> filtered_connections;
     
-    auto all_connections = _get_all_connections(node_id);
+    // same fold as _get_all_connections, but the SSTable records only
+    // decode the neighbors under the prefix
+    std::unordered_set<std::string> unique_connections;
+    auto meta = _resolve_node_meta(node_id);
+    if (!meta || meta->is_delta()) {
+        auto disk = _get_connections_from_sstables(node_id, node_prefix);
+        unique_connections.insert(disk.begin(), disk.end());
+    }
     
-    // Filter based on prefix
-    std::copy_if(all_connections.begin(), all_connections.end(), 
-                 std::back_inserter(filtered_connections),
-                 [&node_prefix](const std::string& conn) {
-                     return conn.find(node_prefix) == 0;
-                 });
+    if (meta) {
+        for (const auto& conn : meta->get_connections()) {
+            if (conn.first.compare(0, node_prefix.size(), node_prefix) != 0) {
+                continue;
+            }
+            if (conn.second != '0') {
+                unique_connections.insert(conn.first);
+            } else {
+                unique_connections.erase(conn.first);
+            }
+        }
+    }
     
+    filtered_connections.assign(unique_connections.begin(), unique_connections.end());
     return filtered_connections;
 }
 
 // Implementing the remaining connection retrieval methods
-std::vector<std::string> StorageEngine::_get_connections_from_active_memtable(
-    std::string node_id, std::string node_prefix) {
-    auto meta = active_memtable_->get(node_id);
-    if (!meta) return {};
+std::shared_ptr<GraphNodeMeta> StorageEngine::_resolve_node_meta(const std::string& node_id) {
+    std::shared_ptr<GraphNodeMeta> resolved;
     
-    std::vector<std::string> filtered_connections;
-    for (const auto& conn : meta->get_connections()) {
-        if (node_prefix.empty() || conn.first.find(node_prefix) == 0) {
-            if (conn.second != '0') { // Only include non-deleted connections
-                filtered_connections.push_back(conn.first);
-            }
+    for (const auto& memtable : _get_memtables(node_id)) {
+        auto meta = memtable->get(node_id);
+        if (!meta) {
+            continue;
+        }
+        
+        // meta is older than what we have folded so far
+        if (resolved) {
+            meta->merge(*resolved);
+        }
+        resolved = meta;
+        
+        // a full node or a tombstone hides everything older
+        if (!resolved->is_delta()) {
+            break;
         }
     }
-    return filtered_connections;
+    
+    return resolved;
 }
 
-std::vector<std::string> StorageEngine::_get_connections_from_old_memtables(
+std::vector<std::string> StorageEngine::_get_connections_from_sstables(
     std::string node_id, std::string node_prefix) {
     std::vector<std::string> connections;
+    auto meta = compaction_manager_->getNodeMeta(node_id, node_prefix);
+    if (!meta || meta->is_tombstone()) {
+        return connections;
+    }
     
-    for (auto* memtable : old_memtables_) {
-        auto meta = memtable->get(node_id);
-        if (meta) {
-            for (const auto& conn : meta->get_connections()) {
-                if (node_prefix.empty() || conn.first.find(node_prefix) == 0) {
-                    if (conn.second != '0') { // Only include non-deleted connections
-                        connections.push_back(conn.first);
-                    }
-                }
-            }
+    for (const auto& conn : meta->get_connections()) {
+        if (conn.second != '0') {
+            connections.push_back(conn.first);
         }
     }
-    
     return connections;
 }
 
-std::vector<std::string> StorageEngine::_get_connections_from_sstables(
-    std::string node_id, std::string node_prefix) {
-    // return compaction_manager_->getConnections(node_id, node_prefix);
-    return {};
-}
-
 std::vector<std::string> StorageEngine::_get_connections_from_cache(
     const std::string& node_id, const std::string& prefix_node, uint8_t& cache_error) {
     std::string cache_key = node_id + "_connections";
@@ -326,6 +547,63 @@ std::vector<std::string> StorageEngine::_get_connections_from_cache(
     return std::vector<std::string>();
 }
 
+std::vector<std::string> StorageEngine::_match_nodeid_with_prefix(std::string prefix) {
+    // every shard's memtables, newest first within a shard. holding the
+    // shared_ptrs keeps them alive while we scan without any lock
+    std::vector<std::shared_ptr<Memtable>> memtables;
+    for (const auto& shard : memtable_shards_) {
+        std::shared_lock<std::shared_mutex> lock(shard->mutex);
+        memtables.push_back(shard->active);
+        memtables.insert(memtables.end(), shard->old.rbegin(), shard->old.rend());
+    }
+
+    std::vector<Memtable::Iterator> cursors;
+    for (const auto& memtable : memtables) {
+        cursors.push_back(memtable->newIterator(prefix));
+    }
+
+    // min-heap on the key, ties pop the newer memtable first. a node id
+    // hashes to one shard, so ties only come from the same shard
+    auto after = [&cursors](size_t a, size_t b) {
+        int cmp = cursors[a].key().compare(cursors[b].key());
+        return cmp != 0 ? cmp > 0 : a > b;
+    };
+    std::priority_queue<size_t, std::vector<size_t>, decltype(after)> heap(after);
+    for (size_t i = 0; i < cursors.size(); ++i) {
+        if (cursors[i].Valid()) {
+            heap.push(i);
+        }
+    }
+
+    std::vector<std::string> node_ids;
+    while (!heap.empty()) {
+        std::string node_id(cursors[heap.top()].key());
+
+        // the newest full record or tombstone decides, a node with only
+        // edge deltas in memory has its record further down
+        bool live = true;
+        bool decided = false;
+        while (!heap.empty() && cursors[heap.top()].key() == node_id) {
+            size_t i = heap.top();
+            heap.pop();
+            if (!decided && cursors[i].type() != GraphNodeMeta::Type::kDelta) {
+                live = cursors[i].type() != GraphNodeMeta::Type::kTombstone;
+                decided = true;
+            }
+            cursors[i].Next();
+            if (cursors[i].Valid()) {
+                heap.push(i);
+            }
+        }
+
+        if (live) {
+            node_ids.push_back(std::move(node_id));
+        }
+    }
+
+    return node_ids;
+}
+
 void StorageEngine::_sanitize_prefix_for_node_id(std::string& prefix) const {
     // node classes are not more than 20 chars long
     if(prefix.size() > 20) {
@@ -348,7 +626,251 @@ bool StorageEngine::isActive() {
 }
 
 size_t StorageEngine::getActiveMemtableSize() {
-    return active_memtable_->size();
+    size_t size = 0;
+    for (const auto& shard : memtable_shards_) {
+        std::shared_lock<std::shared_mutex> lock(shard->mutex);
+        size += shard->active->size();
+    }
+    return size;
+}
+
+MemoryTracker::Snapshot StorageEngine::getMemoryUsage() const {
+    return memory_tracker_->snapshot();
+}
+
+const SSTableReadStats& StorageEngine::getSSTableReadStats() const {
+    return compaction_manager_->readStats();
+}
+
+const CompressionStats& StorageEngine::getCompressionStats() const {
+    return compaction_manager_->compressionStats();
+}
+
+const BlockCacheStats& StorageEngine::getBlockCacheStats() const {
+    return block_cache_->stats();
+}
+
+const CompactionStats& StorageEngine::getCompactionStats() const {
+    return compaction_manager_->compactionStats();
+}
+
+const ReplayStats& StorageEngine::getRecoveryStats() const {
+    return recovery_stats_;
+}
+
+const MergeLogStats& StorageEngine::getLogStats() const {
+    return merge_log_->stats();
+}
+
+uint64_t StorageEngine::getLogCheckpoint() const {
+    return compaction_manager_->logCheckpoint();
+}
+
+size_t StorageEngine::_shard_index(const std::string& node_id) const {
+    return std::hash<std::string>{}(node_id) % memtable_shards_.size();
+}
+
+StorageEngine::MemtableShard& StorageEngine::_shard_for(const std::string& node_id) const {
+    return *memtable_shards_[_shard_index(node_id)];
+}
+
+std::vector<std::shared_ptr<Memtable>> StorageEngine::_get_memtables(const std::string& node_id) const {
+    auto& shard = _shard_for(node_id);
+    std::shared_lock<std::shared_mutex> lock(shard.mutex);
+    std::vector<std::shared_ptr<Memtable>> memtables;
+    memtables.reserve(shard.old.size() + 1);
+    memtables.push_back(shard.active);
+    memtables.insert(memtables.end(), shard.old.rbegin(), shard.old.rend());
+    return memtables;
+}
+
+uint64_t StorageEngine::_write_to_memtable(const std::string& node_id, GraphNodeMeta& meta_node,
+                                           std::optional<uint64_t> logged) {
+    auto& shard = _shard_for(node_id);
+    std::shared_ptr<Memtable> memtable;
+    {
+        // shared: any number of writers insert concurrently, only a
+        // rotation of this shard has to wait for them. logged under it, so
+        // a checkpoint finds every logged record in a memtable or on disc
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        if (!logged) {
+            logged = merge_log_->add(node_id, meta_node);
+        }
+        memtable = shard.active;
+        memtable->markLogged(*logged);
+        memtable->insert(node_id, meta_node);
+    }
+
+    if (memtable->is_full()) {
+        _rotate_memtable(shard, memtable);
+    }
+
+    _enforce_memory_budget();
+    _enforce_log_limit(*logged);
+    return *logged;
+}
+
+void StorageEngine::_replay_log() {
+    // partitioned like the memtables: every shard is refilled by one thread
+    // and a node's records come back in the order they were logged. what
+    // the checkpoint covers is in SSTables already
+    uint64_t checkpoint = compaction_manager_->logCheckpoint();
+    replaying_ = true;
+    recovery_stats_ = durability_manager_->replayLog(
+        merge_log_->directory(), checkpoint, memtable_shards_.size(),
+        std::bind(&StorageEngine::_shard_index, this, std::placeholders::_1),
+        [this](size_t, const LogRecord& record) {
+            GraphNodeMeta meta_node = record.meta;
+            _write_to_memtable(record.key, meta_node, record.end_position);
+            if (meta_node.get_type() == GraphNodeMeta::Type::kNode && !node_id_index_->exists(record.key)) {
+                node_id_index_->insert(record.key);
+            } else if (meta_node.get_type() == GraphNodeMeta::Type::kTombstone && node_id_index_->exists(record.key)) {
+                node_id_index_->remove(record.key);
+            }
+        });
+    replaying_ = false;
+
+    // segments a crash kept from being removed at their checkpoint, and
+    // the ones the flushes during replay covered
+    merge_log_->removeSegments(checkpoint);
+    _checkpoint_log();
+}
+
+void StorageEngine::_rotate_memtable(MemtableShard& shard, const std::shared_ptr<Memtable>& full_memtable) {
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+
+    // another writer got here first
+    if (shard.active != full_memtable) {
+        return;
+    }
+
+    // write stall: flushing can't keep up, hold writers until one finishes.
+    // the full memtable keeps taking writes from anyone not stalled here
+    shard.flushed.wait(lock, [this, &shard, &full_memtable]() {
+        return shard.old.size() < config_.max_immutable_memtables
+            || shard.active != full_memtable;
+    });
+    if (shard.active != full_memtable) {
+        return;
+    }
+
+    full_memtable->freeze();
+    shard.old.push_back(full_memtable);
+    shard.active = std::make_shared<Memtable>(shard_memtable_size_, memory_tracker_.get());
+    flushing_manager_->schedule(full_memtable);
+    lock.unlock();
+
+    // the disk write happens in the background, never on the writer
+    thread_pool_->submitTask(std::bind(&FlushingManager::run, flushing_manager_.get()));
+}
+
+void StorageEngine::_enforce_memory_budget() {
+    size_t total = memory_tracker_->total();
+    size_t budget = memory_tracker_->budget();
+    if (budget == 0 || total <= budget) {
+        return;
+    }
+
+    // the caches are the cheapest to give back, reads refill them
+    size_t excess = total - budget;
+    excess -= std::min(excess, object_cache_->evict(excess));
+    excess -= std::min(excess, block_cache_->evict(excess));
+    if (excess == 0) {
+        return;
+    }
+
+    // then the memtables: rotate the biggest active one out, its arena is
+    // released as soon as it is on disc
+    MemtableShard* largest = nullptr;
+    std::shared_ptr<Memtable> victim;
+    for (auto& shard : memtable_shards_) {
+        std::shared_lock<std::shared_mutex> lock(shard->mutex);
+        if (!victim || shard->active->size() > victim->size()) {
+            largest = shard.get();
+            victim = shard->active;
+        }
+    }
+
+    // a nearly empty memtable isn't worth an SSTable, the indexes are what
+    // is over budget then and only deletes shrink them
+    if (victim && victim->size() >= shard_memtable_size_ / 4) {
+        _rotate_memtable(*largest, victim);
+    }
+}
+
+void StorageEngine::_enforce_log_limit(uint64_t position) {
+    uint64_t checkpoint = compaction_manager_->logCheckpoint();
+    uint64_t limit = config_.max_wal_size;
+    if (limit == 0 || position <= checkpoint || position - checkpoint <= limit) {
+        return;
+    }
+
+    // the checkpoint is held back by the memtables with the oldest records,
+    // rotate the active ones of the older half of the log out to be flushed
+    for (auto& shard : memtable_shards_) {
+        std::shared_ptr<Memtable> memtable;
+        {
+            std::shared_lock<std::shared_mutex> lock(shard->mutex);
+            memtable = shard->active;
+        }
+        if (memtable->firstLogPosition() <= checkpoint + limit / 2) {
+            _rotate_memtable(*shard, memtable);
+        }
+    }
+}
+
+void StorageEngine::_checkpoint_log() {
+    // _replay_log takes one at the end, once every record is in a memtable
+    if (replaying_) {
+        return;
+    }
+
+    // every record ending before the oldest one still in a memtable is on
+    // disc. read first: a record logged after it can't end at or before it
+    uint64_t checkpoint = merge_log_->position();
+    for (auto& shard : memtable_shards_) {
+        // exclusive, no writer is between logging a record and inserting it
+        std::unique_lock<std::shared_mutex> lock(shard->mutex);
+        uint64_t first = shard->active->firstLogPosition();
+        for (const auto& memtable : shard->old) {
+            first = std::min(first, memtable->firstLogPosition());
+        }
+        if (first != UINT64_MAX) {
+            checkpoint = std::min(checkpoint, first - 1);
+        }
+    }
+
+    if (checkpoint > compaction_manager_->logCheckpoint()) {
+        compaction_manager_->setLogCheckpoint(checkpoint);
+        merge_log_->removeSegments(checkpoint);
+    }
+}
+
+void StorageEngine::_on_memtable_flushed(const std::shared_ptr<Memtable>& memtable) {
+    for (auto& shard : memtable_shards_) {
+        bool retired = false;
+        {
+            std::unique_lock<std::shared_mutex> lock(shard->mutex);
+            auto it = std::find(shard->old.begin(), shard->old.end(), memtable);
+            if (it != shard->old.end()) {
+                shard->old.erase(it);
+                retired = true;
+            }
+        }
+        if (retired) {
+            shard->flushed.notify_all();
+            _checkpoint_log();
+            return;
+        }
+    }
+}
+
+void StorageEngine::_on_node_data_released(const std::string& data_id) {
+    try {
+        node_data_index_->remove(data_id);
+    } catch (const std::invalid_argument&) {
+        // delete_node already dropped it
+    }
 }
 
 void StorageEngine::triggerCompaction() {
@@ -6,8 +6,12 @@
 
 #include "concurrency/thread_pool.h"
 #include "concurrency/lock_manager.h"
+#include "core/block_cache.h"
 #include "core/compaction_manager.h"
+#include "core/config.h"
 #include "core/graph_node.h"
+#include "core/io_backend.h"
+#include "core/memory_tracker.h"
 #include "core/memtable.h"
 #include "core/merge_log.h"
 #include "core/object_cache.h"
@@ -19,11 +23,17 @@
 #include "persistence/flushing_manager.h"
 #include "persistence/durability_manager.h"
 
+#include <atomic>
+#include <condition_variable>
 #include <memory>
+#include <optional>
+#include <shared_mutex>
 #include <string>
 #include <vector>
 
 
+class StorageEngineTest;
+
 namespace storage_engine {
 
 class StorageEngine {
@@ -41,6 +51,7 @@ public:
 
     // Constructor and destructor
     StorageEngine();
+    explicit StorageEngine(const EngineConfig& /* config */);
     ~StorageEngine();
 
     // can be only be moved but not copied
@@ -50,40 +61,106 @@ public:
     StorageEngine(const StorageEngine&) = delete;
     StorageEngine& operator=(const StorageEngine&) = delete;
 
+    // writes return once the write-ahead log holds them as durably as sync
+    // asks for, kDefault uses wal_sync_mode of the config. a new node's
+    // data is logged and flushed with its record
+    // throws std::runtime_error if the log can't be written, and
+    // std::invalid_argument if a record doesn't fit the log buffer
     // DEBUG: why is a template T (void *) required?
-    std::string create_node(std::vector<unsigned char>& /* node_data */ );
+    std::string create_node(std::vector<unsigned char>& /* node_data */, SyncMode /* sync */ = SyncMode::kDefault);
     void add_connection(
         const std::string& /* from_node_id */, 
-        const std::string& /* to_node_id */
+        const std::string& /* to_node_id */,
+        SyncMode /* sync */ = SyncMode::kDefault
         );
-    void delete_connection(const std::string& /* from_node_id */, const std::string& /* to_node_id */);
-    void delete_node(std::string /* node_id */);
+    void delete_connection(const std::string& /* from_node_id */, const std::string& /* to_node_id */,
+                           SyncMode /* sync */ = SyncMode::kDefault);
+    void delete_node(std::string /* node_id */, SyncMode /* sync */ = SyncMode::kDefault);
+    // throws std::invalid_argument if the node doesn't exist, and
+    // std::runtime_error if its record is missing or carries no data
     GraphNodeData<void*> get_node_data(const std::string& /* node_id */);
+    // get_node_data() of many nodes, in the order given. the ones only on
+    // disk are looked up together so their block reads overlap
+    // throws like get_node_data()
+    std::vector<GraphNodeData<void*>> get_nodes_data(const std::vector<std::string>& /* node_ids */);
+    bool node_exists(const std::string& /* node_id */) const;
 
     // throws std::invalid_argument
     std::vector<std::string> match_connections(std::string /* node_id */, std::string /* condition */);
 
     bool isActive();
     size_t getActiveMemtableSize();
+    // bytes held by memtables, cache and indexes against the memory budget
+    MemoryTracker::Snapshot getMemoryUsage() const;
+    // bloom filter and block read counters of lookups that reached SSTables
+    const SSTableReadStats& getSSTableReadStats() const;
+    // block bytes before and after compression, written and read
+    const CompressionStats& getCompressionStats() const;
+    // hits, misses and evictions of the SSTable block cache
+    const BlockCacheStats& getBlockCacheStats() const;
+    // compactions run, bytes they reclaimed and the deletes they dropped
+    const CompactionStats& getCompactionStats() const;
+    // what replaying the write-ahead log did when the engine was opened
+    const ReplayStats& getRecoveryStats() const;
+    // bytes and segments written to the write-ahead log, and its syncs
+    const MergeLogStats& getLogStats() const;
+    // log position up to which every record is in an SSTable, a crash
+    // replays only what comes after it
+    uint64_t getLogCheckpoint() const;
     void triggerCompaction();
+    // flush the memtables rotated out so far, returns once they are on
+    // disc and the log is checkpointed past them. flushes run one at a
+    // time, so this waits for any already in flight
     void triggerFlush();
 private:
-    // in the initial implementation we will have only 1 memtable which
-    // shall be extended to multiple threads and multiple memtables each
-    // thread will be owner of 1 memtabke. zero contention with the shared
-    // northing architecture. reads can be concurrent across multiple threads
-    // as they are safe. no writes happen to the segment going to be read
-    
-    // active memtable, to which all writes should go
-    std::unique_ptr<Memtable> active_memtable_;
-
-    // list of inactive memtables
-    std::vector<Memtable*> old_memtables_;
-
-    // a merge blog which shall have a buffer, all writes will be flushed to disc
-    // from the buffer asynchronously. would be batched to be faster.
+    // the unit tests exercise some of the private helpers
+    friend class ::StorageEngineTest;
+
+    // the write path is split into shards, each with its own active memtable,
+    // its own list of rotated memtables and its own lock. node ids hash to a
+    // shard, so writers on different nodes never contend and a point read
+    // only looks at one shard. reads are concurrent with writes, no writes
+    // happen to the segment going to be read
+    struct MemtableShard {
+        // active memtable, to which all writes of this shard go
+        std::shared_ptr<Memtable> active;
+
+        // list of inactive memtables, oldest first. they are frozen and
+        // waiting on the flushing manager, reads still go through them
+        std::vector<std::shared_ptr<Memtable>> old;
+
+        // writers hold this shared while inserting into the active memtable,
+        // swapping it out (rotation) or dropping a flushed one takes it exclusive
+        mutable std::shared_mutex mutex;
+
+        // signalled whenever a flush retires an old memtable (ends write stalls)
+        std::condition_variable_any flushed;
+    };
+
+    EngineConfig config_;
+
+    // byte accounting of everything below that lives in memory. declared
+    // before them so it outlives whatever still charges to it
+    std::unique_ptr<MemoryTracker> memory_tracker_;
+
+    std::vector<std::unique_ptr<MemtableShard>> memtable_shards_;
+
+    // size limit of each shard's memtable, memtable_size split across shards
+    size_t shard_memtable_size_;
+
+    // write-ahead log of every memtable write, in <data_directory>/wal.
+    // writers append to its ring buffer and, depending on their sync
+    // mode, wait for the log thread's group commit before returning
     std::unique_ptr<MergeLog> merge_log_;
 
+    // uncompressed SSTable blocks, shared by every reader. declared before
+    // the compaction manager whose readers point at it
+    std::unique_ptr<BlockCache> block_cache_;
+
+    // batched SSTable block reads (io_uring, or pread threads), also
+    // pointed at by the readers
+    std::unique_ptr<IOBackend> io_backend_;
+
     // SSTables are compacted while in disc to reduce the amount of blocks
     // fetched during a read operation
     std::unique_ptr<CompactionManager> compaction_manager_;
@@ -115,19 +192,65 @@ private:
     // handles merge logs and writing it to disc
     std::unique_ptr<DurabilityManager> durability_manager_;
 
+    // of the log replay that brought the memtables back on open
+    ReplayStats recovery_stats_;
+
+    // set while the log is replayed: the records not replayed yet are in
+    // no memtable, a flush must not checkpoint past them
+    std::atomic<bool> replaying_{false};
+
     // wether this object is active (ready receiving reads/writes) or not
     bool is_active;
 
     std::vector<std::string> _get_all_connections(const std::string& /* node_id */);
+    // node ids starting with prefix in sorted order, from a merged scan of
+    // every memtable. flushed nodes are not covered yet, SSTables can't be
+    // scanned in order
     std::vector<std::string> _match_nodeid_with_prefix(std::string /* prefix */);
     std::vector<std::string> _get_connections(const std::string& /* node_id */, const std::string& /* prefix_node */);
     std::vector<std::string> _get_connections_from_cache(const std::string& /* node_id */, const std::string& /* prefix_node */, uint8_t& /* cache_error */);
-    std::vector<std::string> _get_connections_from_active_memtable(std::string /* node_id */, std::string /* node_prefix */);
-    std::vector<std::string> _get_connections_from_old_memtables(std::string /* node_id */, std::string /* node_prefix */);
+    // node records of the memtables folded newest over oldest, nullptr if
+    // no memtable has the node. a delta result means older data is on disk
+    std::shared_ptr<GraphNodeMeta> _resolve_node_meta(const std::string& /* node_id */);
+    // payload of a full node record, from the data index while it is
+    // there and from the record itself otherwise
+    // throws std::runtime_error if the record carries no payload
+    GraphNodeData<void*> _get_node_payload(const std::string& /* node_id */, const GraphNodeMeta& /* meta */);
     std::vector<std::string> _get_connections_from_sstables(std::string /* node_id */, std::string /* node_prefix */);
-    std::string _create_node(const GraphNodeData<void*>& );
+    std::string _create_node(const GraphNodeData<void*>& , SyncMode /* sync */);
+    // wait on the log for a write that ends at position
+    void _commit_log(uint64_t /* position */, SyncMode /* sync */);
+
+    size_t _shard_index(const std::string& /* node_id */) const;
+    MemtableShard& _shard_for(const std::string& /* node_id */) const;
+    // memtables of the node's shard: active first, then old newest to oldest
+    std::vector<std::shared_ptr<Memtable>> _get_memtables(const std::string& /* node_id */) const;
+    // log the record, unless it comes with the log position of a record
+    // replayed, and insert it. returns the log position just past it
+    uint64_t _write_to_memtable(const std::string& /* node_id */, GraphNodeMeta& /* meta_node */,
+                                std::optional<uint64_t> /* logged */ = std::nullopt);
+    void _rotate_memtable(MemtableShard& /* shard */, const std::shared_ptr<Memtable>& /* full_memtable */);
+    // over the memory budget: evict from the object cache first, then
+    // rotate the biggest memtable out to be flushed
+    void _enforce_memory_budget();
+    // over max_wal_size past the checkpoint: rotate out the memtables
+    // holding the oldest records, so the checkpoint can move on
+    void _enforce_log_limit(uint64_t /* position */);
+    // record in the manifest how much of the log is covered by SSTables,
+    // and delete the segments that are
+    void _checkpoint_log();
+    void _on_memtable_flushed(const std::shared_ptr<Memtable>& /* memtable */);
+    // rotate and flush every memtable, stop the background work and sync
+    // the log. the destructor and move assignment run it before letting
+    // go of the members, a moved-from engine has nothing to shut down
+    void _shutdown();
+    // a compaction dropped the last record pointing at this payload
+    void _on_node_data_released(const std::string& /* data_id */);
+    // put the records of the write-ahead log back into the memtables and
+    // the node id index, one thread per shard
+    void _replay_log();
 
-    void _insert_connection(const std::string& /* from_node_id */, const std::string& /* to_node_id */, unsigned char /* flag_byte */);
+    void _insert_connection(const std::string& /* from_node_id */, const std::string& /* to_node_id */, unsigned char /* flag_byte */, SyncMode /* sync */);
     void _sanitize_prefix_for_node_id(std::string& /* prefix */) const;
 };
 
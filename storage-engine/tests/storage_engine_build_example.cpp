@@ -3,7 +3,9 @@
 #include <chrono>
 #include <random>
 #include <algorithm>
-#include "storage_engine.cpp"
+#include <filesystem>
+#include <thread>
+#include "storage_engine.h"
 
 // using namespace storage_engine;
 
@@ -19,7 +21,125 @@ std::string generate_random_string(size_t length) {
     return result;
 }
 
+// insert/get throughput of a single memtable as writer threads are added
+void benchmark_memtable_scaling(int ops_per_thread) {
+    std::cout << "Memtable Throughput (ops/sec):" << std::endl;
+
+    unsigned int max_threads = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned int num_threads = 1; num_threads <= max_threads; num_threads *= 2) {
+        storage_engine::Memtable memtable(SIZE_MAX);
+
+        auto run = [&](bool do_insert) {
+            std::vector<std::thread> threads;
+            auto start = std::chrono::high_resolution_clock::now();
+            for (unsigned int t = 0; t < num_threads; ++t) {
+                threads.emplace_back([&, t]() {
+                    storage_engine::GraphNodeMeta meta;
+                    meta.set_data_id("data");
+                    for (int i = 0; i < ops_per_thread; ++i) {
+                        std::string key = std::to_string(t) + "." + std::to_string(i);
+                        if (do_insert) {
+                            memtable.insert(key, meta);
+                        } else {
+                            memtable.get(key);
+                        }
+                    }
+                });
+            }
+            for (auto& thread : threads) {
+                thread.join();
+            }
+            std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+            return (num_threads * ops_per_thread) / elapsed.count();
+        };
+
+        double insert_ops = run(true);
+        double get_ops = run(false);
+        std::cout << "Threads: " << num_threads << ", Insert: " << insert_ops << ", Get: " << get_ops << std::endl;
+    }
+}
+
+// engine write throughput (create_node + add_connection) as writer threads
+// are added, every thread works on its own nodes
+void benchmark_engine_write_scaling(int nodes_per_thread) {
+    std::cout << "Engine Write Throughput (ops/sec):" << std::endl;
+
+    unsigned int max_threads = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned int num_threads = 1; num_threads <= max_threads; num_threads *= 2) {
+        storage_engine::StorageEngine engine;
+
+        std::vector<std::thread> threads;
+        auto start = std::chrono::high_resolution_clock::now();
+        for (unsigned int t = 0; t < num_threads; ++t) {
+            threads.emplace_back([&engine, nodes_per_thread]() {
+                std::vector<unsigned char> node_data = {'d', 'a', 't', 'a'};
+                std::string previous = engine.create_node(node_data);
+                for (int i = 1; i < nodes_per_thread; ++i) {
+                    std::string current = engine.create_node(node_data);
+                    engine.add_connection(previous, current);
+                    previous = current;
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+
+        // one create and one connection per node (minus the first)
+        double ops = num_threads * (2.0 * nodes_per_thread - 1) / elapsed.count();
+        std::cout << "Threads: " << num_threads << ", Writes: " << ops << std::endl;
+    }
+}
+
+// latency of single writes under each write-ahead log sync mode, writes
+// alternate between creating a node and connecting it to the one before
+void benchmark_write_latency_by_sync_mode(int ops) {
+    std::cout << "Write Latency by Sync Mode (microseconds):" << std::endl;
+
+    const std::pair<const char*, storage_engine::SyncMode> modes[] = {
+        {"sync", storage_engine::SyncMode::kSync},
+        {"periodic", storage_engine::SyncMode::kPeriodic},
+        {"async", storage_engine::SyncMode::kAsync},
+    };
+    for (const auto& mode : modes) {
+        storage_engine::EngineConfig config;
+        config.data_directory = std::string("./bench_sync_") + mode.first;
+        config.wal_sync_mode = mode.second;
+        config.flush_interval = 1000;
+        std::filesystem::remove_all(config.data_directory);
+
+        std::vector<double> latencies;
+        latencies.reserve(ops);
+        {
+            storage_engine::StorageEngine engine(config);
+            std::vector<unsigned char> node_data = {'d', 'a', 't', 'a'};
+            std::string previous = engine.create_node(node_data);
+            for (int i = 0; i < ops; ++i) {
+                auto start = std::chrono::high_resolution_clock::now();
+                if (i % 2 == 0) {
+                    engine.add_connection(previous, previous);
+                } else {
+                    previous = engine.create_node(node_data);
+                }
+                std::chrono::duration<double, std::micro> elapsed = std::chrono::high_resolution_clock::now() - start;
+                latencies.push_back(elapsed.count());
+            }
+        }
+        std::filesystem::remove_all(config.data_directory);
+
+        std::sort(latencies.begin(), latencies.end());
+        auto percentile = [&](double p) { return latencies[static_cast<size_t>(latencies.size() * p)]; };
+        std::cout << "Mode: " << mode.first << ", P50: " << percentile(0.50) << ", P90: " << percentile(0.90)
+                  << ", P99: " << percentile(0.99) << ", P99.9: " << percentile(0.999) << std::endl;
+    }
+}
+
 int main() {
+    benchmark_memtable_scaling(100000);
+    benchmark_engine_write_scaling(20000);
+    benchmark_write_latency_by_sync_mode(20000);
+
     storage_engine::StorageEngine engine;
 
     const int num_nodes = 10000;
@@ -28,21 +148,26 @@ int main() {
     std::vector<std::chrono::duration<double>> node_creation_times;
     std::vector<std::chrono::duration<double>> connection_creation_times;
 
+    std::vector<std::string> node_ids;
+    std::default_random_engine generator;
+    std::uniform_int_distribution<int> pick(0, num_nodes - 1);
+
     // Generate and insert nodes
     for (int i = 0; i < num_nodes; ++i) {
-        std::vector<unsigned char> node_data(generate_random_string(10).begin(), generate_random_string(10).end());
+        std::string random_data = generate_random_string(10);
+        std::vector<unsigned char> node_data(random_data.begin(), random_data.end());
 
         auto start = std::chrono::high_resolution_clock::now();
-        engine.create_node(node_data);  // Ensure create_node implementation
+        node_ids.push_back(engine.create_node(node_data));
         auto end = std::chrono::high_resolution_clock::now();
 
         node_creation_times.push_back(end - start);
     }
 
-    // Generate and insert connections
+    // Generate and insert connections between existing nodes
     for (int i = 0; i < num_connections; ++i) {
-        std::string from_node_id = generate_random_string(10);  // Ensure proper node ID generation
-        std::string to_node_id = generate_random_string(10);
+        const std::string& from_node_id = node_ids[pick(generator)];
+        const std::string& to_node_id = node_ids[pick(generator)];
 
         auto start = std::chrono::high_resolution_clock::now();
         engine.add_connection(from_node_id, to_node_id);  // Ensure add_connection implementation
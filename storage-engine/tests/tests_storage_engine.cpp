@@ -1,11 +1,37 @@
 #include <gtest/gtest.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <thread>
 #include "storage_engine.h"
 
 using namespace storage_engine;
 
 class StorageEngineTest : public ::testing::Test {
 protected:
-    StorageEngine engine;
+    // every test starts empty, the engine would replay the log of the last one
+    static EngineConfig freshConfig() {
+        EngineConfig config;
+        config.data_directory = "./test_engine_data";
+        std::filesystem::remove_all(config.data_directory);
+        return config;
+    }
+
+    StorageEngine engine{freshConfig()};
+
+    // private helpers of the engine under test, the fixture is its friend
+    std::vector<std::string> matchNodeIdWithPrefix(const std::string& prefix) {
+        return engine._match_nodeid_with_prefix(prefix);
+    }
+    void sanitizePrefix(std::string& prefix) {
+        engine._sanitize_prefix_for_node_id(prefix);
+    }
 
     void SetUp() override {
         // Any setup needed before each test
@@ -22,7 +48,7 @@ TEST_F(StorageEngineTest, CreateNode) {
     std::string node_id = engine.create_node(node_data);
     
     ASSERT_FALSE(node_id.empty());
-    ASSERT_TRUE(engine.node_id_index_->exists(node_id)); // Assuming node_id_index_ is accessible for testing
+    ASSERT_TRUE(engine.node_exists(node_id));
 }
 
 // Test connection addition
@@ -56,6 +82,48 @@ TEST_F(StorageEngineTest, DeleteConnection) {
     ASSERT_EQ(std::find(connections.begin(), connections.end(), node2_id), connections.end());
 }
 
+// Test a second connection from the same node doesn't replace the first
+TEST_F(StorageEngineTest, ConnectionsAccumulate) {
+    std::vector<unsigned char> node_data = {'n', 'o', 'd', 'e'};
+    std::string from_id = engine.create_node(node_data);
+    std::string first_id = engine.create_node(node_data);
+    std::string second_id = engine.create_node(node_data);
+    std::string third_id = engine.create_node(node_data);
+
+    engine.add_connection(from_id, first_id);
+    engine.add_connection(from_id, second_id);
+    engine.add_connection(from_id, third_id);
+    engine.delete_connection(from_id, second_id);
+
+    auto connections = engine.match_connections(from_id, "");
+    ASSERT_EQ(connections.size(), 2);
+    ASSERT_NE(std::find(connections.begin(), connections.end(), first_id), connections.end());
+    ASSERT_NE(std::find(connections.begin(), connections.end(), third_id), connections.end());
+
+    // the edge deltas must not hide the node's data pointer
+    ASSERT_NO_THROW(engine.get_node_data(from_id));
+}
+
+// Test the prefix scan over the memtables skips deleted nodes
+TEST_F(StorageEngineTest, MatchNodeIdWithPrefix) {
+    std::vector<unsigned char> node_data = {'n', 'o', 'd', 'e'};
+    std::vector<std::string> node_ids;
+    for (int i = 0; i < 20; ++i) {
+        node_ids.push_back(engine.create_node(node_data));
+    }
+    engine.delete_node(node_ids[0]);
+
+    std::string prefix = node_ids[1].substr(0, 1);
+    auto matched = matchNodeIdWithPrefix(prefix);
+    ASSERT_TRUE(std::is_sorted(matched.begin(), matched.end()));
+    ASSERT_NE(std::find(matched.begin(), matched.end(), node_ids[1]), matched.end());
+    ASSERT_EQ(std::find(matched.begin(), matched.end(), node_ids[0]), matched.end());
+    for (const auto& node_id : matched) {
+        ASSERT_EQ(node_id.compare(0, prefix.size(), prefix), 0);
+    }
+    ASSERT_EQ(matchNodeIdWithPrefix("").size(), 19);
+}
+
 // Test error when adding connection with non-existent nodes
 TEST_F(StorageEngineTest, AddConnectionWithNonExistentNodes) {
     EXPECT_THROW(engine.add_connection("non_existent_1", "non_existent_2"), std::invalid_argument);
@@ -69,13 +137,13 @@ TEST_F(StorageEngineTest, DeleteNonExistentNode) {
 // Test sanitization of prefix for node IDs
 TEST_F(StorageEngineTest, SanitizePrefix) {
     std::string valid_prefix = "valid";
-    EXPECT_NO_THROW(engine._sanitize_prefix_for_node_id(valid_prefix));
+    EXPECT_NO_THROW(sanitizePrefix(valid_prefix));
     
     std::string invalid_prefix = "invalid123";
-    EXPECT_THROW(engine._sanitize_prefix_for_node_id(invalid_prefix), std::invalid_argument);
+    EXPECT_THROW(sanitizePrefix(invalid_prefix), std::invalid_argument);
     
     invalid_prefix = "invalid@prefix";
-    EXPECT_THROW(engine._sanitize_prefix_for_node_id(invalid_prefix), std::invalid_argument);
+    EXPECT_THROW(sanitizePrefix(invalid_prefix), std::invalid_argument);
 }
 
 // Test active state of the storage engine
@@ -89,6 +157,1622 @@ TEST_F(StorageEngineTest, GetActiveMemtableSize) {
     ASSERT_GE(size, 0); // Size should never be negative
 }
 
+// Test the arena aligns what asks for it, gives big requests a block of
+// their own without giving up the current one, and charges every block it
+// reserves to the tracker until reset() or its destructor hands them back
+TEST(ArenaTest, AlignmentSpillAndAccounting) {
+    MemoryTracker tracker;
+    {
+        Arena arena(&tracker);
+        const size_t block = arena.memoryUsage();
+        ASSERT_GT(block, 0);
+        ASSERT_EQ(tracker.usage(MemoryTracker::Component::kMemtables), block);
+
+        for (size_t bytes : {1, 3, 7, 24, 100}) {
+            arena.allocate(bytes);  // unaligned bytes in between
+            char* mem = arena.allocateAligned(bytes);
+            ASSERT_EQ(reinterpret_cast<uintptr_t>(mem) % alignof(std::max_align_t), 0);
+        }
+        ASSERT_EQ(std::string(arena.copy("payload", 7), 7), "payload");
+        ASSERT_EQ(arena.memoryUsage(), block);
+
+        // spills into a block of its own, the current one keeps serving
+        const size_t big = 100000;
+        char* spilled = arena.allocateAligned(big);
+        std::memset(spilled, 'x', big);
+        size_t after_spill = arena.memoryUsage();
+        ASSERT_GE(after_spill, block + big);
+        arena.allocateAligned(64);
+        ASSERT_EQ(arena.memoryUsage(), after_spill);
+
+        // small ones fill the current block, then a new one is started
+        std::vector<char*> chunks;
+        for (int i = 0; i < 100; ++i) {
+            chunks.push_back(arena.allocate(1024));
+            std::memset(chunks.back(), i, 1024);
+        }
+        ASSERT_GT(arena.memoryUsage(), after_spill);
+        for (int i = 0; i < 100; ++i) {
+            ASSERT_EQ(chunks[i][0], static_cast<char>(i));
+            ASSERT_EQ(chunks[i][1023], static_cast<char>(i));
+        }
+        ASSERT_EQ(spilled[big - 1], 'x');
+        ASSERT_EQ(tracker.usage(MemoryTracker::Component::kMemtables), arena.memoryUsage());
+
+        arena.reset();
+        ASSERT_EQ(arena.memoryUsage(), block);
+        ASSERT_EQ(tracker.usage(MemoryTracker::Component::kMemtables), block);
+    }
+    ASSERT_EQ(tracker.usage(MemoryTracker::Component::kMemtables), 0);
+}
+
+// Test concurrent writers get disjoint, aligned memory from one arena and
+// skiplist nodes carved from it stay linked in key order
+TEST(ArenaTest, ConcurrentAllocationsAndSkipListNodes) {
+    Arena arena;
+    const int num_threads = 4;
+    const int per_thread = 2000;
+    std::vector<std::vector<uint64_t*>> owned(num_threads);
+    std::vector<std::thread> writers;
+    for (int t = 0; t < num_threads; ++t) {
+        writers.emplace_back([&arena, &owned, t]() {
+            for (int i = 0; i < per_thread; ++i) {
+                auto* mem = reinterpret_cast<uint64_t*>(arena.allocateAligned(sizeof(uint64_t) * (1 + i % 8)));
+                *mem = static_cast<uint64_t>(t) * per_thread + i;
+                owned[t].push_back(mem);
+            }
+        });
+    }
+    for (auto& writer : writers) {
+        writer.join();
+    }
+    for (int t = 0; t < num_threads; ++t) {
+        for (int i = 0; i < per_thread; ++i) {
+            ASSERT_EQ(reinterpret_cast<uintptr_t>(owned[t][i]) % alignof(std::max_align_t), 0);
+            ASSERT_EQ(*owned[t][i], static_cast<uint64_t>(t) * per_thread + i);
+        }
+    }
+
+    using List = SkipList<int, int>;
+    size_t before = arena.memoryUsage();
+    List list(&arena);
+    const int keys = 5000;
+    for (int i = 0; i < keys; ++i) {
+        int key = (i * 7919) % keys;  // every key once, out of order
+        auto inserted = list.insert(key);
+        ASSERT_TRUE(inserted.second);
+        ASSERT_EQ(reinterpret_cast<uintptr_t>(inserted.first) % alignof(List::Node), 0);
+        inserted.first->value = key * 2;
+    }
+    ASSERT_FALSE(list.insert(42).second);
+    ASSERT_GT(arena.memoryUsage(), before);  // the nodes took new blocks
+
+    int expected = 0;
+    List::Iterator it(&list);
+    for (it.SeekToFirst(); it.Valid(); it.Next()) {
+        ASSERT_EQ(it.key(), expected);
+        ASSERT_EQ(it.node()->value, expected * 2);
+        ++expected;
+    }
+    ASSERT_EQ(expected, keys);
+    ASSERT_EQ(list.find(keys), nullptr);
+    ASSERT_EQ(list.find(keys - 1)->value, (keys - 1) * 2);
+}
+
+// Test concurrent writers on one memtable keep every key, in sorted order
+TEST(MemtableTest, ConcurrentInsertsAreSorted) {
+    Memtable memtable(SIZE_MAX);
+    const int num_threads = 4;
+    const int per_thread = 1000;
+
+    std::vector<std::thread> writers;
+    for (int t = 0; t < num_threads; ++t) {
+        writers.emplace_back([&memtable, t]() {
+            for (int i = 0; i < per_thread; ++i) {
+                GraphNodeMeta meta;
+                meta.set_data_id(std::to_string(i));
+                memtable.insert(std::to_string(t) + "_" + std::to_string(i), meta);
+            }
+        });
+    }
+    for (auto& writer : writers) {
+        writer.join();
+    }
+
+    ASSERT_EQ(memtable.count(), num_threads * per_thread);
+    std::vector<std::string> keys;
+    for (auto it = memtable.newIterator(); it.Valid(); it.Next()) {
+        keys.emplace_back(it.key());
+    }
+    ASSERT_EQ(keys.size(), num_threads * per_thread);
+    ASSERT_TRUE(std::is_sorted(keys.begin(), keys.end()));
+    ASSERT_EQ(memtable.get("3_999")->get_data_id(), "999");
+}
+
+// Test iterator seeks, stays inside its prefix and ignores later writes
+TEST(MemtableTest, IteratorSeekPrefixAndSnapshot) {
+    Memtable memtable(SIZE_MAX);
+    for (const std::string key : {"apple", "banana", "bandana", "band", "cherry"}) {
+        GraphNodeMeta meta;
+        meta.set_data_id(key);
+        memtable.insert(key, meta);
+    }
+
+    auto it = memtable.newIterator("ban");
+    std::vector<std::string> keys;
+    for (; it.Valid(); it.Next()) {
+        keys.emplace_back(it.key());
+    }
+    ASSERT_EQ(keys, std::vector<std::string>({"banana", "band", "bandana"}));
+
+    auto snapshot = memtable.newIterator();
+    GraphNodeMeta delta;
+    delta.set_type(GraphNodeMeta::Type::kDelta);
+    delta.add_connection("cherry", '1');
+    memtable.insert("band", delta);
+    GraphNodeMeta added;
+    memtable.insert("blueberry", added);
+
+    snapshot.Seek("b");
+    ASSERT_EQ(snapshot.key(), "banana");
+    snapshot.Seek("band");
+    ASSERT_EQ(snapshot.key(), "band");
+    ASSERT_EQ(snapshot.type(), GraphNodeMeta::Type::kNode);
+    ASSERT_TRUE(snapshot.value().get_connections().empty());
+    snapshot.Next();
+    snapshot.Next();
+    ASSERT_EQ(snapshot.key(), "cherry"); // blueberry came after the snapshot
+
+    auto latest = memtable.newIterator("band");
+    ASSERT_EQ(latest.value().get_connections().size(), 1);
+}
+
+// Test writes spread over memtable shards: each node's records go to one
+// shard so its deltas fold onto its node record, every shard rotates on its
+// own share of memtable_size, and reads find nodes whatever shard they're in
+TEST(StorageEngineRotationTest, ShardedMemtables) {
+    EngineConfig config;
+    config.data_directory = "./test_shard_data";
+    config.memtable_shards = 4;
+    config.memtable_size = 4 * 4096;
+    std::filesystem::remove_all(config.data_directory);
+    {
+        StorageEngine engine(config);
+        std::vector<unsigned char> node_data = {'n', 'o', 'd', 'e'};
+        std::vector<std::string> node_ids;
+        for (int i = 0; i < 1000; ++i) {
+            node_ids.push_back(engine.create_node(node_data));
+        }
+        // no shard grows past its share by more than the record that filled it
+        ASSERT_LE(engine.getActiveMemtableSize(), config.memtable_size + config.memtable_shards * 1024);
+        engine.triggerFlush();
+        ASSERT_GT(engine.getLogCheckpoint(), 0);
+
+        // edges of one node, to nodes of every shard, interleaved with
+        // writes to the others so the shards keep rotating underneath
+        const std::string& hub = node_ids.back();
+        std::vector<std::string> expected;
+        for (size_t i = 0; i < 200; ++i) {
+            engine.add_connection(hub, node_ids[i]);
+            engine.add_connection(node_ids[i], hub);
+            if (i % 3 == 0) {
+                engine.delete_connection(hub, node_ids[i]);
+            } else {
+                expected.push_back(node_ids[i]);
+            }
+        }
+        auto connections = engine.match_connections(hub, "");
+        std::sort(connections.begin(), connections.end());
+        std::sort(expected.begin(), expected.end());
+        ASSERT_EQ(connections, expected);
+        for (size_t i = 0; i < 200; ++i) {
+            ASSERT_EQ(engine.match_connections(node_ids[i], ""), std::vector<std::string>{hub});
+        }
+        ASSERT_EQ(engine.get_nodes_data(node_ids).size(), node_ids.size());
+    }
+    ASSERT_FALSE(std::filesystem::is_empty(config.data_directory));
+    std::filesystem::remove_all(config.data_directory);
+}
+
+// Test move assignment shuts the old engine down onto its disc before
+// taking over the other one, whose tables, flushes and log it keeps
+TEST(StorageEngineRotationTest, MoveAssignment) {
+    const std::string directory = "./test_move";
+    std::filesystem::remove_all(directory);
+    EngineConfig config;
+    config.memtable_shards = 1;
+    config.memtable_size = 4096;
+    std::vector<unsigned char> node_data = {'n', 'o', 'd', 'e'};
+    std::string replaced, moved;
+    std::vector<std::string> node_ids;
+    {
+        config.data_directory = directory + "/replaced";
+        StorageEngine engine(config);
+        replaced = engine.create_node(node_data);
+
+        config.data_directory = directory + "/moved";
+        StorageEngine other(config);
+        moved = other.create_node(node_data);
+        engine = std::move(other);
+        ASSERT_TRUE(engine.node_exists(moved));
+        ASSERT_FALSE(engine.node_exists(replaced));
+
+        // rotations flush into the tables taken over, and retire through
+        // callbacks bound to this engine
+        for (int i = 0; i < 200; ++i) {
+            node_ids.push_back(engine.create_node(node_data));
+        }
+        engine.triggerFlush();
+        ASSERT_GT(engine.getLogCheckpoint(), 0);
+        ASSERT_GT(engine.getCompressionStats().bytes_out, 0);
+        ASSERT_EQ(engine.get_nodes_data(node_ids).size(), node_ids.size());
+        ASSERT_NO_THROW(engine.get_node_data(moved));
+    }
+
+    config.data_directory = directory + "/replaced";
+    {
+        StorageEngine engine(config);
+        ASSERT_TRUE(engine.node_exists(replaced));
+    }
+    config.data_directory = directory + "/moved";
+    {
+        StorageEngine engine(config);
+        ASSERT_TRUE(engine.node_exists(moved));
+        for (const auto& node_id : node_ids) {
+            ASSERT_TRUE(engine.node_exists(node_id));
+        }
+    }
+    std::filesystem::remove_all(directory);
+}
+
+// Test a full memtable is rotated and flushed instead of failing writes
+TEST(StorageEngineRotationTest, RotatesFullMemtable) {
+    EngineConfig config;
+    config.data_directory = "./test_rotation_data";
+    config.memtable_size = 4096;
+    {
+        StorageEngine engine(config);
+        std::vector<std::string> node_ids;
+        for (int i = 0; i < 1000; ++i) {
+            std::vector<unsigned char> node_data = {'n', 'o', 'd', 'e'};
+            ASSERT_NO_THROW(node_ids.push_back(engine.create_node(node_data)));
+        }
+        ASSERT_LE(engine.getActiveMemtableSize(), config.memtable_size + 1024);
+    }
+    ASSERT_FALSE(std::filesystem::is_empty(config.data_directory));
+    std::filesystem::remove_all(config.data_directory);
+}
+
+// Test a lookup finds every key across many data blocks and misses cleanly
+TEST(SSTableTest, BlockIndexLookup) {
+    const std::string filename = "./test_block_index.sst";
+    SSTableOptions options;
+    options.block_size = 256;
+    options.bloom_bits_per_key = 0;
+    options.compression = CompressionType::kNone; // the size check counts raw blocks
+    SSTable table(options);
+    for (int i = 0; i < 1000; ++i) {
+        char key[16];
+        std::snprintf(key, sizeof(key), "node_%05d", i * 2);
+        table.insert({key, std::make_shared<GraphNodeMeta>()});
+    }
+    table.writeToDisk(filename);
+
+    // same answers through pread and through the mapping
+    for (bool use_mmap : {false, true}) {
+        SSTableOptions read_options;
+        read_options.use_mmap = use_mmap;
+        SSTableReader reader(filename, read_options);
+        ASSERT_EQ(reader.isMapped(), use_mmap);
+        ASSERT_GT(reader.fileSize(), 20 * 256); // many blocks were cut
+
+        std::string scratch;
+        for (int i = 0; i < 2000; ++i) {
+            char key[16];
+            std::snprintf(key, sizeof(key), "node_%05d", i);
+            ASSERT_EQ(reader.getView(key, scratch).has_value(), i % 2 == 0) << key;
+        }
+        ASSERT_FALSE(reader.get("a").has_value());
+        ASSERT_FALSE(reader.get("zzz").has_value());
+    }
+
+    SSTable loaded;
+    std::ifstream in(filename, std::ios::binary);
+    loaded.deserialize(in);
+    ASSERT_NO_THROW(loaded.get("node_01998"));
+    std::filesystem::remove(filename);
+}
+
+// Test a block handle whose offset + size wraps around is rejected as
+// corrupted instead of passing the bounds check
+TEST(SSTableTest, RejectsOverflowingBlockHandle) {
+    const std::string filename = "./test_bad_handle.sst";
+    SSTable table;
+    table.insert({"node", std::make_shared<GraphNodeMeta>()});
+    table.writeToDisk(filename);
+
+    // footer: [filter offset][filter size][index offset][index size][magic]
+    std::string contents;
+    {
+        std::ifstream in(filename, std::ios::binary);
+        contents.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+    char* index = &contents[contents.size() - SSTable::kFooterSize + 2 * sizeof(uint64_t)];
+    std::string size;
+    Util::putFixed64(size, ~Util::decodeFixed64(index) + 1);  // offset + size == 0
+    contents.replace(index - contents.data() + sizeof(uint64_t), sizeof(uint64_t), size);
+    {
+        std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+        out << contents;
+    }
+
+    for (bool use_mmap : {false, true}) {
+        SSTableOptions options;
+        options.use_mmap = use_mmap;
+        ASSERT_THROW(SSTableReader(filename, options), std::runtime_error);
+    }
+    SSTable loaded;
+    std::ifstream in(filename, std::ios::binary);
+    ASSERT_THROW(loaded.deserialize(in), std::runtime_error);
+    std::filesystem::remove(filename);
+}
+
+// Test keys sharing a class prefix are stored once per restart interval
+TEST(SSTableTest, PrefixCompressedKeys) {
+    const std::string filename = "./test_prefix_keys.sst";
+    std::vector<std::string> keys;
+    for (int i = 0; i < 500; ++i) {
+        keys.push_back("person" + UUIDGenerator::generateUUID());
+    }
+
+    uint64_t sizes[2];
+    for (int restart_interval : {1, 16}) {
+        SSTableOptions options;
+        options.block_restart_interval = restart_interval;
+        options.bloom_bits_per_key = 0;
+        options.compression = CompressionType::kNone;
+        SSTable table(options);
+        for (const auto& key : keys) {
+            table.insert({key, std::make_shared<GraphNodeMeta>()});
+        }
+        table.writeToDisk(filename);
+
+        SSTableReader reader(filename, options);
+        for (const auto& key : keys) {
+            ASSERT_TRUE(reader.get(key).has_value()) << key;
+        }
+        ASSERT_FALSE(reader.get("person").has_value());
+        ASSERT_FALSE(reader.get("persoo").has_value());
+        sizes[restart_interval == 1 ? 0 : 1] = reader.fileSize();
+    }
+    ASSERT_LT(sizes[1], sizes[0] * 9 / 10);
+    std::filesystem::remove(filename);
+}
+
+// Test the bloom filter skips almost every absent key without a block read
+TEST(SSTableTest, BloomFilterSkipsAbsentKeys) {
+    const std::string filename = "./test_bloom_filter.sst";
+    SSTable table;
+    for (int i = 0; i < 1000; ++i) {
+        table.insert({"present_" + std::to_string(i), std::make_shared<GraphNodeMeta>()});
+    }
+    table.writeToDisk(filename);
+
+    SSTableReadStats stats;
+    SSTableReader reader(filename, SSTableOptions(), &stats);
+    for (int i = 0; i < 1000; ++i) {
+        ASSERT_TRUE(reader.get("present_" + std::to_string(i)).has_value());
+    }
+    ASSERT_EQ(stats.filter_skips, 0);
+
+    for (int i = 0; i < 10000; ++i) {
+        ASSERT_FALSE(reader.get("absent_" + std::to_string(i)).has_value());
+    }
+    ASSERT_EQ(stats.filter_checks, 11000);
+    ASSERT_EQ(stats.filter_skips + stats.filter_false_positives, 10000);
+    ASSERT_LT(stats.filter_false_positives, 300); // ~1% at 10 bits per key
+
+    // past the last key no block is read, a pass is still a false positive
+    for (int i = 0; i < 10000; ++i) {
+        ASSERT_FALSE(reader.get("zabsent_" + std::to_string(i)).has_value());
+    }
+    ASSERT_EQ(stats.filter_checks, 21000);
+    ASSERT_EQ(stats.filter_skips + stats.filter_false_positives, 20000);
+    ASSERT_GT(stats.filter_skips, 19000);
+    std::filesystem::remove(filename);
+}
+
+// Test every codec round-trips and SSTable blocks shrink through them
+TEST(SSTableTest, CompressedBlocks) {
+    std::string repetitive;
+    for (int i = 0; i < 1000; ++i) {
+        repetitive += "edge:" + std::to_string(i % 37) + ";";
+    }
+    std::string random;
+    for (int i = 0; i < 4096; ++i) {
+        random.push_back(static_cast<char>(std::rand()));
+    }
+    for (CompressionType type : {CompressionType::kLZ, CompressionType::kZlib}) {
+        for (const std::string& input : {std::string(), std::string("abc"), std::string(5000, 'a'), repetitive, random}) {
+            std::string compressed;
+            ASSERT_TRUE(Compression::compress(type, input, compressed));
+            ASSERT_EQ(Compression::decompress(type, compressed), input);
+        }
+        std::string compressed;
+        Compression::compress(type, repetitive, compressed);
+        ASSERT_LT(compressed.size(), repetitive.size() / 4);
+        ASSERT_THROW(Compression::decompress(type, compressed.substr(0, compressed.size() / 2)), std::runtime_error);
+
+        // a corrupt length must not turn into a huge allocation
+        std::string inflated;
+        Util::putVarint64(inflated, uint64_t(1) << 50);
+        inflated.append(compressed.substr(compressed.size() - 16));
+        ASSERT_THROW(Compression::decompress(type, inflated), std::runtime_error);
+    }
+    std::string long_run(1 << 20, 'x');
+    std::string compressed;
+    Compression::compress(CompressionType::kLZ, long_run, compressed);
+    ASSERT_EQ(Compression::decompress(CompressionType::kLZ, compressed), long_run);
+
+    const std::string filename = "./test_compressed_blocks.sst";
+    for (CompressionType type : {CompressionType::kNone, CompressionType::kLZ, CompressionType::kZlib}) {
+        CompressionStats stats;
+        SSTableOptions options;
+        options.compression = type;
+        options.compression_stats = &stats;
+        SSTable table(options);
+        for (int i = 0; i < 2000; ++i) {
+            table.insert({"person" + std::to_string(i), std::make_shared<GraphNodeMeta>()});
+        }
+        table.writeToDisk(filename);
+
+        if (type == CompressionType::kNone) {
+            ASSERT_EQ(stats.blocks_compressed, 0);
+        } else {
+            ASSERT_GT(stats.blocks_compressed, 0);
+            ASSERT_LT(stats.bytes_out, stats.bytes_in * 7 / 8);
+        }
+
+        for (bool use_mmap : {false, true}) {
+            options.use_mmap = use_mmap;
+            SSTableReader reader(filename, options);
+            for (int i = 0; i < 2000; ++i) {
+                ASSERT_TRUE(reader.get("person" + std::to_string(i)).has_value());
+            }
+            ASSERT_FALSE(reader.get("person2000").has_value());
+        }
+        ASSERT_EQ(stats.bytes_decompressed > 0, type != CompressionType::kNone);
+    }
+    std::filesystem::remove(filename);
+}
+
+// Test the adjacency codec round-trips and decodes just a neighbor prefix
+TEST(GraphNodeMetaTest, EncodeDecodeWithPrefix) {
+    GraphNodeMeta meta;
+    meta.set_data_id("data-1");
+    for (int i = 0; i < 100; ++i) {
+        meta.add_connection("company" + std::to_string(i), i % 3 == 0 ? '0' : '1');
+        meta.add_connection("person" + std::to_string(i), '1');
+    }
+
+    std::string encoded;
+    meta.encodeTo(encoded);
+    GraphNodeMeta decoded;
+    ASSERT_TRUE(decoded.decodeFrom(encoded));
+    ASSERT_EQ(decoded.get_data_id(), "data-1");
+    ASSERT_EQ(decoded.get_connections(), meta.get_connections());
+
+    ASSERT_TRUE(decoded.decodeFrom(encoded, "company1"));
+    ASSERT_EQ(decoded.get_connections().size(), 11); // company1, company10..19
+    ASSERT_TRUE(decoded.get_connections().count({"company12", '0'}));
+    ASSERT_TRUE(decoded.decodeFrom(encoded, "person99"));
+    ASSERT_EQ(decoded.get_connections().size(), 1);
+    ASSERT_TRUE(decoded.decodeFrom(encoded, "robot"));
+    ASSERT_TRUE(decoded.get_connections().empty());
+    ASSERT_FALSE(decoded.decodeFrom(std::string_view(encoded).substr(0, encoded.size() - 3)));
+
+    // a delta flushed after the full record is folded on top of it
+    const std::string base_file = "./test_meta_base.sst";
+    const std::string delta_file = "./test_meta_delta.sst";
+    SSTable base;
+    base.insert({"node", std::make_shared<GraphNodeMeta>(meta)});
+    base.writeToDisk(base_file);
+    GraphNodeMeta delta;
+    delta.set_type(GraphNodeMeta::Type::kDelta);
+    delta.add_connection("person5", '0');
+    delta.add_connection("person500", '1');
+    SSTable newer;
+    newer.insert({"node", std::make_shared<GraphNodeMeta>(delta)});
+    newer.writeToDisk(delta_file);
+
+    CompactionManager manager;
+    manager.addSSTable(base_file);
+    manager.addSSTable(delta_file);
+    auto folded = manager.getNodeMeta("node", "person5");
+    ASSERT_TRUE(folded.has_value());
+    ASSERT_FALSE(folded->is_delta());
+    ASSERT_EQ(folded->get_data_id(), "data-1");
+    std::set<std::pair<std::string, unsigned char>> expected = {
+        {"person5", '0'}, {"person50", '1'}, {"person500", '1'}, {"person51", '1'}, {"person52", '1'},
+        {"person53", '1'}, {"person54", '1'}, {"person55", '1'}, {"person56", '1'}, {"person57", '1'},
+        {"person58", '1'}, {"person59", '1'}};
+    ASSERT_EQ(folded->get_connections(), expected);
+    ASSERT_FALSE(manager.getNodeMeta("other").has_value());
+
+    // memtable dumps carry the records too
+    Memtable memtable(1 << 20);
+    memtable.insert("node", meta);
+    std::stringstream dump;
+    memtable.serialize(dump);
+    Memtable restored(1 << 20);
+    restored.deserialize(dump);
+    ASSERT_EQ(restored.get("node")->get_connections(), meta.get_connections());
+
+    std::filesystem::remove(base_file);
+    std::filesystem::remove(delta_file);
+}
+
+// Test the block cache keeps index/filter blocks over data blocks and
+// serves repeated SSTable lookups from memory
+TEST(BlockCacheTest, PrioritiesAndSSTableHits) {
+    for (auto policy : {BlockCache::Policy::kLRU, BlockCache::Policy::kClock}) {
+        BlockCache cache(64 * 1024, policy, 1);
+        cache.insert(1, 0, std::string(4096, 'i'), BlockCache::Priority::kHigh);
+        for (uint64_t offset = 1; offset <= 100; ++offset) {
+            cache.insert(1, offset * 4096, std::string(4096, 'd'), BlockCache::Priority::kLow);
+            ASSERT_LE(cache.memoryUsage(), cache.capacity());
+            if (offset % 10 == 0) {
+                ASSERT_NE(cache.lookup(1, 0), nullptr); // every table lookup reads the index
+            }
+        }
+        auto index = cache.lookup(1, 0);
+        ASSERT_NE(index, nullptr);
+        ASSERT_EQ(*index, std::string(4096, 'i'));
+        ASSERT_NE(cache.lookup(1, 100 * 4096), nullptr);
+        ASSERT_EQ(cache.lookup(1, 4096), nullptr);
+        ASSERT_EQ(cache.lookup(2, 0), nullptr);
+        ASSERT_EQ(cache.stats().hits, 12);
+        ASSERT_EQ(cache.stats().misses, 2);
+        ASSERT_GT(cache.stats().evictions, 80);
+
+        // a handle outlives the eviction of its block
+        cache.evict(cache.capacity());
+        ASSERT_EQ(cache.memoryUsage(), 0);
+        ASSERT_EQ(*index, std::string(4096, 'i'));
+    }
+
+    const std::string filename = "./test_block_cache.sst";
+    SSTableOptions options;
+    options.block_size = 256;
+    SSTable table(options);
+    for (int i = 0; i < 1000; ++i) {
+        table.insert({"node" + std::to_string(i), std::make_shared<GraphNodeMeta>()});
+    }
+    table.writeToDisk(filename);
+
+    BlockCache cache(1 << 20);
+    options.block_cache = &cache;
+    SSTableReadStats stats;
+    SSTableReader reader(filename, options, &stats);
+    for (int round = 0; round < 2; ++round) {
+        for (int i = 0; i < 1000; ++i) {
+            ASSERT_TRUE(reader.get("node" + std::to_string(i)).has_value());
+        }
+    }
+    // the second round never went to disk
+    uint64_t blocks = stats.block_reads;
+    ASSERT_GT(blocks, 10);
+    ASSERT_EQ(cache.stats().misses, blocks + 2); // + the index and filter
+    ASSERT_EQ(cache.stats().hits, 3 * 2000 - blocks - 1);
+    std::filesystem::remove(filename);
+}
+
+// Test flushed tables are compacted into level 1 and the manifest brings
+// the same levels back on reopen
+TEST(VersionSetTest, ManifestRecoversLevels) {
+    const std::string directory = "./test_version_set";
+    std::filesystem::remove_all(directory);
+
+    CompactionOptions compaction_options;
+    compaction_options.level0_file_trigger = 2;
+    uint64_t number = 0;
+    {
+        CompactionManager manager(directory, SSTableOptions(), compaction_options);
+        FlushingManager flusher(directory, &manager, manager.sstableOptions());
+
+        auto first = std::make_shared<Memtable>(SIZE_MAX);
+        for (int i = 0; i < 100; ++i) {
+            GraphNodeMeta meta;
+            meta.set_data_id("v1");
+            first->insert("node" + std::to_string(i), meta);
+        }
+        flusher.schedule(first);
+        flusher.run();
+        ASSERT_EQ(manager.currentVersion()->files(0).size(), 1);
+
+        auto second = std::make_shared<Memtable>(SIZE_MAX);
+        GraphNodeMeta delta;
+        delta.set_type(GraphNodeMeta::Type::kDelta);
+        delta.add_connection("node6", '1');
+        second->insert("node5", delta);
+        GraphNodeMeta added;
+        second->insert("node200", added);
+        flusher.schedule(second);
+        flusher.run();
+
+        // both level 0 tables were merged into one level 1 table
+        auto version = manager.currentVersion();
+        ASSERT_TRUE(version->files(0).empty());
+        ASSERT_EQ(version->files(1).size(), 1);
+        ASSERT_EQ(version->files(1)[0]->smallest, "node0");
+        ASSERT_EQ(version->files(1)[0]->largest, "node99");
+        ASSERT_EQ(version->files(1)[0]->num_entries, 101);
+        number = version->files(1)[0]->number;
+
+        auto meta = manager.getNodeMeta("node5");
+        ASSERT_TRUE(meta.has_value());
+        ASSERT_EQ(meta->get_data_id(), "v1");
+        ASSERT_EQ(meta->get_connections().size(), 1);
+
+        // a key past the table's range never reaches its filter
+        uint64_t checks = manager.readStats().filter_checks;
+        ASSERT_FALSE(manager.getNodeMeta("zzz").has_value());
+        ASSERT_EQ(manager.readStats().filter_checks, checks);
+    }
+
+    // a table the manifest doesn't list is left over from a crash
+    const std::string orphan = directory + "/9999.sst";
+    std::filesystem::copy_file(directory + "/" + std::to_string(number) + ".sst", orphan);
+
+    CompactionManager reopened(directory, SSTableOptions(), compaction_options);
+    auto version = reopened.currentVersion();
+    ASSERT_EQ(version->numFiles(), 1);
+    ASSERT_EQ(version->files(1).size(), 1);
+    ASSERT_EQ(version->files(1)[0]->number, number);
+    ASSERT_FALSE(std::filesystem::exists(orphan));
+    ASSERT_GT(reopened.newFileNumber(), number);
+    ASSERT_EQ(reopened.getNodeMeta("node5")->get_connections().size(), 1);
+    ASSERT_TRUE(reopened.getNodeMeta("node200").has_value());
+    std::filesystem::remove_all(directory);
+}
+
+// Test every table is synced, with its directory entry, before the manifest
+// lists it, and so before a flush lets the log checkpoint move past it
+TEST(VersionSetTest, TablesSyncedBeforeListed) {
+    const std::string directory = "./test_table_sync";
+    std::filesystem::remove_all(directory);
+
+    CompactionOptions compaction_options;
+    compaction_options.level0_file_trigger = 2;
+    CompactionManager manager(directory, SSTableOptions(), compaction_options);
+    FlushingManager flusher(directory, &manager, manager.sstableOptions());
+    const CompactionStats& stats = manager.compactionStats();
+
+    // the engine advances the checkpoint from this callback
+    std::vector<std::pair<uint64_t, uint64_t>> synced_when_flushed;
+    flusher.setFlushCallback([&](const std::shared_ptr<Memtable>&) {
+        synced_when_flushed.emplace_back(stats.tables_synced.load(), stats.directory_syncs.load());
+    });
+
+    for (int round = 0; round < 2; ++round) {
+        auto memtable = std::make_shared<Memtable>(SIZE_MAX);
+        for (int i = 0; i < 100; ++i) {
+            GraphNodeMeta meta;
+            meta.set_data_id("v" + std::to_string(round));
+            memtable->insert("node" + std::to_string(i), meta);
+        }
+        flusher.schedule(memtable);
+        flusher.run();
+    }
+
+    ASSERT_EQ(synced_when_flushed.size(), 2);
+    ASSERT_EQ(synced_when_flushed[0], std::make_pair(uint64_t(1), uint64_t(1)));
+    ASSERT_EQ(synced_when_flushed[1], std::make_pair(uint64_t(2), uint64_t(2)));
+
+    // the second flush crossed the trigger, the compaction output was synced
+    // before its inputs were dropped
+    auto version = manager.currentVersion();
+    ASSERT_TRUE(version->files(0).empty());
+    ASSERT_EQ(version->files(1).size(), 1);
+    ASSERT_EQ(stats.compactions, 1);
+    ASSERT_EQ(stats.tables_synced, 3);
+    ASSERT_EQ(stats.directory_syncs, 3);
+    std::filesystem::remove_all(directory);
+}
+
+// Test the manifest rolls to a fresh snapshot instead of growing with
+// every edit, and the snapshot recovers the same set
+TEST(VersionSetTest, ManifestRollsPastItsLimit) {
+    const std::string directory = "./test_manifest_roll";
+    std::filesystem::remove_all(directory);
+
+    auto manifests = [&] {
+        std::vector<std::filesystem::path> found;
+        for (const auto& entry : std::filesystem::directory_iterator(directory)) {
+            if (entry.path().filename().string().rfind("MANIFEST-", 0) == 0) {
+                found.push_back(entry.path());
+            }
+        }
+        return found;
+    };
+
+    {
+        VersionSet versions(directory, VersionSet::kNumLevels, 1024);
+        ASSERT_FALSE(versions.recover());
+        auto first = manifests();
+        ASSERT_EQ(first.size(), 1);
+
+        for (uint64_t i = 1; i <= 500; ++i) {
+            VersionEdit edit;
+            if (i % 50 == 0) {
+                FileMetaData file;
+                file.number = versions.newFileNumber();
+                file.smallest = file.largest = "node" + std::to_string(i);
+                edit.addFile(0, file);
+            }
+            edit.setLogCheckpoint(i);
+            versions.logAndApply(edit);
+        }
+
+        auto current = manifests();
+        ASSERT_EQ(current.size(), 1);
+        ASSERT_NE(current[0], first[0]);
+        ASSERT_LT(std::filesystem::file_size(current[0]), 2048);
+    }
+
+    VersionSet reopened(directory);
+    ASSERT_TRUE(reopened.recover());
+    ASSERT_EQ(reopened.current()->files(0).size(), 10);
+    ASSERT_EQ(reopened.logCheckpoint(), 500);
+    ASSERT_EQ(manifests().size(), 1);
+    std::filesystem::remove_all(directory);
+}
+
+// Test each policy scores its levels and picks the inputs its style calls for
+TEST(CompactionPolicyTest, LeveledAndSizeTieredPicks) {
+    auto file = [](uint64_t number, std::string smallest, std::string largest, uint64_t size, uint64_t sequence) {
+        FileMetaData meta;
+        meta.number = number;
+        meta.smallest = std::move(smallest);
+        meta.largest = std::move(largest);
+        meta.file_size = size;
+        meta.smallest_sequence = meta.largest_sequence = sequence;
+        return meta;
+    };
+
+    CompactionOptions options;
+    options.level0_file_trigger = 4;
+    options.level1_max_files = 0;
+    options.level1_max_bytes = 1000;
+    {
+        VersionSet versions;
+        VersionEdit edit;
+        edit.addFile(1, file(1, "a", "c", 600, 1));
+        edit.addFile(1, file(2, "d", "f", 600, 2));
+        edit.addFile(2, file(3, "a", "c", 5000, 0));
+        edit.addFile(2, file(4, "d", "f", 100, 0));
+        versions.logAndApply(edit);
+
+        LeveledCompactionPolicy policy(options);
+        auto scores = policy.scores(*versions.current());
+        ASSERT_DOUBLE_EQ(scores[1], 1.2);
+        ASSERT_DOUBLE_EQ(scores[2], 0.51); // level 2 may hold 10x level 1
+
+        // the level 1 file that overlaps the fewest level 2 bytes
+        auto job = policy.pick(*versions.current());
+        ASSERT_TRUE(job.has_value());
+        ASSERT_EQ(job->output_level, 2);
+        ASSERT_EQ(job->inputs.size(), 2);
+        ASSERT_EQ(job->inputs[0].files.front()->number, 2);
+        ASSERT_EQ(job->inputs[1].files.front()->number, 4);
+        ASSERT_TRUE(job->bottommost);
+        ASSERT_FALSE(job->isTrivialMove());
+    }
+
+    options.style = CompactionStyle::kSizeTiered;
+    options.level0_file_trigger = 3;
+    {
+        VersionSet versions;
+        VersionEdit edit;
+        edit.addFile(0, file(1, "a", "z", 100, 4));
+        edit.addFile(0, file(2, "a", "z", 100, 3));
+        edit.addFile(0, file(3, "a", "z", 100, 2));
+        edit.addFile(6, file(4, "a", "z", 10000, 1));
+        versions.logAndApply(edit);
+
+        // the three similar runs are merged, the big one is left alone
+        auto policy = CompactionPolicy::create(options);
+        ASSERT_DOUBLE_EQ(policy->scores(*versions.current())[0], 4.0 / 3);
+        auto job = policy->pick(*versions.current());
+        ASSERT_TRUE(job.has_value());
+        ASSERT_EQ(job->inputs.size(), 1);
+        ASSERT_EQ(job->inputs[0].files.size(), 3);
+        ASSERT_EQ(job->output_level, 0);
+        ASSERT_FALSE(job->bottommost);
+
+        // until the newer runs outweigh the oldest one
+        VersionEdit shrink;
+        shrink.deleteFile(6, 4);
+        shrink.addFile(6, file(4, "a", "z", 100, 1));
+        versions.logAndApply(shrink);
+        job = policy->pick(*versions.current());
+        ASSERT_EQ(job->inputs.size(), 2);
+        ASSERT_EQ(job->output_level, 6);
+        ASSERT_TRUE(job->bottommost);
+    }
+    ASSERT_THROW(CompactionPolicy::styleFromString("universal"), std::invalid_argument);
+
+    // size-tiered end to end: a flush per run, merged once there are two
+    const std::string directory = "./test_compaction_policy";
+    std::filesystem::remove_all(directory);
+    options.level0_file_trigger = 2;
+    {
+        CompactionManager manager(directory, SSTableOptions(), options);
+        FlushingManager flusher(directory, &manager, manager.sstableOptions());
+        for (int run = 0; run < 2; ++run) {
+            auto memtable = std::make_shared<Memtable>(SIZE_MAX);
+            GraphNodeMeta meta;
+            meta.set_data_id("v" + std::to_string(run));
+            memtable->insert("node" + std::to_string(run), meta);
+            memtable->insert("shared", meta);
+            flusher.schedule(memtable);
+            flusher.run();
+        }
+        auto version = manager.currentVersion();
+        ASSERT_EQ(version->numFiles(), 1);
+        ASSERT_EQ(version->files(version->numLevels() - 1).size(), 1);
+        ASSERT_EQ(manager.getNodeMeta("shared")->get_data_id(), "v1");
+        ASSERT_EQ(manager.getNodeMeta("node0")->get_data_id(), "v0");
+        ASSERT_LT(manager.levelScores()[0], 1);
+    }
+    std::filesystem::remove_all(directory);
+}
+
+// Test a compaction is split into disjoint key ranges merged on the pool
+TEST(CompactionManagerTest, ParallelSubcompactions) {
+    const std::string directory = "./test_subcompactions";
+    std::filesystem::remove_all(directory);
+
+    SSTableOptions options;
+    options.block_size = 256;
+    options.compression = CompressionType::kNone;
+    CompactionOptions compaction_options;
+    compaction_options.level0_file_trigger = 2;
+    compaction_options.max_subcompactions = 4;
+
+    ThreadPool pool(4);
+    CompactionManager manager(directory, options, compaction_options);
+    manager.setThreadPool(&pool);
+    FlushingManager flusher(directory, &manager, manager.sstableOptions());
+    for (int run = 0; run < 2; ++run) {
+        auto memtable = std::make_shared<Memtable>(SIZE_MAX);
+        for (int i = run * 500; i < 2000 + run * 500; ++i) {
+            GraphNodeMeta meta;
+            meta.set_data_id("v" + std::to_string(run));
+            memtable->insert("node" + std::to_string(10000 + i), meta);
+        }
+        flusher.schedule(memtable);
+        flusher.run();
+    }
+
+    // level 1 holds one table per range, in key order and disjoint
+    auto version = manager.currentVersion();
+    ASSERT_TRUE(version->files(0).empty());
+    const auto& files = version->files(1);
+    ASSERT_EQ(files.size(), 4);
+    uint64_t entries = 0;
+    for (size_t i = 0; i < files.size(); ++i) {
+        entries += files[i]->num_entries;
+        if (i > 0) {
+            ASSERT_LT(files[i - 1]->largest, files[i]->smallest);
+        }
+    }
+    ASSERT_EQ(entries, 2500);
+
+    for (int i = 0; i < 2500; ++i) {
+        auto meta = manager.getNodeMeta("node" + std::to_string(10000 + i));
+        ASSERT_TRUE(meta.has_value());
+        ASSERT_EQ(meta->get_data_id(), i < 500 ? "v0" : "v1");
+    }
+    manager.setThreadPool(nullptr);
+    std::filesystem::remove_all(directory);
+}
+
+// Test the merge folds each key oldest source first and compaction output
+// is streamed into tables cut at the target size
+TEST(MergingIteratorTest, FoldsSourcesAndCutsTables) {
+    const std::string filename = "./test_merging_iterator.sst";
+    {
+        std::ofstream out(filename, std::ios::binary);
+        SSTableBuilder builder(out);
+        for (const std::string key : {"a", "c", "e"}) {
+            GraphNodeMeta meta;
+            meta.set_data_id("sst");
+            std::string encoded;
+            meta.encodeTo(encoded);
+            builder.add(key, encoded);
+        }
+        builder.finish();
+        ASSERT_EQ(builder.numEntries(), 3);
+        ASSERT_EQ(builder.lastKey(), "e");
+    }
+    SSTableReader reader(filename);
+
+    Memtable older(SIZE_MAX);
+    Memtable newer(SIZE_MAX);
+    GraphNodeMeta node;
+    node.set_data_id("memtable");
+    older.insert("b", node);
+    older.insert("c", node);
+    GraphNodeMeta delta;
+    delta.set_type(GraphNodeMeta::Type::kDelta);
+    delta.add_connection("x", '1');
+    newer.insert("c", delta);
+    newer.insert("d", delta);
+
+    std::vector<std::unique_ptr<MergeSource>> sources;
+    sources.push_back(std::make_unique<SSTableSource>(&reader));
+    sources.push_back(std::make_unique<MemtableSource>(older.newIterator()));
+    sources.push_back(std::make_unique<MemtableSource>(newer.newIterator()));
+    MergingIterator it(std::move(sources));
+
+    std::vector<std::string> keys;
+    for (it.SeekToFirst(); it.Valid(); it.Next()) {
+        keys.emplace_back(it.key());
+    }
+    ASSERT_EQ(keys, std::vector<std::string>({"a", "b", "c", "d", "e"}));
+
+    // "c": the sstable's node, replaced by the older memtable's, then the delta
+    it.Seek("c");
+    ASSERT_EQ(it.key(), "c");
+    ASSERT_EQ(it.value().get_data_id(), "memtable");
+    ASSERT_EQ(it.value().get_connections().size(), 1);
+    ASSERT_FALSE(it.value().is_delta());
+    it.Next();
+    ASSERT_TRUE(it.value().is_delta());
+    std::filesystem::remove(filename);
+
+    const std::string directory = "./test_target_file_size";
+    std::filesystem::remove_all(directory);
+    SSTableOptions options;
+    options.compression = CompressionType::kNone;
+    options.bottommost_compression = CompressionType::kNone;
+    CompactionOptions compaction_options;
+    compaction_options.level0_file_trigger = 2;
+    compaction_options.target_file_size = 16 * 1024;
+    CompactionManager manager(directory, options, compaction_options);
+    FlushingManager flusher(directory, &manager, manager.sstableOptions());
+    for (int run = 0; run < 2; ++run) {
+        auto memtable = std::make_shared<Memtable>(SIZE_MAX);
+        for (int i = 0; i < 3000; ++i) {
+            GraphNodeMeta meta;
+            meta.set_data_id("value" + std::to_string(run));
+            memtable->insert("node" + std::to_string(10000 + i), meta);
+        }
+        flusher.schedule(memtable);
+        flusher.run();
+    }
+    const auto& files = manager.currentVersion()->files(1);
+    ASSERT_GT(files.size(), 2);
+    uint64_t entries = 0;
+    for (const auto& file : files) {
+        ASSERT_LT(file->file_size, 2 * compaction_options.target_file_size);
+        entries += file->num_entries;
+    }
+    ASSERT_EQ(entries, 3000);
+    ASSERT_EQ(manager.getNodeMeta("node12999")->get_data_id(), "value1");
+    std::filesystem::remove_all(directory);
+}
+
+// Test a compaction into the bottom level drops tombstones and deleted
+// edges, and releases the data of replaced node records
+TEST(CompactionManagerTest, DropsTombstonesAndDeletedEdges) {
+    const std::string directory = "./test_tombstones";
+    std::filesystem::remove_all(directory);
+
+    CompactionOptions compaction_options;
+    compaction_options.level0_file_trigger = 2;
+    CompactionManager manager(directory, SSTableOptions(), compaction_options);
+    std::vector<std::string> released;
+    manager.setDataReleaseCallback([&](const std::string& data_id) { released.push_back(data_id); });
+    FlushingManager flusher(directory, &manager, manager.sstableOptions());
+
+    auto node = [](const std::string& data_id) {
+        GraphNodeMeta meta;
+        meta.set_data_id(data_id);
+        return meta;
+    };
+    auto first = std::make_shared<Memtable>(SIZE_MAX);
+    GraphNodeMeta follower = node("a1");
+    follower.add_connection("b", '1');
+    follower.add_connection("c", '1');
+    first->insert("a", follower);
+    GraphNodeMeta replaced = node("r1");
+    first->insert("r", replaced);
+    GraphNodeMeta deleted = node("t1");
+    first->insert("t", deleted);
+    flusher.schedule(first);
+    flusher.run();
+
+    auto second = std::make_shared<Memtable>(SIZE_MAX);
+    GraphNodeMeta unfollow;
+    unfollow.set_type(GraphNodeMeta::Type::kDelta);
+    unfollow.add_connection("b", '0');
+    unfollow.add_connection("c", '0');
+    second->insert("a", unfollow);
+    GraphNodeMeta replacement = node("r2");
+    second->insert("r", replacement);
+    GraphNodeMeta tombstone;
+    tombstone.set_type(GraphNodeMeta::Type::kTombstone);
+    second->insert("t", tombstone);
+    GraphNodeMeta orphan_delta;
+    orphan_delta.set_type(GraphNodeMeta::Type::kDelta);
+    orphan_delta.add_connection("a", '0');
+    second->insert("z", orphan_delta);
+    flusher.schedule(second);
+    flusher.run();
+
+    // nothing lives below level 1, so nothing is left for the deletes to hide
+    ASSERT_EQ(manager.currentVersion()->files(1).size(), 1);
+    ASSERT_EQ(manager.currentVersion()->files(1)[0]->num_entries, 2);
+    auto a = manager.getNodeMeta("a");
+    ASSERT_TRUE(a.has_value());
+    ASSERT_TRUE(a->get_connections().empty());
+    ASSERT_EQ(manager.getNodeMeta("r")->get_data_id(), "r2");
+    ASSERT_FALSE(manager.getNodeMeta("t").has_value());
+    ASSERT_FALSE(manager.getNodeMeta("z").has_value());
+
+    std::sort(released.begin(), released.end());
+    ASSERT_EQ(released, std::vector<std::string>({"r1", "t1"}));
+    const auto& stats = manager.compactionStats();
+    ASSERT_EQ(stats.compactions, 1);
+    ASSERT_EQ(stats.tombstones_dropped, 1);
+    ASSERT_EQ(stats.edges_dropped, 3);
+    ASSERT_EQ(stats.records_dropped, 2);
+    ASSERT_EQ(stats.data_ids_released, 2);
+    ASSERT_GT(stats.bytes_reclaimed, 0);
+    std::filesystem::remove_all(directory);
+}
+
+// Test batched lookups through io_uring and through pread threads find
+// what single lookups find, reading each missing block once
+TEST(CompactionManagerTest, MultiGetBatchesBlockReads) {
+    const std::string directory = "./test_multiget";
+    for (auto type : {IOBackendType::kIoUring, IOBackendType::kPread}) {
+        std::filesystem::remove_all(directory);
+        auto io = IOBackend::create(type, 8);
+        BlockCache cache(1 << 20);
+        SSTableOptions options;
+        options.block_size = 256;
+        options.block_cache = &cache;
+        options.io_backend = io.get();
+        CompactionManager manager(directory, options);
+        FlushingManager flusher(directory, &manager, manager.sstableOptions());
+
+        auto full = std::make_shared<Memtable>(SIZE_MAX);
+        auto deltas = std::make_shared<Memtable>(SIZE_MAX);
+        for (int i = 0; i < 500; ++i) {
+            std::string key = "node" + std::to_string(1000 + i);
+            GraphNodeMeta meta;
+            meta.set_data_id("data" + std::to_string(i));
+            meta.add_connection("a", '1');
+            full->insert(key, meta);
+            if (i % 2 == 0) {
+                GraphNodeMeta delta;
+                delta.set_type(GraphNodeMeta::Type::kDelta);
+                delta.add_connection("b", '1');
+                deltas->insert(key, delta);
+            }
+        }
+        flusher.schedule(full);
+        flusher.run();
+        flusher.schedule(deltas);
+        flusher.run();
+        ASSERT_EQ(manager.currentVersion()->files(0).size(), 2);
+
+        std::vector<std::string> keys;
+        for (int i = 0; i < 500; i += 7) {
+            keys.push_back("node" + std::to_string(1000 + i));
+        }
+        keys.push_back("node1003");  // twice, one read serves both
+        keys.push_back("missing");
+
+        uint64_t reads_before = manager.readStats().block_reads;
+        auto batched = manager.multiGetNodeMeta(keys);
+        ASSERT_EQ(batched.size(), keys.size());
+        ASSERT_FALSE(batched.back().has_value());
+        for (size_t i = 0; i + 1 < keys.size(); ++i) {
+            auto single = manager.getNodeMeta(keys[i]);
+            ASSERT_TRUE(batched[i].has_value()) << keys[i];
+            ASSERT_EQ(batched[i]->get_data_id(), single->get_data_id());
+            ASSERT_EQ(batched[i]->get_connections(), single->get_connections());
+        }
+        ASSERT_EQ(batched[0]->get_connections().size(), 2);
+
+        // the batch left every block it read in the cache
+        uint64_t reads = manager.readStats().block_reads - reads_before;
+        ASSERT_GT(reads, 0);
+        ASSERT_LT(reads, keys.size() * 2);
+        reads_before = manager.readStats().block_reads;
+        manager.multiGetNodeMeta(keys);
+        ASSERT_EQ(manager.readStats().block_reads, reads_before);
+    }
+    std::filesystem::remove_all(directory);
+}
+
+// Test a batched read hands back each node's data in the order asked, from
+// the object cache, the memtables or, only for the flushed ones, SSTables
+TEST(StorageEngineReadTest, GetNodesDataMixesSources) {
+    EngineConfig config;
+    config.data_directory = "./test_nodes_data";
+    config.memtable_shards = 1;
+    config.memtable_size = 4096;
+    std::filesystem::remove_all(config.data_directory);
+    {
+        StorageEngine engine(config);
+        std::vector<unsigned char> node_data = {'n', 'o', 'd', 'e'};
+        std::vector<std::string> node_ids;
+        for (int i = 0; i < 200; ++i) {
+            node_ids.push_back(engine.create_node(node_data));
+        }
+        // the oldest memtables were rotated out, now they are on disc only
+        engine.triggerFlush();
+        if (engine.getActiveMemtableSize() == 0) {
+            node_ids.push_back(engine.create_node(node_data));
+        }
+        const std::string on_disk = node_ids.front();
+        const std::string cached = node_ids[node_ids.size() / 2];
+        const std::string in_memtable = node_ids.back();
+        std::string cached_id = engine.get_node_data(cached).get_id();
+
+        uint64_t filter_checks = engine.getSSTableReadStats().filter_checks;
+        auto results = engine.get_nodes_data({cached, in_memtable, on_disk, node_ids[1]});
+        ASSERT_EQ(results.size(), 4);
+        ASSERT_GT(engine.getSSTableReadStats().filter_checks, filter_checks);
+        ASSERT_EQ(results[0].get_id(), cached_id);
+        ASSERT_EQ(results[1].get_id(), engine.get_node_data(in_memtable).get_id());
+        ASSERT_EQ(results[2].get_id(), engine.get_node_data(on_disk).get_id());
+        ASSERT_EQ(results[3].get_id(), engine.get_node_data(node_ids[1]).get_id());
+        ASSERT_NE(results[2].get_id(), results[3].get_id());
+
+        // a memtable or the cache answers without touching an SSTable
+        filter_checks = engine.getSSTableReadStats().filter_checks;
+        std::string fresh;
+        do {
+            fresh = engine.create_node(node_data);
+        } while (engine.getActiveMemtableSize() == 0);  // it filled and rotated one
+        ASSERT_EQ(engine.get_nodes_data({fresh, cached}).size(), 2);
+        ASSERT_EQ(engine.getSSTableReadStats().filter_checks, filter_checks);
+        ASSERT_TRUE(engine.get_nodes_data({}).empty());
+        ASSERT_THROW(engine.get_nodes_data({on_disk, "missing"}), std::invalid_argument);
+    }
+    std::filesystem::remove_all(config.data_directory);
+}
+
+// Test concurrent writers through a small ring: every record reaches the
+// segments once, in each writer's order, with syncs shared between writers
+TEST(MergeLogTest, GroupCommitsConcurrentWriters) {
+    const std::string directory = "./test_wal";
+    std::filesystem::remove_all(directory);
+    MergeLogOptions options;
+    options.buffer_size = 4096;
+    options.segment_size = 64 * 1024;
+    const int writers = 8;
+    const int records = 1000;
+    uint64_t end = 0;
+    {
+        MergeLog log(directory, options);
+        std::vector<std::thread> threads;
+        for (int w = 0; w < writers; ++w) {
+            threads.emplace_back([&log, w]() {
+                for (int i = 0; i < records; ++i) {
+                    GraphNodeMeta meta;
+                    meta.set_data_id(std::to_string(i));
+                    uint64_t position = log.add("writer" + std::to_string(w), meta);
+                    if (i % 10 == 0) {
+                        log.waitFor(position, true);
+                    }
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        log.toDisc();
+        end = log.position();
+        ASSERT_EQ(log.stats().records, writers * records);
+        ASSERT_LT(log.stats().syncs, writers * records / 10);
+    }
+
+    auto segments = MergeLog::segments(directory);
+    ASSERT_GT(segments.size(), 1);
+    std::vector<int> next(writers, 0);
+    uint64_t last_position = 0;
+    size_t count = 0;
+    for (const auto& segment : segments) {
+        MergeLog::Reader reader(segment);
+        LogRecord record;
+        while (reader.next(record)) {
+            ASSERT_TRUE(count == 0 || record.position > last_position);
+            last_position = record.position;
+            int w = std::stoi(record.key.substr(6));
+            ASSERT_EQ(record.meta.get_data_id(), std::to_string(next[w]++));
+            ++count;
+        }
+        ASSERT_FALSE(reader.corrupted());
+    }
+    ASSERT_EQ(count, writers * records);
+
+    // a torn tail ends the segment, the next run cuts it off and carries on
+    {
+        MergeLog::Reader reader(segments.back());
+        LogRecord record;
+        while (reader.next(record)) {
+        }
+        std::fstream tail(segments.back(), std::ios::binary | std::ios::in | std::ios::out);
+        tail.seekp(static_cast<std::streamoff>(reader.validBytes()));
+        tail << "torn";
+    }
+    {
+        MergeLog log(directory, options);
+        ASSERT_EQ(log.position(), end);
+    }
+    MergeLog::Reader reader(segments.back());
+    LogRecord record;
+    while (reader.next(record)) {
+    }
+    ASSERT_FALSE(reader.corrupted());
+    ASSERT_EQ(reader.endPosition(), end);
+    std::filesystem::remove_all(directory);
+}
+
+// Test each sync mode waits for as much as it promises, and that a write
+// may ask for more than the engine's default
+TEST(MergeLogTest, SyncModes) {
+    const std::string directory = "./test_sync_modes";
+    std::filesystem::remove_all(directory);
+    GraphNodeMeta meta;
+    meta.set_data_id("data");
+    {
+        MergeLogOptions options;
+        options.write_interval_ms = 60000;
+        MergeLog log(directory + "/explicit", options);
+        ASSERT_THROW(log.commit(log.add("a", meta), SyncMode::kDefault), std::invalid_argument);
+        log.commit(log.add("b", meta), SyncMode::kPeriodic);
+        ASSERT_GE(log.stats().writes, 1);
+        ASSERT_EQ(log.stats().syncs, 0);
+        log.commit(log.add("c", meta), SyncMode::kSync);
+        ASSERT_EQ(log.stats().syncs, 1);
+    }
+    {
+        // nobody waits, the log thread syncs on its own
+        MergeLogOptions options;
+        options.write_interval_ms = 60000;
+        options.sync_interval_ms = 20;
+        MergeLog log(directory + "/periodic", options);
+        log.commit(log.add("d", meta), SyncMode::kAsync);
+        for (int i = 0; i < 500 && log.stats().syncs == 0; ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        ASSERT_EQ(log.stats().records, 1);
+        ASSERT_GE(log.stats().syncs, 1);
+    }
+
+    EngineConfig config;
+    config.data_directory = directory + "/engine";
+    config.wal_sync_mode = SyncMode::kAsync;
+    {
+        StorageEngine engine(config);
+        std::vector<unsigned char> node_data = {'d', 'a', 't', 'a'};
+        std::string node_id = engine.create_node(node_data, SyncMode::kSync);
+
+        bool logged = false;
+        for (const auto& segment : MergeLog::segments(config.data_directory + "/wal")) {
+            MergeLog::Reader reader(segment);
+            LogRecord record;
+            while (reader.next(record)) {
+                logged = logged || record.key == node_id;
+            }
+        }
+        ASSERT_TRUE(logged);
+    }
+    std::filesystem::remove_all(directory);
+}
+
+// Test segments are preallocated, freed segments are written over instead
+// of being deleted, and the records left in them are never read back
+TEST(MergeLogTest, RecyclesPreallocatedSegments) {
+    const std::string directory = "./test_recycle";
+    std::filesystem::remove_all(directory);
+    MergeLogOptions options;
+    options.segment_size = 16 << 10;
+    options.recycle_segments = 2;
+    GraphNodeMeta meta;
+    meta.set_data_id("data");
+    auto countFree = [&directory]() {
+        size_t count = 0;
+        for (const auto& entry : std::filesystem::directory_iterator(directory)) {
+            count += entry.path().extension() == ".free";
+        }
+        return count;
+    };
+
+    uint64_t checkpoint = 0;
+    int after_checkpoint = 0;
+    {
+        MergeLog log(directory, options);
+        while (MergeLog::segments(directory).size() < 5) {
+            log.add("before", meta);
+            log.toDisc();
+        }
+        ASSERT_EQ(std::filesystem::file_size(MergeLog::segments(directory).front()), options.segment_size);
+
+        checkpoint = log.position();
+        ASSERT_EQ(log.removeSegments(checkpoint), 4);
+        ASSERT_EQ(MergeLog::segments(directory).size(), 1);
+        ASSERT_EQ(countFree(), 2);
+
+        while (log.stats().segments_recycled < 2) {
+            log.add("after", meta);
+            log.toDisc();
+            ++after_checkpoint;
+        }
+        ASSERT_EQ(countFree(), 0);
+        ASSERT_EQ(log.stats().segments_created, 5 + log.stats().segments_recycled - 2);
+    }
+
+    // the recycled segments still hold "before" records behind the new ones
+    int replayed = 0;
+    uint64_t last_end = 0;
+    for (const auto& segment : MergeLog::segments(directory)) {
+        MergeLog::Reader reader(segment);
+        LogRecord record;
+        while (reader.next(record)) {
+            ASSERT_TRUE(last_end == 0 || record.position == last_end);
+            last_end = record.end_position;
+            replayed += record.end_position > checkpoint;
+            ASSERT_EQ(record.key, record.end_position > checkpoint ? "after" : "before");
+        }
+        ASSERT_FALSE(reader.corrupted());
+    }
+    ASSERT_EQ(replayed, after_checkpoint);
+    std::filesystem::remove_all(directory);
+}
+
+// Test replay hands every record of the log to its partition in log order,
+// across segments scanned side by side, that an engine that crashed gets
+// its nodes back from the log and one shut down cleanly from its SSTables
+TEST(RecoveryTest, ReplaysLogIntoPartitions) {
+    const std::string directory = "./test_replay";
+    std::filesystem::remove_all(directory);
+    const int keys = 16;
+    const int records = 5000;
+    {
+        MergeLogOptions options;
+        options.segment_size = 8 << 10;
+        MergeLog log(directory + "/wal", options);
+        for (int i = 0; i < records; ++i) {
+            GraphNodeMeta meta;
+            meta.set_data_id(std::to_string(i));
+            log.add("node" + std::to_string(i % keys), meta);
+        }
+    }
+    ASSERT_GT(MergeLog::segments(directory + "/wal").size(), 4);
+
+    const size_t partitions = 4;
+    std::vector<std::map<std::string, int>> last(partitions);
+    std::atomic<int> replayed{0};
+    DurabilityManager durability_manager;
+    ReplayStats stats = durability_manager.replayLog(
+        directory + "/wal", 0, partitions,
+        [](const std::string& key) { return std::stoul(key.substr(4)) % partitions; },
+        [&](size_t partition, const LogRecord& record) {
+            // one thread per partition, no locking needed
+            int i = std::stoi(record.meta.get_data_id());
+            ASSERT_EQ(partition, std::stoul(record.key.substr(4)) % partitions);
+            auto it = last[partition].find(record.key);
+            ASSERT_TRUE(it == last[partition].end() ? i < keys : i == it->second + keys);
+            last[partition][record.key] = i;
+            ++replayed;
+        },
+        3);
+    ASSERT_EQ(replayed, records);
+    ASSERT_EQ(stats.records, records);
+    ASSERT_EQ(stats.segments, MergeLog::segments(directory + "/wal").size());
+    ASSERT_GT(stats.bytes, 0);
+    ASSERT_GT(stats.recordsPerSecond(), 0);
+
+    EngineConfig config;
+    config.data_directory = directory + "/engine";
+    config.memtable_shards = 4;
+    std::string a, b, c;
+    {
+        StorageEngine engine(config);
+        std::vector<unsigned char> node_data = {'d', 'a', 't', 'a'};
+        a = engine.create_node(node_data);
+        b = engine.create_node(node_data);
+        c = engine.create_node(node_data);
+        engine.add_connection(a, b);
+        engine.delete_node(c);
+        ASSERT_EQ(engine.getRecoveryStats().records, 0);
+
+        // what a crash leaves behind: nothing flushed, everything logged
+        std::filesystem::copy(config.data_directory, directory + "/crashed", std::filesystem::copy_options::recursive);
+    }
+    config.data_directory = directory + "/crashed";
+    {
+        StorageEngine engine(config);
+        const ReplayStats& recovered = engine.getRecoveryStats();
+        ASSERT_EQ(recovered.records, 5);
+        ASSERT_GE(recovered.ready_seconds, recovered.seconds);
+        engine.add_connection(b, a);
+        ASSERT_THROW(engine.add_connection(a, c), std::invalid_argument);
+    }
+
+    // the clean shutdown flushed everything, the checkpoint covers the log
+    config.data_directory = directory + "/engine";
+    {
+        StorageEngine engine(config);
+        ASSERT_EQ(engine.getRecoveryStats().records, 0);
+        ASSERT_TRUE(engine.node_exists(a));
+        ASSERT_TRUE(engine.node_exists(b));
+        ASSERT_FALSE(engine.node_exists(c));
+        ASSERT_EQ(engine.match_connections(a, ""), std::vector<std::string>{b});
+        engine.add_connection(b, a);
+        ASSERT_THROW(engine.add_connection(a, c), std::invalid_argument);
+    }
+    std::filesystem::remove_all(directory);
+}
+
+// Test flushes checkpoint the log: the segments a checkpoint covers are
+// deleted, the log stays near max_wal_size however much is written and a
+// crash only replays what came after the checkpoint
+TEST(RecoveryTest, CheckpointsBoundTheLog) {
+    const std::string directory = "./test_checkpoint";
+    std::filesystem::remove_all(directory);
+    EngineConfig config;
+    config.data_directory = directory + "/engine";
+    config.memtable_shards = 2;
+    config.memtable_size = 64 << 20;  // flushes only come from the log limit
+    config.wal_segment_size = 16 << 10;
+    config.max_wal_size = 128 << 10;
+    config.compaction_threshold = 1000;
+    config.wal_sync_mode = SyncMode::kAsync;
+    const int nodes = 20000;
+    std::string first, last;
+    {
+        StorageEngine engine(config);
+        std::vector<unsigned char> node_data = {'d'};
+        first = engine.create_node(node_data);
+        for (int i = 1; i < nodes - 1; ++i) {
+            engine.create_node(node_data);
+        }
+        last = engine.create_node(node_data, SyncMode::kSync);
+
+        // let the flushes in flight finish
+        engine.triggerFlush();
+
+        ASSERT_GT(engine.getLogCheckpoint(), 0);
+        ASSERT_GT(engine.getLogStats().bytes_written, 8 * config.max_wal_size);
+        uint64_t log_bytes = 0;
+        for (const auto& segment : MergeLog::segments(config.data_directory + "/wal")) {
+            log_bytes += std::filesystem::file_size(segment);
+        }
+        // writes go on while the early flushes run, the log may overshoot
+        ASSERT_LE(log_bytes, 2 * config.max_wal_size);
+
+        std::filesystem::copy(config.data_directory, directory + "/crashed", std::filesystem::copy_options::recursive);
+    }
+
+    config.data_directory = directory + "/crashed";
+    {
+        StorageEngine engine(config);
+        const ReplayStats& recovered = engine.getRecoveryStats();
+        ASSERT_GT(recovered.records, 0);
+        ASSERT_LT(recovered.records, nodes / 2);
+        ASSERT_LE(recovered.bytes, 2 * config.max_wal_size);
+        ASSERT_TRUE(engine.node_exists(last));
+        // flushed long before the crash, back from the SSTables
+        ASSERT_TRUE(engine.node_exists(first));
+    }
+    std::filesystem::remove_all(directory);
+}
+
+// Test a node's data survives a reopen, back from the SSTables after a
+// clean shutdown and from the log after a crash, and the node can be deleted
+TEST(RecoveryTest, NodeDataAfterReopen) {
+    const std::string directory = "./test_reopen";
+    std::filesystem::remove_all(directory);
+    std::filesystem::remove_all(directory + "_crashed");
+    EngineConfig config;
+    config.data_directory = directory;
+    std::vector<unsigned char> node_data = {'d', 'a', 't', 'a'};
+    std::string written;
+    std::string data_id;
+    {
+        StorageEngine engine(config);
+        written = engine.create_node(node_data, SyncMode::kSync);
+        data_id = engine.get_node_data(written).get_id();
+        std::filesystem::copy(config.data_directory, directory + "_crashed", std::filesystem::copy_options::recursive);
+    }
+
+    for (const std::string& reopened : {directory, directory + "_crashed"}) {
+        config.data_directory = reopened;
+        StorageEngine engine(config);
+        ASSERT_EQ(engine.getRecoveryStats().records, reopened == directory ? 0 : 1);
+        ASSERT_TRUE(engine.node_exists(written));
+        auto data = engine.get_node_data(written);
+        ASSERT_EQ(data.get_data(), node_data);
+        ASSERT_EQ(data.get_id(), data_id);
+        ASSERT_EQ(engine.get_nodes_data({written})[0].get_data(), node_data);
+
+        std::string fresh = engine.create_node(node_data);
+        ASSERT_EQ(engine.get_node_data(fresh).get_data(), node_data);
+        engine.delete_node(written);
+        ASSERT_FALSE(engine.node_exists(written));
+        ASSERT_THROW(engine.get_node_data(written), std::invalid_argument);
+    }
+    std::filesystem::remove_all(directory);
+    std::filesystem::remove_all(directory + "_crashed");
+}
+
+// Test the object cache stays within its capacity and drops the LRU entry
+TEST(ObjectCacheTest, EvictsLeastRecentlyUsed) {
+    MemoryTracker tracker;
+    GraphNodeData<void*> data(std::vector<unsigned char>(100, 'x'));
+    {
+        ObjectCache probe;
+        probe.put("probe", data);
+        size_t entry_size = probe.memoryUsage();
+
+        ObjectCache cache(3 * entry_size, &tracker);
+        cache.put("a", data);
+        cache.put("b", data);
+        cache.put("c", data);
+
+        uint8_t error_code = 0;
+        cache.get("a", error_code); // b is now the least recently used
+        cache.put("d", data);
+
+        ASSERT_LE(cache.memoryUsage(), cache.capacity());
+        ASSERT_EQ(tracker.usage(MemoryTracker::Component::kObjectCache), cache.memoryUsage());
+        cache.get("b", error_code);
+        ASSERT_EQ(error_code, 1);
+        cache.get("a", error_code);
+        ASSERT_EQ(error_code, 0);
+    }
+    ASSERT_EQ(tracker.total(), 0);
+}
+
+// Test the engine accounts its memtables and indexes, and flushes memtables
+// early once the memory budget is exceeded
+TEST(StorageEngineMemoryTest, EnforcesMemoryBudget) {
+    EngineConfig config;
+    config.data_directory = "./test_memory_data";
+    config.memtable_shards = 1;
+    config.memtable_size = 2 * 1024 * 1024;
+    config.memory_budget = 2 * 1024 * 1024;
+    {
+        StorageEngine engine(config);
+        for (int i = 0; i < 5000; ++i) {
+            std::vector<unsigned char> node_data(256, 'n');
+            engine.create_node(node_data);
+        }
+
+        auto usage = engine.getMemoryUsage();
+        ASSERT_GT(usage.memtables, 0);
+        ASSERT_GT(usage.node_id_index, 0);
+        ASSERT_GT(usage.node_data_index, 5000 * 256);
+        ASSERT_EQ(usage.total, usage.memtables + usage.object_cache + usage.block_cache +
+                               usage.node_id_index + usage.node_data_index);
+        // the indexes alone are over budget, so the memtable was pushed to
+        // disc long before reaching memtable_size
+        ASSERT_LT(engine.getActiveMemtableSize(), config.memtable_size / 4 + 1024);
+    }
+    ASSERT_FALSE(std::filesystem::is_empty(config.data_directory));
+    std::filesystem::remove_all(config.data_directory);
+}
+
 int main(int argc, char **argv) {
     ::testing::InitGoogleTest(&argc, argv);
     return RUN_ALL_TESTS();